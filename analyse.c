@@ -92,6 +92,18 @@ void *analyse(Program *prog) {
     }
 }
 
+// Infers the types of the expressions in a program that has already passed
+// analysis, after the optimiser has rewritten it (the reducer leaves the
+// nodes it creates untyped)
+void infer_types(Program *prog, void *table) {
+    Procs *procs = prog->procedures;
+    while (procs != NULL) {
+        Proc *p = procs->first;
+        analyse_statements(p->body->statements, table, p->header->id);
+        procs = procs->rest;
+    }
+}
+
 void report_unused_symbols(const void *node) {
     if (node != NULL) {
         symbol *s = (symbol *) node;
@@ -135,6 +147,7 @@ void analyse_statements(Stmts *statements, sym_table *table, char *scope_id) {
         // Switch on kind of statement and print appropriately
         switch (kind) {
             case STMT_ASSIGN:
+            case STMT_BIND:
                 analyse_assign(&info->assign, table, scope_id, line_no);
                 break;
 
@@ -157,6 +170,10 @@ void analyse_statements(Stmts *statements, sym_table *table, char *scope_id) {
             case STMT_FUNC:
                 analyse_function(info->func, table, scope_id, line_no);
                 break;
+
+            case STMT_ADVANCE:
+                // only the optimiser creates these, already well typed
+                break;
         }
         statements = statements->rest;
     }
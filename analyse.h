@@ -16,4 +16,8 @@
 //main know about our program.
 void *analyse(Program *prog);
 
+//Infers expression types again once the optimiser has rewritten an
+//analysed program, using the table analyse returned.
+void infer_types(Program *prog, void *table);
+
 void setInvalid();
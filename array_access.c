@@ -14,6 +14,7 @@
 #include "ast.h"
 #include "symbol.h"
 #include "array_access.h"
+#include "passes.h"
 
 
 Intervals *create_dbounds_node(int lower, int upper, int offset_coefficient);
@@ -57,8 +58,10 @@ ArrayAccess *get_array_access(Expr *expr, Bounds *array_bounds) {
         int lower = array_bounds->first->lower;
         offset_coefficient /= (upper - lower + 1);
 
-        //static expression case
-        if (next_index->kind == EXPR_CONST) {
+        //static expression case (constant indices are only folded into
+        //the static offset when array-folding is enabled)
+        if (next_index->kind == EXPR_CONST
+            && pass_enabled(PASS_ARRAY_FOLDING)) {
             //if constant expression, add to the static_offset
             int index_val = next_index->constant.val.int_val;
             static_offset += offset_coefficient * (index_val - lower);
@@ -155,6 +158,7 @@ Exprs *create_doffsets_node(Expr *index_e, int offset_coefficient, int lower) {
 
     //create the LHS expression first
     e1->kind = EXPR_BINOP;
+    e1->inferred_type = INT_TYPE;
     e1->lineno = index_e->lineno;
     e1->binop = BINOP_SUB;
     //link the index expression for sub expression 1
@@ -162,28 +166,62 @@ Exprs *create_doffsets_node(Expr *index_e, int offset_coefficient, int lower) {
     //create a constant node for sub expression 2
     e1->e2 = (Expr *) checked_malloc(sizeof(Expr));
     e1->e2->kind = EXPR_CONST;
+    e1->e2->inferred_type = INT_TYPE;
     e1->e2->lineno = index_e->lineno;
     e1->e2->constant.type = INT_TYPE;
     e1->e2->constant.val.int_val = lower;
 
     //create the RHS expression now
     e2->kind = EXPR_CONST;
+    e2->inferred_type = INT_TYPE;
     e2->lineno = index_e->lineno;
     e2->constant.type = INT_TYPE;
     e2->constant.val.int_val = offset_coefficient;
 
     //now combine them
     e_offset->kind = EXPR_BINOP;
+    e_offset->inferred_type = INT_TYPE;
     e_offset->lineno = index_e->lineno;
     e_offset->binop = BINOP_MUL;
     e_offset->e1 = e1;
     e_offset->e2 = e2;
 
-    //finally attempt to reduce the expression we have created, and link
-    //from the new node
-    dynamic_offset_node->first = reduce_expression(e_offset);
-    //need to fill out inferred types recursively as INT_TYPE to prevent
-    //code generation from crashing
+    //finally attempt to reduce the expression we have created (unless
+    //array-folding is disabled), and link from the new node
+    if (pass_enabled(PASS_ARRAY_FOLDING)) {
+        e_offset = reduce_expression(e_offset);
+    }
+    dynamic_offset_node->first = e_offset;
     dynamic_offset_node->rest = NULL;
     return dynamic_offset_node;
 }
+
+
+/*-----------------------------------------------------------------------
+    an access is static when every index expression is a constant
+-----------------------------------------------------------------------*/
+BOOL is_static_access(Expr *expr) {
+    Exprs *indices = expr->indices;
+    while (indices != NULL) {
+        if (indices->first->kind != EXPR_CONST) {
+            return FALSE;
+        }
+        indices = indices->rest;
+    }
+    return TRUE;
+}
+
+
+/*-----------------------------------------------------------------------
+    an index adding or subtracting a constant, whose constant part is
+    folded into the static offset when the dynamic offset is reduced
+-----------------------------------------------------------------------*/
+BOOL is_offset_index(Expr *index) {
+    if (index->kind != EXPR_BINOP) {
+        return FALSE;
+    }
+    if (index->binop == BINOP_ADD) {
+        return index->e1->kind == EXPR_CONST || index->e2->kind == EXPR_CONST;
+    }
+    return index->binop == BINOP_SUB && index->e2->kind == EXPR_CONST;
+}
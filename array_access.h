@@ -17,7 +17,7 @@
       indices, and is_in_static_bounds indicates whether the access
       from statically determined indices is in bounds or not
 -----------------------------------------------------------------------*/
-typedef struct {
+typedef struct array_access {
     int         static_offset;
     BOOL        is_in_static_bounds;
     Exprs       *dynamic_offsets;
@@ -30,3 +30,14 @@ typedef struct {
     array expression
 -----------------------------------------------------------------------*/
 ArrayAccess *get_array_access(Expr *expr, Bounds *bounds);
+
+
+/*-----------------------------------------------------------------------
+    functions describing the cost of an array expression's indices:
+    - an access is static when all its indices are constant, and is then
+      a single load or store of a slot
+    - an index of the form e + k or e - k (k constant) costs no more than
+      e, as k is folded into the static offset
+-----------------------------------------------------------------------*/
+BOOL is_static_access(Expr *expr);
+BOOL is_offset_index(Expr *index);
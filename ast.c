@@ -10,7 +10,9 @@
     For use the COMP90045 project 2014.
 -----------------------------------------------------------------------*/
 
+#include    <string.h>
 #include    "ast.h"
+#include    "helper.h"
 
 /* The pretty-printer will need to know how to print binary operators: */
 const char  *binopname[] = { BINOP_NAMES };
@@ -27,3 +29,358 @@ const char  *typenames[]  = { TYPE_NAMES };
 */
 const int  binopprec[] = { BINOP_PRECEDENCE };
 const int  unopprec[] = { UNOP_PRECEDENCE };
+
+/*----------------------------------------------------------------------
+    Helper functions for building, copying and comparing trees.
+-----------------------------------------------------------------------*/
+
+// Creates a deep copy of an expression, so that passes which duplicate
+// code never share nodes (the reducer rewrites nodes in place)
+Expr *copy_expr(Expr *e) {
+    if (e == NULL) {
+        return NULL;
+    }
+    Expr *copy = (Expr *) checked_malloc(sizeof(Expr));
+    *copy = *e;
+    // only follow the children the kind uses, nodes built by the reducer
+    // do not always clear the others
+    copy->e1 = NULL;
+    copy->e2 = NULL;
+    copy->indices = NULL;
+    switch (e->kind) {
+        case EXPR_BINOP:
+            copy->e2 = copy_expr(e->e2);
+            // fall through
+        case EXPR_UNOP:
+            copy->e1 = copy_expr(e->e1);
+            break;
+
+        case EXPR_ARRAY:
+            copy->indices = copy_exprs(e->indices);
+            break;
+
+        default:
+            break;
+    }
+    return copy;
+}
+
+// Deep copy of a list of expressions
+Exprs *copy_exprs(Exprs *es) {
+    if (es == NULL) {
+        return NULL;
+    }
+    Exprs *copy = (Exprs *) checked_malloc(sizeof(Exprs));
+    copy->first = copy_expr(es->first);
+    copy->rest = copy_exprs(es->rest);
+    return copy;
+}
+
+// Creates a deep copy of a statement, sharing only identifiers and the
+// names of called procs
+Stmt *copy_stmt(Stmt *s) {
+    Stmt *copy = new_stmt(s->kind, s->lineno);
+    SInfo *from = &(s->info);
+    SInfo *to = &(copy->info);
+
+    switch (s->kind) {
+        case STMT_ASSIGN:
+        case STMT_BIND:
+        case STMT_ADVANCE:
+            to->assign.asg_ident = copy_expr(from->assign.asg_ident);
+            to->assign.asg_expr = copy_expr(from->assign.asg_expr);
+            break;
+
+        case STMT_READ:
+            to->read = copy_expr(from->read);
+            break;
+
+        case STMT_WRITE:
+            to->write = copy_expr(from->write);
+            break;
+
+        case STMT_FUNC:
+            to->func = (Function *) checked_malloc(sizeof(Function));
+            to->func->id = from->func->id;
+            to->func->args = copy_exprs(from->func->args);
+            to->func->tail = FALSE;
+            to->func->spills = NULL;
+            break;
+
+        case STMT_COND:
+            to->cond.cond = copy_expr(from->cond.cond);
+            to->cond.then_branch = copy_stmts(from->cond.then_branch);
+            to->cond.else_branch = copy_stmts(from->cond.else_branch);
+            break;
+
+        case STMT_WHILE:
+            to->loop.cond = copy_expr(from->loop.cond);
+            to->loop.body = copy_stmts(from->loop.body);
+            break;
+    }
+    return copy;
+}
+
+// Deep copy of a list of statements
+Stmts *copy_stmts(Stmts *ss) {
+    if (ss == NULL) {
+        return NULL;
+    }
+    return new_stmts_node(copy_stmt(ss->first), copy_stmts(ss->rest));
+}
+
+// Replaces each read of an identifier (which the code never assigns) in
+// an expression with a copy of value
+void subst_expr(Expr *e, char *id, Expr *value) {
+    Exprs *es;
+    Expr *copy;
+
+    switch (e->kind) {
+        case EXPR_ID:
+            if (streq(e->id, id)) {
+                copy = copy_expr(value);
+                copy->lineno = e->lineno;
+                *e = *copy;
+            }
+            break;
+
+        case EXPR_BINOP:
+            subst_expr(e->e2, id, value);
+            // fall through
+        case EXPR_UNOP:
+            subst_expr(e->e1, id, value);
+            break;
+
+        case EXPR_ARRAY:
+            for (es = e->indices; es != NULL; es = es->rest) {
+                subst_expr(es->first, id, value);
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+// Replaces each read of an identifier throughout a list of statements
+void subst_stmts(Stmts *ss, char *id, Expr *value) {
+    Exprs *es;
+
+    while (ss != NULL) {
+        SInfo *info = &(ss->first->info);
+        switch (ss->first->kind) {
+            case STMT_ASSIGN:
+            case STMT_BIND:
+            case STMT_ADVANCE:
+                subst_expr(info->assign.asg_ident, id, value);
+                subst_expr(info->assign.asg_expr, id, value);
+                break;
+
+            case STMT_READ:
+                subst_expr(info->read, id, value);
+                break;
+
+            case STMT_WRITE:
+                subst_expr(info->write, id, value);
+                break;
+
+            case STMT_FUNC:
+                for (es = info->func->args; es != NULL; es = es->rest) {
+                    subst_expr(es->first, id, value);
+                }
+                break;
+
+            case STMT_COND:
+                subst_expr(info->cond.cond, id, value);
+                subst_stmts(info->cond.then_branch, id, value);
+                subst_stmts(info->cond.else_branch, id, value);
+                break;
+
+            case STMT_WHILE:
+                subst_expr(info->loop.cond, id, value);
+                subst_stmts(info->loop.body, id, value);
+                break;
+        }
+        ss = ss->rest;
+    }
+}
+
+// The operators compiled into jumps in the condition of an if or while
+BOOL is_jump_cond(Expr *e) {
+    if (e->kind == EXPR_UNOP) {
+        return e->unop == UNOP_NOT;
+    }
+    if (e->kind == EXPR_BINOP) {
+        return e->binop == BINOP_AND || e->binop == BINOP_OR;
+    }
+    return FALSE;
+}
+
+// Structural equality of expressions. Constants must have the same type
+// and value, so 1 and 1.0 are not considered equal.
+BOOL exprs_equal(Expr *a, Expr *b) {
+    if (a == b) {
+        return TRUE;
+    }
+    if (a == NULL || b == NULL || a->kind != b->kind) {
+        return FALSE;
+    }
+
+    switch (a->kind) {
+        case EXPR_ID:
+            return streq(a->id, b->id);
+
+        case EXPR_CONST:
+            if (a->constant.type != b->constant.type) {
+                return FALSE;
+            }
+            switch (a->constant.type) {
+                case BOOL_TYPE:
+                    return a->constant.val.bool_val == b->constant.val.bool_val;
+                case INT_TYPE:
+                    return a->constant.val.int_val == b->constant.val.int_val;
+                case FLOAT_TYPE:
+                    return a->constant.val.float_val
+                           == b->constant.val.float_val;
+                case STRING_CONST:
+                    return streq(a->constant.val.string,
+                                 b->constant.val.string);
+                default:
+                    return FALSE;
+            }
+
+        case EXPR_BINOP:
+            return a->binop == b->binop && exprs_equal(a->e1, b->e1)
+                   && exprs_equal(a->e2, b->e2);
+
+        case EXPR_UNOP:
+            return a->unop == b->unop && exprs_equal(a->e1, b->e1);
+
+        case EXPR_ARRAY:
+            return streq(a->id, b->id)
+                   && expr_lists_equal(a->indices, b->indices);
+    }
+    return FALSE;
+}
+
+// Pairwise structural equality of two expression lists
+BOOL expr_lists_equal(Exprs *a, Exprs *b) {
+    while (a != NULL && b != NULL) {
+        if (!exprs_equal(a->first, b->first)) {
+            return FALSE;
+        }
+        a = a->rest;
+        b = b->rest;
+    }
+    return a == NULL && b == NULL;
+}
+
+// Rewrites an expression in place into a read of an identifier (such as a
+// compiler temporary holding its value), keeping its inferred type
+void make_id_expr(Expr *e, char *id) {
+    e->kind = EXPR_ID;
+    e->id = id;
+    e->e1 = NULL;
+    e->e2 = NULL;
+    e->indices = NULL;
+}
+
+// Creates an identifier expression with an already inferred type
+Expr *new_id_expr(char *id, Type t, int lineno) {
+    Expr *e = (Expr *) checked_malloc(sizeof(Expr));
+    e->lineno = lineno;
+    e->kind = EXPR_ID;
+    e->id = id;
+    e->e1 = NULL;
+    e->e2 = NULL;
+    e->indices = NULL;
+    e->inferred_type = t;
+    return e;
+}
+
+// Creates an int constant expression
+Expr *new_int_expr(int val, int lineno) {
+    Expr *e = (Expr *) checked_malloc(sizeof(Expr));
+    e->lineno = lineno;
+    e->kind = EXPR_CONST;
+    e->constant.type = INT_TYPE;
+    e->constant.val.int_val = val;
+    e->e1 = NULL;
+    e->e2 = NULL;
+    e->indices = NULL;
+    e->inferred_type = INT_TYPE;
+    return e;
+}
+
+// Creates the constant a local variable of the given type starts as
+Expr *new_zero_expr(Type t, int lineno) {
+    Expr *e = new_int_expr(0, lineno);
+    e->constant.type = t;
+    if (t == FLOAT_TYPE) {
+        e->constant.val.float_val = 0.0f;
+    } else if (t == BOOL_TYPE) {
+        e->constant.val.bool_val = FALSE;
+    }
+    e->inferred_type = t;
+    return e;
+}
+
+// Creates a binary operation whose type is already known
+Expr *new_binop_expr(BinOp op, Expr *e1, Expr *e2, Type t, int lineno) {
+    Expr *e = (Expr *) checked_malloc(sizeof(Expr));
+    e->lineno = lineno;
+    e->kind = EXPR_BINOP;
+    e->binop = op;
+    e->e1 = e1;
+    e->e2 = e2;
+    e->indices = NULL;
+    e->inferred_type = t;
+    return e;
+}
+
+// Creates a blank statement of the given kind
+Stmt *new_stmt(StmtKind kind, int lineno) {
+    Stmt *s = (Stmt *) checked_malloc(sizeof(Stmt));
+    s->kind = kind;
+    s->lineno = lineno;
+    return s;
+}
+
+// Creates a statement list node
+Stmts *new_stmts_node(Stmt *first, Stmts *rest) {
+    Stmts *node = (Stmts *) checked_malloc(sizeof(Stmts));
+    node->first = first;
+    node->rest = rest;
+    return node;
+}
+
+// Appends a statement to the end of a list, returning the new list
+Stmts *append_stmt(Stmts *stmts, Stmt *stmt) {
+    Stmts *node = new_stmts_node(stmt, NULL);
+    if (stmts == NULL) {
+        return node;
+    }
+    Stmts *last = stmts;
+    while (last->rest != NULL) {
+        last = last->rest;
+    }
+    last->rest = node;
+    return stmts;
+}
+
+// The number of statements in a list, including nested statements
+int count_stmts(Stmts *stmts) {
+    int count = 0;
+    while (stmts != NULL) {
+        Stmt *stmt = stmts->first;
+        count++;
+        if (stmt->kind == STMT_COND) {
+            count += count_stmts(stmt->info.cond.then_branch);
+            count += count_stmts(stmt->info.cond.else_branch);
+        } else if (stmt->kind == STMT_WHILE) {
+            count += count_stmts(stmt->info.loop.body);
+        }
+        stmts = stmts->rest;
+    }
+    return count;
+}
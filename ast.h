@@ -132,6 +132,9 @@ struct expr {
     Expr      *e2;          /* for binary operators */
     Exprs     *indices;     /* for arrays */
     Type      inferred_type;
+    // Set by codegen for each proc just before it is generated
+    int       reg_need;     /* registers needed besides the result's */
+    struct array_access *access;    /* for arrays, how to reach the element */
 };
 
 struct exprs {
@@ -175,8 +178,17 @@ struct interval {
     internal statements, expressions or values as required.
 -----------------------------------------------------------------------*/
 
+// STMT_BIND and STMT_ADVANCE are never produced by the parser. They are
+// introduced by the optimiser, and reuse the Assign info:
+// - STMT_BIND binds a compiler temporary (held like a ref parameter) to the
+//   address of an array element: asg_ident is the temporary and asg_expr
+//   is the (bounds checked) array expression, or the identifier of another
+//   address temporary already holding that address.
+// - STMT_ADVANCE moves such a temporary on by asg_expr (an int constant)
+//   elements, without any bounds check.
 typedef enum {
-    STMT_ASSIGN, STMT_COND, STMT_READ, STMT_WHILE, STMT_WRITE, STMT_FUNC
+    STMT_ASSIGN, STMT_COND, STMT_READ, STMT_WHILE, STMT_WRITE, STMT_FUNC,
+    STMT_BIND, STMT_ADVANCE
 } StmtKind;
 
 typedef struct {
@@ -211,6 +223,8 @@ typedef struct {
 struct func {
     char  *id;
     Exprs *args;
+    BOOL  tail;     /* last thing its proc does, so its frame can go */
+    struct spills *spills;  /* registers saved around it, set by regalloc */
 };
 
 
@@ -289,6 +303,55 @@ struct prog {
     Procs   *procedures;
 };
 
+/*----------------------------------------------------------------------
+    Helper functions for building, copying and comparing trees, used by
+    the optimisation passes that rewrite the program after analysis.
+-----------------------------------------------------------------------*/
+
+// Creates a deep copy of an expression (including array indices)
+Expr    *copy_expr(Expr *e);
+Exprs   *copy_exprs(Exprs *es);
+
+// Creates a deep copy of a statement (including nested statements)
+Stmt    *copy_stmt(Stmt *s);
+Stmts   *copy_stmts(Stmts *ss);
+
+// Replaces each read of an identifier (which must never be assigned in the
+// code) with a copy of value
+void    subst_expr(Expr *e, char *id, Expr *value);
+void    subst_stmts(Stmts *ss, char *id, Expr *value);
+
+// Whether a condition is an and, or or not, which code generation turns
+// into jumps (evaluating the right operand of and/or only when needed)
+// when the condition only feeds a branch
+BOOL    is_jump_cond(Expr *e);
+
+// Structural equality of two expressions (same kinds, operators,
+// constants, identifiers and sub-expressions)
+BOOL    exprs_equal(Expr *a, Expr *b);
+BOOL    expr_lists_equal(Exprs *a, Exprs *b);
+
+// Creates an identifier expression of the given type, or rewrites an
+// expression in place into one
+Expr    *new_id_expr(char *id, Type t, int lineno);
+void    make_id_expr(Expr *e, char *id);
+
+// Creates an int constant, the initial value of a local of type t, or a
+// binary operation with the given type
+Expr    *new_int_expr(int val, int lineno);
+Expr    *new_zero_expr(Type t, int lineno);
+Expr    *new_binop_expr(BinOp op, Expr *e1, Expr *e2, Type t, int lineno);
+
+// Creates a new statement, and a list node holding a statement
+Stmt    *new_stmt(StmtKind kind, int lineno);
+Stmts   *new_stmts_node(Stmt *first, Stmts *rest);
+
+// Appends a statement to the end of a list, returning the new list
+Stmts   *append_stmt(Stmts *stmts, Stmt *stmt);
+
+// The number of statements in a list, including nested statements
+int     count_stmts(Stmts *stmts);
+
 /*----------------------------------------------------------------------*/
 
 
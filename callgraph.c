@@ -0,0 +1,207 @@
+/* callgraph.c */
+
+/*-----------------------------------------------------------------------
+    Developed by: #undef TEAMNAME
+    The static call graph of a program, built from its call statements,
+    for passes that look across procs.
+
+    Each proc records the procs it calls (with the number of call sites),
+    how many call sites call it, whether main can reach it, and whether
+    it can reach itself. Procs main can never reach are removed before
+    analysis and code generation, as nothing would ever run them.
+-----------------------------------------------------------------------*/
+#include <stdlib.h>
+#include <string.h>
+#include "callgraph.h"
+#include "helper.h"
+
+#define PROGENTRY "main"
+
+/*----------------------------------------------------------------------
+    Internal function definitions.
+-----------------------------------------------------------------------*/
+void add_calls(CallGraph *graph, CallNode *caller, Stmts *stmts);
+void add_call(CallNode *caller, CallNode *callee);
+void mark_reachable(CallNode *node);
+BOOL reaches(CallGraph *graph, CallNode *from, CallNode *target);
+
+/*----------------------------------------------------------------------
+    Function implementations
+-----------------------------------------------------------------------*/
+
+CallGraph *build_call_graph(Program *prog) {
+    CallGraph *graph = (CallGraph *) checked_malloc(sizeof(CallGraph));
+    graph->nodes = NULL;
+    graph->searches = 0;
+
+    // a node for each proc, in program order
+    CallNode *last = NULL;
+    Procs *procs = prog->procedures;
+    while (procs != NULL) {
+        CallNode *node = (CallNode *) checked_malloc(sizeof(CallNode));
+        node->proc = procs->first;
+        node->callees = NULL;
+        node->calls = 0;
+        node->reachable = FALSE;
+        node->recursive = FALSE;
+        node->mark = 0;
+        node->next = NULL;
+        if (last == NULL) {
+            graph->nodes = node;
+        } else {
+            last->next = node;
+        }
+        last = node;
+        procs = procs->rest;
+    }
+
+    CallNode *node;
+    for (node = graph->nodes; node != NULL; node = node->next) {
+        add_calls(graph, node, node->proc->body->statements);
+    }
+    for (node = graph->nodes; node != NULL; node = node->next) {
+        graph->searches++;
+        node->recursive = reaches(graph, node, node);
+    }
+
+    CallNode *entry = find_call_node(graph, PROGENTRY);
+    if (entry != NULL) {
+        mark_reachable(entry);
+    }
+    return graph;
+}
+
+CallNode *find_call_node(CallGraph *graph, char *id) {
+    CallNode *node = graph->nodes;
+    while (node != NULL && !streq(node->proc->header->id, id)) {
+        node = node->next;
+    }
+    return node;
+}
+
+int remove_unreachable_procs(Program *prog, CallGraph *graph) {
+    if (find_call_node(graph, PROGENTRY) == NULL) {
+        return 0;
+    }
+
+    int removed = 0;
+    Procs **link = &(prog->procedures);
+    while (*link != NULL) {
+        // a proc defined twice shares the fate of its first definition,
+        // so that analysis still reports it
+        CallNode *node = find_call_node(graph, (*link)->first->header->id);
+        if (node->reachable) {
+            link = &((*link)->rest);
+        } else {
+            *link = (*link)->rest;
+            removed++;
+        }
+    }
+    return removed;
+}
+
+void dump_call_graph(FILE *fp, CallGraph *graph) {
+    CallNode *node;
+    for (node = graph->nodes; node != NULL; node = node->next) {
+        fprintf(fp, "proc %s (%d call%s", node->proc->header->id,
+                node->calls, node->calls == 1 ? "" : "s");
+        if (node->recursive) {
+            fprintf(fp, ", recursive");
+        }
+        if (!node->reachable) {
+            fprintf(fp, ", unreachable");
+        }
+        fprintf(fp, ")\n");
+
+        CallEdge *edge;
+        for (edge = node->callees; edge != NULL; edge = edge->next) {
+            fprintf(fp, "    -> %s (%d call%s)\n",
+                    edge->callee->proc->header->id, edge->sites,
+                    edge->sites == 1 ? "" : "s");
+        }
+    }
+}
+
+/*----------------------------------------------------------------------
+    Helper functions
+-----------------------------------------------------------------------*/
+
+// Adds an edge (or another site to an edge) for each call in the
+// statements
+void add_calls(CallGraph *graph, CallNode *caller, Stmts *stmts) {
+    while (stmts != NULL) {
+        Stmt *stmt = stmts->first;
+        CallNode *callee;
+
+        switch (stmt->kind) {
+            case STMT_COND:
+                add_calls(graph, caller, stmt->info.cond.then_branch);
+                add_calls(graph, caller, stmt->info.cond.else_branch);
+                break;
+
+            case STMT_WHILE:
+                add_calls(graph, caller, stmt->info.loop.body);
+                break;
+
+            case STMT_FUNC:
+                callee = find_call_node(graph, stmt->info.func->id);
+                if (callee != NULL) {
+                    add_call(caller, callee);
+                }
+                break;
+
+            default:
+                break;
+        }
+        stmts = stmts->rest;
+    }
+}
+
+void add_call(CallNode *caller, CallNode *callee) {
+    callee->calls++;
+
+    CallEdge **link = &(caller->callees);
+    while (*link != NULL) {
+        if ((*link)->callee == callee) {
+            (*link)->sites++;
+            return;
+        }
+        link = &((*link)->next);
+    }
+
+    CallEdge *edge = (CallEdge *) checked_malloc(sizeof(CallEdge));
+    edge->callee = callee;
+    edge->sites = 1;
+    edge->next = NULL;
+    *link = edge;
+}
+
+void mark_reachable(CallNode *node) {
+    if (node->reachable) {
+        return;
+    }
+    node->reachable = TRUE;
+
+    CallEdge *edge;
+    for (edge = node->callees; edge != NULL; edge = edge->next) {
+        mark_reachable(edge->callee);
+    }
+}
+
+// Whether target can be called (directly or not) from from. Each node is
+// searched at most once per search.
+BOOL reaches(CallGraph *graph, CallNode *from, CallNode *target) {
+    from->mark = graph->searches;
+
+    CallEdge *edge;
+    for (edge = from->callees; edge != NULL; edge = edge->next) {
+        if (edge->callee == target) {
+            return TRUE;
+        }
+        if (edge->callee->mark != graph->searches
+            && reaches(graph, edge->callee, target)) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
@@ -0,0 +1,61 @@
+/* callgraph.h */
+
+/*-----------------------------------------------------------------------
+    Developed by: #undef TEAMNAME
+    Provides function definitions and external access rights for
+    callgraph.c
+-----------------------------------------------------------------------*/
+#ifndef CALLGRAPH_H
+#define CALLGRAPH_H
+
+#include <stdio.h>
+#include "std.h"
+#include "ast.h"
+
+/*----------------------------------------------------------------------
+    Structures and enums needed from other files.
+-----------------------------------------------------------------------*/
+
+// The calls from one proc to another
+typedef struct call_edge {
+    struct call_node    *callee;
+    int                 sites;      /* number of calls made to it */
+    struct call_edge    *next;
+} CallEdge;
+
+// A proc, with the procs it calls and how often it is called
+typedef struct call_node {
+    Proc                *proc;
+    CallEdge            *callees;   /* in order of first call */
+    int                 calls;      /* call sites anywhere calling it */
+    BOOL                reachable;  /* called (directly or not) by main */
+    BOOL                recursive;  /* may call itself, directly or not */
+    int                 mark;       /* last search that reached it */
+    struct call_node    *next;
+} CallNode;
+
+// The static call graph of a program, one node per proc in program order
+typedef struct {
+    CallNode            *nodes;
+    int                 searches;
+} CallGraph;
+
+/*----------------------------------------------------------------------
+    External Functions that will be accessed by other C files.
+-----------------------------------------------------------------------*/
+// Builds the call graph of a program from its call statements. Calls to
+// procs that do not exist are left for analysis to report.
+CallGraph   *build_call_graph(Program *prog);
+
+// Finds the node for a proc (the first, if it is defined twice)
+CallNode    *find_call_node(CallGraph *graph, char *id);
+
+// Removes the procs main can never call from the program. Does nothing if
+// there is no main, so analysis still reports every error. Returns the
+// number of procs removed.
+int         remove_unreachable_procs(Program *prog, CallGraph *graph);
+
+// Prints each proc, how many calls are made to it, and what it calls
+void        dump_call_graph(FILE *fp, CallGraph *graph);
+
+#endif /* CALLGRAPH_H */
@@ -8,5 +8,6 @@
 #include <stdio.h>
 #include "ast.h"
 
-// Compiles a Wiz program to Oz, outputting to fp. Returns 0 for success.
-int compile(FILE *fp, Program *prog);
+// Compiles a Wiz program to Oz, outputting to fp as text, or in the binary
+// Oz format if binary is set. Returns 0 for success.
+int compile(FILE *fp, Program *prog, BOOL binary);
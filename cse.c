@@ -0,0 +1,458 @@
+/* cse.c */
+
+/*-----------------------------------------------------------------------
+    Developed by: #undef TEAMNAME
+    Common subexpression elimination, by value numbering over the ast
+    after semantic analysis.
+
+    Expressions are numbered in evaluation order. When an expression (or
+    the address of an array element, which includes its bounds checks)
+    is computed again while still available, a temporary is assigned just
+    before the statement that first computed it, and every occurrence
+    reads the temporary instead. Availability follows the structure of
+    the program: anything available before an if or a while is also
+    available in its branches or body (which it dominates), unless the
+    loop may change it.
+-----------------------------------------------------------------------*/
+#include <stdlib.h>
+#include "cse.h"
+#include "effects.h"
+#include "wizoptimiser.h"
+#include "array_access.h"
+#include "helper.h"
+
+/*----------------------------------------------------------------------
+    Internal structures.
+-----------------------------------------------------------------------*/
+
+// What an available expression stands for: the value of an expression,
+// or the (bounds checked) address of an array element
+typedef enum {
+    AVAIL_VALUE, AVAIL_ADDRESS
+} AvailKind;
+
+// The list node holding a statement. Temporaries are inserted just
+// before the statement, so the statement moves along as they are added.
+typedef struct {
+    Stmts *node;
+} Site;
+
+// An expression that has been computed and not invalidated since
+typedef struct avail {
+    AvailKind     kind;
+    Expr          *key;     /* private copy, as first written */
+    Expr          *canon;   /* shared node of the key, to match on */
+    Expr          *first;   /* the node that first computed it */
+    Site          *site;    /* the statement that first computed it */
+    Names         *reads;   /* names whose change invalidates it */
+    symbol        *temp;    /* temporary holding it, once reused */
+    BOOL          killed;
+    struct avail  *next;
+} Avail;
+
+// State kept while optimising one proc
+typedef struct {
+    sym_table     *prog;
+    scope         *scope;
+    Avail         *avail;   /* innermost scope's entries come first */
+    BOOL          record;   /* whether new expressions become available */
+} CseState;
+
+/*----------------------------------------------------------------------
+    Internal function definitions.
+-----------------------------------------------------------------------*/
+void cse_proc(Proc *proc, sym_table *prog);
+void cse_statements(Stmts *stmts, CseState *st);
+void cse_statement(Stmt *stmt, Site *site, CseState *st);
+void cse_call(Function *f, Site *site, CseState *st);
+void cse_lvalue(Expr *lvalue, Site *site, CseState *st);
+void cse_bind(Assign *bind, Site *site, CseState *st);
+Names *cse_expr(Expr *e, Site *site, CseState *st);
+Names *cse_cond(Expr *e, Site *site, CseState *st);
+Names *cse_indices(Exprs *indices, Site *site, CseState *st);
+Names *cse_array_read(Expr *e, Site *site, CseState *st);
+
+Avail *find_avail(CseState *st, AvailKind kind, Expr *e);
+void make_avail(CseState *st, AvailKind kind, Expr *e, Expr *key,
+                Names *reads, Site *site);
+void reuse_avail(CseState *st, Avail *a, Expr *e);
+void materialise(CseState *st, Avail *a);
+void kill_avail(CseState *st, Names *written);
+void insert_before(Site *site, Stmt *stmt);
+
+/*----------------------------------------------------------------------
+    Function implementations
+-----------------------------------------------------------------------*/
+
+void eliminate_common_subexpressions(Program *prog, sym_table *table) {
+    Procs *procs = prog->procedures;
+    while (procs != NULL) {
+        cse_proc(procs->first, table);
+        procs = procs->rest;
+    }
+}
+
+void cse_proc(Proc *proc, sym_table *prog) {
+    CseState st;
+    st.prog = prog;
+    st.scope = find_scope(proc->header->id, prog);
+    st.avail = NULL;
+    st.record = TRUE;
+    cse_statements(proc->body->statements, &st);
+}
+
+// Number each statement in turn. Each statement gets a site, which follows
+// it along the list as temporaries are inserted before it.
+void cse_statements(Stmts *stmts, CseState *st) {
+    while (stmts != NULL) {
+        Site *site = (Site *) checked_malloc(sizeof(Site));
+        site->node = stmts;
+        cse_statement(stmts->first, site, st);
+        stmts = site->node->rest;
+    }
+}
+
+void cse_statement(Stmt *stmt, Site *site, CseState *st) {
+    SInfo *info = &(stmt->info);
+    Avail *outer;
+    BOOL record;
+
+    switch (stmt->kind) {
+        case STMT_ASSIGN:
+            // the value is computed before the target's address
+            cse_expr(info->assign.asg_expr, site, st);
+            cse_lvalue(info->assign.asg_ident, site, st);
+            kill_avail(st, lvalue_writes(info->assign.asg_ident,
+                                         st->scope, NULL));
+            break;
+
+        case STMT_BIND:
+            cse_bind(&info->assign, site, st);
+            break;
+
+        case STMT_ADVANCE:
+            kill_avail(st, add_name(NULL, info->assign.asg_ident->id));
+            break;
+
+        case STMT_READ:
+            cse_lvalue(info->read, site, st);
+            kill_avail(st, lvalue_writes(info->read, st->scope, NULL));
+            break;
+
+        case STMT_WRITE:
+            cse_expr(info->write, site, st);
+            break;
+
+        case STMT_FUNC:
+            cse_call(info->func, site, st);
+            break;
+
+        case STMT_COND:
+            // the condition is evaluated once, before either branch.
+            // Anything made available in a branch is forgotten after it,
+            // but anything killed in a branch stays killed.
+            cse_cond(info->cond.cond, site, st);
+            outer = st->avail;
+            cse_statements(info->cond.then_branch, st);
+            st->avail = outer;
+            cse_statements(info->cond.else_branch, st);
+            st->avail = outer;
+            break;
+
+        case STMT_WHILE:
+            // the condition and body are also reached from the end of the
+            // body, so first kill anything the loop may change. The
+            // condition may reuse values, but is not a single point at
+            // which to compute new ones.
+            kill_avail(st, stmts_writes(info->loop.body, st->prog,
+                                        st->scope, NULL));
+            record = st->record;
+            st->record = FALSE;
+            cse_cond(info->loop.cond, site, st);
+            st->record = record;
+            outer = st->avail;
+            cse_statements(info->loop.body, st);
+            st->avail = outer;
+            break;
+    }
+}
+
+// Value arguments are ordinary expressions, while ref arguments that are
+// array elements have their address computed
+void cse_call(Function *f, Site *site, CseState *st) {
+    scope *callee = find_scope(f->id, st->prog);
+    Params *params = callee->params;
+    Exprs *args = f->args;
+
+    while (args != NULL) {
+        if (params->first->ind == REF_IND) {
+            cse_lvalue(args->first, site, st);
+        } else {
+            cse_expr(args->first, site, st);
+        }
+        args = args->rest;
+        params = params->rest;
+    }
+
+    kill_avail(st, call_writes(f, st->prog, st->scope, NULL));
+}
+
+// A target only ever has its address computed, so only the address of an
+// array element can be shared
+void cse_lvalue(Expr *lvalue, Site *site, CseState *st) {
+    if (lvalue->kind != EXPR_ARRAY) {
+        return;
+    }
+    if (is_static_access(lvalue)) {
+        cse_indices(lvalue->indices, site, st);
+        return;
+    }
+
+    Avail *a = find_avail(st, AVAIL_ADDRESS, lvalue);
+    if (a != NULL) {
+        reuse_avail(st, a, lvalue);
+        return;
+    }
+
+    Expr *key = st->record ? copy_expr(lvalue) : NULL;
+    Names *reads = cse_indices(lvalue->indices, site, st);
+    if (st->record) {
+        make_avail(st, AVAIL_ADDRESS, lvalue, key, reads, site);
+    }
+}
+
+// A binding (made by an earlier pass) computes an element's address, and
+// copies another temporary instead if that address is already available.
+// Otherwise the bound temporary itself holds the address from then on,
+// until the indices change or the temporary is rebound.
+void cse_bind(Assign *bind, Site *site, CseState *st) {
+    Expr *element = bind->asg_expr;
+    char *id = bind->asg_ident->id;
+
+    Avail *a = find_avail(st, AVAIL_ADDRESS, element);
+    if (a != NULL) {
+        reuse_avail(st, a, element);
+        kill_avail(st, add_name(NULL, id));
+        return;
+    }
+
+    Expr *key = copy_expr(element);
+    Names *reads = cse_indices(element->indices, site, st);
+    kill_avail(st, add_name(NULL, id));
+    if (st->record) {
+        make_avail(st, AVAIL_ADDRESS, element, key, add_name(reads, id),
+                   site);
+        st->avail->temp = retrieve_symbol_in_scope(id, st->scope);
+    }
+}
+
+// Numbers an expression, returning the names it reads. Whole expressions
+// are looked up before their parts, so that reusing an expression does not
+// also leave temporaries behind for its sub-expressions.
+Names *cse_expr(Expr *e, Site *site, CseState *st) {
+    Names *reads;
+    Avail *a;
+    Expr *key;
+
+    switch (e->kind) {
+        case EXPR_ID:
+            return expr_reads(e, st->scope, NULL);
+
+        case EXPR_CONST:
+            return NULL;
+
+        case EXPR_BINOP:
+        case EXPR_UNOP:
+            reads = expr_reads(e, st->scope, NULL);
+            a = find_avail(st, AVAIL_VALUE, e);
+            if (a != NULL) {
+                reuse_avail(st, a, e);
+                return reads;
+            }
+            key = st->record ? copy_expr(e) : NULL;
+            cse_expr(e->e1, site, st);
+            if (e->kind == EXPR_BINOP) {
+                cse_expr(e->e2, site, st);
+            }
+            if (st->record) {
+                make_avail(st, AVAIL_VALUE, e, key, reads, site);
+            }
+            return reads;
+
+        case EXPR_ARRAY:
+            if (is_static_access(e)) {
+                cse_indices(e->indices, site, st);
+                return add_name(NULL, e->id);
+            }
+            return cse_array_read(e, site, st);
+    }
+    return NULL;
+}
+
+// Numbers a condition that only feeds a branch. Code generation evaluates
+// the right operand of and/or only if it decides the outcome, so nothing
+// in it may become available (its temporary would be assigned before the
+// statement, whether or not the condition needs it). Nor does the value of
+// an and, or or not, as jump code never computes it.
+Names *cse_cond(Expr *e, Site *site, CseState *st) {
+    BOOL record;
+
+    if (!is_jump_cond(e)) {
+        return cse_expr(e, site, st);
+    }
+
+    Names *reads = expr_reads(e, st->scope, NULL);
+    Avail *a = find_avail(st, AVAIL_VALUE, e);
+    if (a != NULL) {
+        reuse_avail(st, a, e);
+        return reads;
+    }
+
+    cse_cond(e->e1, site, st);
+    if (e->kind == EXPR_BINOP) {
+        record = st->record;
+        st->record = FALSE;
+        cse_cond(e->e2, site, st);
+        st->record = record;
+    }
+    return reads;
+}
+
+// An index of the form e + k or e - k (k a constant) costs no more than
+// e itself, as the constant is folded into the array's static offset, so
+// only e is worth sharing
+Names *cse_indices(Exprs *indices, Site *site, CseState *st) {
+    Names *reads = NULL;
+    while (indices != NULL) {
+        Expr *index = indices->first;
+        if (is_offset_index(index)) {
+            reads = add_names(reads, cse_expr(index->e1, site, st));
+            reads = add_names(reads, cse_expr(index->e2, site, st));
+        } else {
+            reads = add_names(reads, cse_expr(index, site, st));
+        }
+        indices = indices->rest;
+    }
+    return reads;
+}
+
+// Reading an array element computes its address, then its value. Prefer
+// reusing the value, and otherwise the address (which saves recomputing
+// the offset and the bounds checks).
+Names *cse_array_read(Expr *e, Site *site, CseState *st) {
+    Names *index_reads = exprs_reads(e->indices, st->scope, NULL);
+    Names *reads = add_name(index_reads, e->id);
+
+    Avail *value = find_avail(st, AVAIL_VALUE, e);
+    if (value != NULL) {
+        reuse_avail(st, value, e);
+        return reads;
+    }
+
+    Avail *address = find_avail(st, AVAIL_ADDRESS, e);
+    Expr *key = st->record ? copy_expr(e) : NULL;
+    if (address != NULL) {
+        reuse_avail(st, address, e);
+    } else {
+        cse_indices(e->indices, site, st);
+        if (st->record) {
+            make_avail(st, AVAIL_ADDRESS, e, key, index_reads, site);
+        }
+    }
+    if (st->record) {
+        make_avail(st, AVAIL_VALUE, e, key, reads, site);
+    }
+    return reads;
+}
+
+/*----------------------------------------------------------------------
+    Available expressions
+-----------------------------------------------------------------------*/
+
+// Expressions are matched through their shared nodes, so each entry is
+// compared by address rather than structurally
+Avail *find_avail(CseState *st, AvailKind kind, Expr *e) {
+    Expr *canon = hash_cons(e);
+    Avail *a = st->avail;
+    while (a != NULL) {
+        if (!a->killed && a->kind == kind && a->canon == canon) {
+            return a;
+        }
+        a = a->next;
+    }
+    return NULL;
+}
+
+// The key is a copy of the expression as first written, taken before any
+// of its parts were replaced by temporaries, so it matches later
+// occurrences of the same expression
+void make_avail(CseState *st, AvailKind kind, Expr *e, Expr *key,
+                Names *reads, Site *site) {
+    Avail *a = (Avail *) checked_malloc(sizeof(Avail));
+
+    a->kind = kind;
+    a->key = key;
+    a->canon = hash_cons(key);
+    a->first = e;
+    a->site = site;
+    a->reads = reads;
+    a->temp = NULL;
+    a->killed = FALSE;
+    a->next = st->avail;
+    st->avail = a;
+}
+
+void reuse_avail(CseState *st, Avail *a, Expr *e) {
+    if (a->temp == NULL) {
+        materialise(st, a);
+    }
+    make_id_expr(e, get_symbol_id(a->temp));
+}
+
+// Creates the temporary for an expression that is being reused, assigning
+// (or for addresses binding) it just before the statement that first
+// computed it, and makes that first computation read the temporary
+void materialise(CseState *st, Avail *a) {
+    Type t = a->key->inferred_type;
+    BOOL is_address = (a->kind == AVAIL_ADDRESS);
+    int lineno = a->site->node->first->lineno;
+    symbol *temp = create_temp_symbol(st->prog, st->scope, t, is_address);
+    if (is_address) {
+        temp->target = a->key->id;
+    }
+
+    // the first computation (with its parts already shared) computes the
+    // value, unless it has since become a read of the element's value
+    // temporary, which cannot be used for the element's address
+    Expr *computed = a->first;
+    if (is_address && a->first->kind != EXPR_ARRAY) {
+        computed = a->key;
+    }
+
+    Stmt *def = new_stmt(is_address ? STMT_BIND : STMT_ASSIGN, lineno);
+    def->info.assign.asg_ident = new_id_expr(get_symbol_id(temp), t, lineno);
+    def->info.assign.asg_expr = copy_expr(computed);
+    insert_before(a->site, def);
+
+    if (computed == a->first) {
+        make_id_expr(a->first, get_symbol_id(temp));
+    }
+    a->temp = temp;
+}
+
+void kill_avail(CseState *st, Names *written) {
+    Avail *a = st->avail;
+    while (a != NULL) {
+        if (!a->killed && names_intersect(a->reads, written)) {
+            a->killed = TRUE;
+        }
+        a = a->next;
+    }
+}
+
+void insert_before(Site *site, Stmt *stmt) {
+    Stmts *moved = new_stmts_node(site->node->first, site->node->rest);
+    site->node->first = stmt;
+    site->node->rest = moved;
+    site->node = moved;
+}
@@ -0,0 +1,17 @@
+/* cse.h */
+
+/*-----------------------------------------------------------------------
+    Developed by: #undef TEAMNAME
+    Provides function definitions and external access rights for
+    cse.c
+-----------------------------------------------------------------------*/
+#include "ast.h"
+#include "symbol.h"
+
+/*----------------------------------------------------------------------
+    External Functions that will be accessed by other C files.
+-----------------------------------------------------------------------*/
+// Replaces repeated pure subexpressions (and repeated array address
+// computations) with compiler temporaries. Must run after analysis, as it
+// relies on inferred types and adds temporaries to the symbol table.
+void eliminate_common_subexpressions(Program *prog, sym_table *table);
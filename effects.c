@@ -0,0 +1,223 @@
+/* effects.c */
+
+/*-----------------------------------------------------------------------
+    Developed by: #undef TEAMNAME
+    Computes which names expressions read and statements write, so that
+    optimisation passes know when a computed value is no longer valid.
+    Semantic analysis must already have succeeded, so every identifier
+    has a symbol in the given scope.
+-----------------------------------------------------------------------*/
+#include <string.h>
+#include "effects.h"
+#include "helper.h"
+
+/*----------------------------------------------------------------------
+    Internal function definitions.
+-----------------------------------------------------------------------*/
+Names *id_reads(char *id, scope *s, Names *acc);
+
+/*----------------------------------------------------------------------
+    Name lists
+-----------------------------------------------------------------------*/
+
+Names *add_name(Names *names, char *id) {
+    if (has_name(names, id)) {
+        return names;
+    }
+    Names *node = (Names *) checked_malloc(sizeof(Names));
+    node->id = id;
+    node->rest = names;
+    return node;
+}
+
+Names *add_names(Names *names, Names *more) {
+    while (more != NULL) {
+        names = add_name(names, more->id);
+        more = more->rest;
+    }
+    return names;
+}
+
+BOOL has_name(Names *names, char *id) {
+    while (names != NULL) {
+        if (streq(names->id, id)) {
+            return TRUE;
+        }
+        names = names->rest;
+    }
+    return FALSE;
+}
+
+BOOL names_intersect(Names *a, Names *b) {
+    while (a != NULL) {
+        if (has_name(b, a->id)) {
+            return TRUE;
+        }
+        a = a->rest;
+    }
+    return FALSE;
+}
+
+/*----------------------------------------------------------------------
+    Reads
+-----------------------------------------------------------------------*/
+
+// A scalar depends on its own name. A value reached through a ref
+// parameter depends on REF_MEMORY, and one reached through an address
+// temporary depends on the array it points into (and the temporary).
+Names *id_reads(char *id, scope *s, Names *acc) {
+    symbol *sym = retrieve_symbol_in_scope(id, s);
+    if (sym != NULL && sym->kind == SYM_PARAM_REF) {
+        if (sym->target != NULL) {
+            acc = add_name(acc, sym->target);
+            return add_name(acc, id);
+        }
+        return add_name(acc, REF_MEMORY);
+    }
+    return add_name(acc, id);
+}
+
+Names *expr_reads(Expr *e, scope *s, Names *acc) {
+    switch (e->kind) {
+        case EXPR_ID:
+            return id_reads(e->id, s, acc);
+
+        case EXPR_CONST:
+            return acc;
+
+        case EXPR_BINOP:
+            acc = expr_reads(e->e1, s, acc);
+            return expr_reads(e->e2, s, acc);
+
+        case EXPR_UNOP:
+            return expr_reads(e->e1, s, acc);
+
+        case EXPR_ARRAY:
+            acc = add_name(acc, e->id);
+            return exprs_reads(e->indices, s, acc);
+    }
+    return acc;
+}
+
+Names *exprs_reads(Exprs *es, scope *s, Names *acc) {
+    while (es != NULL) {
+        acc = expr_reads(es->first, s, acc);
+        es = es->rest;
+    }
+    return acc;
+}
+
+/*----------------------------------------------------------------------
+    Faults
+-----------------------------------------------------------------------*/
+
+// Whether evaluating an expression may halt the program: division by
+// anything but a non-zero constant, or any array access (static accesses
+// may be statically out of bounds)
+BOOL can_fault(Expr *e) {
+    switch (e->kind) {
+        case EXPR_ID:
+        case EXPR_CONST:
+            return FALSE;
+
+        case EXPR_BINOP:
+            return op_can_fault(e) || can_fault(e->e1) || can_fault(e->e2);
+
+        case EXPR_UNOP:
+            return can_fault(e->e1);
+
+        case EXPR_ARRAY:
+            return TRUE;
+    }
+    return FALSE;
+}
+
+BOOL op_can_fault(Expr *e) {
+    if (e->kind == EXPR_ARRAY) {
+        return TRUE;
+    }
+    if (e->kind != EXPR_BINOP || e->binop != BINOP_DIV) {
+        return FALSE;
+    }
+    Expr *d = e->e2;
+    return d->kind != EXPR_CONST
+        || (d->constant.type == INT_TYPE && d->constant.val.int_val == 0)
+        || (d->constant.type == FLOAT_TYPE
+            && d->constant.val.float_val == 0.0);
+}
+
+/*----------------------------------------------------------------------
+    Writes
+-----------------------------------------------------------------------*/
+
+// Writing an array element changes the array's contents, writing through
+// a ref parameter may change anything reachable from any ref parameter.
+Names *lvalue_writes(Expr *lvalue, scope *s, Names *acc) {
+    if (lvalue->kind == EXPR_ARRAY) {
+        return add_name(acc, lvalue->id);
+    }
+
+    symbol *sym = retrieve_symbol_in_scope(lvalue->id, s);
+    if (sym != NULL && sym->kind == SYM_PARAM_REF) {
+        if (sym->target != NULL) {
+            return add_name(acc, sym->target);
+        }
+        return add_name(acc, REF_MEMORY);
+    }
+    return add_name(acc, lvalue->id);
+}
+
+// Every argument passed to a ref parameter may be written by the callee
+Names *call_writes(Function *f, sym_table *prog, scope *s, Names *acc) {
+    scope *callee = find_scope(f->id, prog);
+    Params *params = callee->params;
+    Exprs *args = f->args;
+
+    while (args != NULL && params != NULL) {
+        if (params->first->ind == REF_IND) {
+            acc = lvalue_writes(args->first, s, acc);
+        }
+        args = args->rest;
+        params = params->rest;
+    }
+    return acc;
+}
+
+Names *stmt_writes(Stmt *stmt, sym_table *prog, scope *s, Names *acc) {
+    SInfo *info = &(stmt->info);
+
+    switch (stmt->kind) {
+        case STMT_ASSIGN:
+            return lvalue_writes(info->assign.asg_ident, s, acc);
+
+        case STMT_BIND:
+        case STMT_ADVANCE:
+            // rebinding changes the address held, not any array contents
+            return add_name(acc, info->assign.asg_ident->id);
+
+        case STMT_READ:
+            return lvalue_writes(info->read, s, acc);
+
+        case STMT_FUNC:
+            return call_writes(info->func, prog, s, acc);
+
+        case STMT_COND:
+            acc = stmts_writes(info->cond.then_branch, prog, s, acc);
+            return stmts_writes(info->cond.else_branch, prog, s, acc);
+
+        case STMT_WHILE:
+            return stmts_writes(info->loop.body, prog, s, acc);
+
+        case STMT_WRITE:
+            return acc;
+    }
+    return acc;
+}
+
+Names *stmts_writes(Stmts *stmts, sym_table *prog, scope *s, Names *acc) {
+    while (stmts != NULL) {
+        acc = stmt_writes(stmts->first, prog, s, acc);
+        stmts = stmts->rest;
+    }
+    return acc;
+}
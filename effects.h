@@ -0,0 +1,57 @@
+/* effects.h */
+
+/*-----------------------------------------------------------------------
+    Developed by: #undef TEAMNAME
+    Provides summaries of what expressions read and statements write,
+    for use by the optimisation passes that run after analysis.
+-----------------------------------------------------------------------*/
+
+#ifndef EFFECTS_H
+#define EFFECTS_H
+
+#include "std.h"
+#include "ast.h"
+#include "symbol.h"
+
+/*----------------------------------------------------------------------
+    Names read or written are kept as a simple linked list. Arrays are
+    named by their identifier (standing for their contents), and anything
+    reached through a ref parameter is named by REF_MEMORY, as two ref
+    parameters may alias one another.
+-----------------------------------------------------------------------*/
+#define REF_MEMORY "&"
+
+typedef struct names {
+    char         *id;
+    struct names *rest;
+} Names;
+
+// Adds a name to a list (if not already present) and returns the new list
+Names   *add_name(Names *names, char *id);
+Names   *add_names(Names *names, Names *more);
+BOOL    has_name(Names *names, char *id);
+BOOL    names_intersect(Names *a, Names *b);
+
+// Names whose value an expression depends on
+Names   *expr_reads(Expr *e, scope *s, Names *acc);
+Names   *exprs_reads(Exprs *es, scope *s, Names *acc);
+
+// Whether evaluating an expression may halt the program (by dividing by
+// zero or accessing an array out of bounds)
+BOOL    can_fault(Expr *e);
+
+// Whether an expression's own operation may halt the program, leaving
+// aside its operands
+BOOL    op_can_fault(Expr *e);
+
+// Names an assignment target (lvalue) changes when written
+Names   *lvalue_writes(Expr *lvalue, scope *s, Names *acc);
+
+// Names a call may change through its ref parameters
+Names   *call_writes(Function *f, sym_table *prog, scope *s, Names *acc);
+
+// Names a statement (or any statement in the list) may change
+Names   *stmt_writes(Stmt *stmt, sym_table *prog, scope *s, Names *acc);
+Names   *stmts_writes(Stmts *stmts, sym_table *prog, scope *s, Names *acc);
+
+#endif /* EFFECTS_H */
@@ -0,0 +1,357 @@
+/* emit.c */
+
+/*-----------------------------------------------------------------------
+    Developed by: #undef TEAMNAME
+    Writes an Oz program as assembly text.
+
+    Lines are formatted straight into a large buffer, which is written
+    out with a single write call whenever it fills, instead of through a
+    printf per instruction. Each op's mnemonic is padded once, up front,
+    and the way its operands are printed comes from a table indexed by
+    its code. Integers (registers, slots, labels and constants) are
+    formatted by hand; only real constants go through snprintf, so that
+    they print exactly as %f does.
+-----------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "emit.h"
+#include "helper.h"
+#include "error_printer.h"
+
+#define INDENTS "    "
+#define INSTRWIDTH 16
+
+// Bytes held before they are written out
+#define BUFFER_SIZE (1 << 18)
+
+// Room for any one int or real constant formatted in place
+#define MAX_NUMBER 64
+
+// Room for any line, not counting the strings in it
+#define MAX_LINE 256
+
+#define NUM_OPS (OP_DEBUG_STACK + 1)
+
+/*----------------------------------------------------------------------
+    Internal structures.
+-----------------------------------------------------------------------*/
+
+// How an op is printed: its mnemonic, whether the mnemonic is padded to
+// line up the operands, and its operands as a letter each, taking arg1,
+// arg2 and arg3 in turn:
+//   r a register, i an int, l a label, p a proc name (string id),
+//   s a string constant (string id), f the real constant (uses an arg)
+// An op with no mnemonic is not printable.
+typedef struct {
+    char    *name;
+    BOOL    padded;
+    char    *operands;
+} OpFormat;
+
+// The output buffer, and the file it is written to
+typedef struct {
+    int     fd;
+    char    *buf;
+    int     used;
+} Emitter;
+
+/*----------------------------------------------------------------------
+    Internal function definitions.
+-----------------------------------------------------------------------*/
+void emit_op(Emitter *e, OzProgram *p, OzLine *op);
+void pad_mnemonics(void);
+
+char *reserve(Emitter *e);
+void put_chars(Emitter *e, const char *s, int n);
+void put_string(Emitter *e, const char *s);
+char *format_int(char *out, int value);
+void flush(Emitter *e);
+void write_all(int fd, const char *s, int n);
+
+/*----------------------------------------------------------------------
+    The format of each op, in the order of OpCode
+-----------------------------------------------------------------------*/
+OpFormat formats[NUM_OPS] = {
+    { "push_stack_frame",   TRUE,   "i" },      // OP_PUSH_STACK_FRAME
+    { "pop_stack_frame",    TRUE,   "i" },      // OP_POP_STACK_FRAME
+    { "halt",               FALSE,  "" },       // OP_HALT
+    { "load",               TRUE,   "ri" },     // OP_LOAD
+    { "store",              TRUE,   "ir" },     // OP_STORE
+    { "load_address",       TRUE,   "ri" },     // OP_LOAD_ADDRESS
+    { "load_indirect",      TRUE,   "rr" },     // OP_LOAD_INDIRECT
+    { "store_indirect",     TRUE,   "rr" },     // OP_STORE_INDIRECT
+    { "int_const",          TRUE,   "ri" },     // OP_INT_CONST
+    { "real_const",         TRUE,   "rf" },     // OP_REAL_CONST
+    { "string_const",       TRUE,   "rs" },     // OP_STRING_CONST
+    { "int_to_real",        TRUE,   "rr" },     // OP_INT_TO_REAL
+    { "move",               TRUE,   "rr" },     // OP_MOVE
+    { "add_int",            TRUE,   "rrr" },    // OP_ADD_INT
+    { "add_real",           TRUE,   "rrr" },    // OP_ADD_REAL
+    { "add_offset",         TRUE,   "rrr" },    // OP_ADD_OFFSET
+    { "sub_int",            TRUE,   "rrr" },    // OP_SUB_INT
+    { "sub_real",           TRUE,   "rrr" },    // OP_SUB_REAL
+    { "sub_offset",         TRUE,   "rrr" },    // OP_SUB_OFFSET
+    { "mul_int",            TRUE,   "rrr" },    // OP_MUL_INT
+    { "mul_real",           TRUE,   "rrr" },    // OP_MUL_REAL
+    { "div_int",            TRUE,   "rrr" },    // OP_DIV_INT
+    { "div_real",           TRUE,   "rrr" },    // OP_DIV_REAL
+    { "cmp_eq_int",         TRUE,   "rrr" },    // OP_CMP_EQ_INT
+    { "cmp_ne_int",         TRUE,   "rrr" },    // OP_CMP_NE_INT
+    { "cmp_gt_int",         TRUE,   "rrr" },    // OP_CMP_GT_INT
+    { "cmp_ge_int",         TRUE,   "rrr" },    // OP_CMP_GE_INT
+    { "cmp_lt_int",         TRUE,   "rrr" },    // OP_CMP_LT_INT
+    { "cmp_le_int",         TRUE,   "rrr" },    // OP_CMP_LE_INT
+    { "cmp_eq_real",        TRUE,   "rrr" },    // OP_CMP_EQ_REAL
+    { "cmp_ne_real",        TRUE,   "rrr" },    // OP_CMP_NE_REAL
+    { "cmp_gt_real",        TRUE,   "rrr" },    // OP_CMP_GT_REAL
+    { "cmp_ge_real",        TRUE,   "rrr" },    // OP_CMP_GE_REAL
+    { "cmp_lt_real",        TRUE,   "rrr" },    // OP_CMP_LT_REAL
+    { "cmp_le_real",        TRUE,   "rrr" },    // OP_CMP_LE_REAL
+    { "and",                TRUE,   "rrr" },    // OP_AND
+    { "or",                 TRUE,   "rrr" },    // OP_OR
+    { "not",                TRUE,   "rr" },     // OP_NOT
+    { "branch_on_true",     TRUE,   "rl" },     // OP_BRANCH_ON_TRUE
+    { "branch_on_false",    TRUE,   "rl" },     // OP_BRANCH_ON_FALSE
+    { "branch_uncond",      TRUE,   "l" },      // OP_BRANCH_UNCOND
+    { "branch_uncond",      TRUE,   "p" },      // OP_BRANCH_PROC
+    { "call",               TRUE,   "p" },      // OP_CALL
+    { NULL,                 FALSE,  "" },       // OP_CALL_BUILTIN (a line)
+    { "return",             FALSE,  "" },       // OP_RETURN
+    { "debug_reg",          TRUE,   "r" },      // OP_DEBUG_REG
+    { "debug_slot",         TRUE,   "i" },      // OP_DEBUG_SLOT
+    { "debug_stack",        TRUE,   "" }        // OP_DEBUG_STACK
+};
+
+// Each op's indented mnemonic, padded to INSTRWIDTH and followed by the
+// space before its operands, made once
+char *padded[NUM_OPS];
+char *padded_builtin;
+int padded_length;
+
+/*----------------------------------------------------------------------
+    Function implementations
+-----------------------------------------------------------------------*/
+
+void write_oz_text(FILE *fp, OzProgram *p) {
+    Emitter e;
+    int i;
+
+    pad_mnemonics();
+    fflush(fp);
+    e.fd = fileno(fp);
+    e.buf = checked_malloc(BUFFER_SIZE);
+    e.used = 0;
+
+    for (i = 0; i < p->nlines; i++) {
+        OzLine *line = &(p->lines[i]);
+        char *out;
+        switch (line->kind) {
+            case OZ_OP:
+                emit_op(&e, p, line);
+                break;
+
+            case OZ_BUILTIN:
+                put_chars(&e, padded_builtin, padded_length);
+                put_string(&e, builtinnames[line->arg1]);
+                put_chars(&e, "\n", 1);
+                break;
+
+            case OZ_PROC:
+                put_chars(&e, "proc_", 5);
+                put_string(&e, oz_string(p, line->arg1));
+                put_chars(&e, ":\n", 2);
+                break;
+
+            case OZ_LABEL:
+                out = reserve(&e);
+                memcpy(out, "label", 5);
+                out = format_int(out + 5, line->arg1);
+                memcpy(out, ":\n", 2);
+                e.used = out + 2 - e.buf;
+                break;
+
+            case OZ_COMMENT:
+                put_chars(&e, "# ", 2);
+                put_string(&e, sectionnames[line->arg1]);
+                put_chars(&e, "\n", 1);
+                break;
+        }
+    }
+
+    flush(&e);
+    free(e.buf);
+}
+
+// Formats an op straight into the buffer, apart from any proc name or
+// string constant in it
+void emit_op(Emitter *e, OzProgram *p, OzLine *op) {
+    OpFormat *format = &formats[op->code];
+    int args[3];
+    int i;
+
+    if (format->name == NULL) {
+        report_error_and_exit("operation not yet implemented!");
+    }
+    if (!format->padded) {
+        put_chars(e, INDENTS, strlen(INDENTS));
+        put_string(e, format->name);
+        put_chars(e, "\n", 1);
+        return;
+    }
+
+    // the space after the mnemonic only comes before operands
+    char *out = reserve(e);
+    int length = padded_length - (format->operands[0] != '\0' ? 0 : 1);
+    memcpy(out, padded[op->code], length);
+    out += length;
+
+    args[0] = op->arg1;
+    args[1] = op->arg2;
+    args[2] = op->arg3;
+    for (i = 0; format->operands[i] != '\0'; i++) {
+        if (i > 0) {
+            *out++ = ',';
+            *out++ = ' ';
+        }
+        switch (format->operands[i]) {
+            case 'r':
+                *out++ = 'r';
+                out = format_int(out, args[i]);
+                break;
+
+            case 'i':
+                out = format_int(out, args[i]);
+                break;
+
+            case 'l':
+                memcpy(out, "label", 5);
+                out = format_int(out + 5, args[i]);
+                break;
+
+            case 'f':
+                out += snprintf(out, MAX_NUMBER, "%f", op->real);
+                break;
+
+            case 'p':
+            case 's':
+                e->used = out - e->buf;
+                if (format->operands[i] == 'p') {
+                    put_chars(e, "proc_", 5);
+                    put_string(e, oz_string(p, args[i]));
+                } else {
+                    put_chars(e, "\"", 1);
+                    put_string(e, oz_string(p, args[i]));
+                    put_chars(e, "\"", 1);
+                }
+                out = reserve(e);
+                break;
+        }
+    }
+    *out++ = '\n';
+    e->used = out - e->buf;
+}
+
+const char *oz_operands(OpCode code) {
+    if ((int) code < 0 || (int) code >= NUM_OPS
+        || formats[code].name == NULL) {
+        return NULL;
+    }
+    return formats[code].operands;
+}
+
+const char *oz_mnemonic(OpCode code) {
+    if ((int) code < 0 || (int) code >= NUM_OPS) {
+        return NULL;
+    }
+    return formats[code].name;
+}
+
+// Makes the padded mnemonics, the first time they are needed
+void pad_mnemonics(void) {
+    int i;
+    if (padded_builtin != NULL) {
+        return;
+    }
+
+    padded_length = strlen(INDENTS) + INSTRWIDTH + 1;
+    for (i = 0; i < NUM_OPS; i++) {
+        if (formats[i].name != NULL) {
+            padded[i] = checked_malloc(padded_length + 1);
+            sprintf(padded[i], "%s%-*s ", INDENTS, INSTRWIDTH,
+                    formats[i].name);
+        }
+    }
+    padded_builtin = checked_malloc(padded_length + 1);
+    sprintf(padded_builtin, "%s%-*s ", INDENTS, INSTRWIDTH, "call_builtin");
+}
+
+/*----------------------------------------------------------------------
+    The output buffer
+-----------------------------------------------------------------------*/
+
+// Makes room for a line, returning where it goes. The line is added by
+// moving used past it.
+char *reserve(Emitter *e) {
+    if (e->used + MAX_LINE > BUFFER_SIZE) {
+        flush(e);
+    }
+    return e->buf + e->used;
+}
+
+void put_chars(Emitter *e, const char *s, int n) {
+    if (e->used + n > BUFFER_SIZE) {
+        flush(e);
+        if (n > BUFFER_SIZE) {
+            write_all(e->fd, s, n);
+            return;
+        }
+    }
+    memcpy(e->buf + e->used, s, n);
+    e->used += n;
+}
+
+void put_string(Emitter *e, const char *s) {
+    put_chars(e, s, strlen(s));
+}
+
+// Formats an int in decimal at out, as %d does, returning the end of it
+char *format_int(char *out, int value) {
+    char digits[MAX_NUMBER];
+    int n = 0;
+    // the magnitude as unsigned, so that the most negative int works
+    unsigned magnitude = value < 0 ? 0u - (unsigned) value
+                                   : (unsigned) value;
+    if (value < 0) {
+        *out++ = '-';
+    }
+    do {
+        digits[n++] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude > 0);
+    while (n > 0) {
+        *out++ = digits[--n];
+    }
+    return out;
+}
+
+void flush(Emitter *e) {
+    write_all(e->fd, e->buf, e->used);
+    e->used = 0;
+}
+
+void write_all(int fd, const char *s, int n) {
+    while (n > 0) {
+        ssize_t written = write(fd, s, n);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            report_error_and_exit("could not write the Oz program!");
+        }
+        s += written;
+        n -= written;
+    }
+}
@@ -0,0 +1,29 @@
+/* emit.h */
+
+/*-----------------------------------------------------------------------
+    Developed by: #undef TEAMNAME
+    Provides function definitions and external access rights for
+    emit.c
+-----------------------------------------------------------------------*/
+#ifndef EMIT_H
+#define EMIT_H
+
+#include <stdio.h>
+#include "ast.h"
+#include "oztree.h"
+
+/*----------------------------------------------------------------------
+    External Functions that will be accessed by other C files.
+-----------------------------------------------------------------------*/
+// Writes a program to fp as Oz assembly text, one line per line of the
+// program
+void write_oz_text(FILE *fp, OzProgram *p);
+
+// The operands of an op, as a letter each in the order of its args (see
+// emit.c), or NULL if the op cannot be written
+const char *oz_operands(OpCode code);
+
+// The mnemonic an op is written with, or NULL if the op cannot be written
+const char *oz_mnemonic(OpCode code);
+
+#endif
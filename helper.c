@@ -9,6 +9,9 @@
 #include    "helper.h"
 #include    "error_printer.h"
 
+// The number of allocations made through checked_malloc, by this thread
+_Thread_local long allocations = 0;
+
 // Simple safe malloc funciton that will return the requested amount of
 // memory if available otherwiuse will exit citing failure. Taken from Wiz.c
 void *checked_malloc(int num_bytes) {
@@ -16,6 +19,7 @@ void *checked_malloc(int num_bytes) {
     void *addr;
     // Allocate with malloc
     addr = malloc((size_t) num_bytes);
+    allocations++;
 
     //Check if null, if so report error otherwise return.
     if (addr == NULL) {
@@ -23,3 +27,25 @@ void *checked_malloc(int num_bytes) {
     }
     return addr;
 }
+
+// As checked_malloc, but resizing a block from checked_malloc, keeping its
+// contents
+void *checked_realloc(void *addr, int num_bytes) {
+    addr = realloc(addr, (size_t) num_bytes);
+    allocations++;
+    if (addr == NULL) {
+        report_error_and_exit("Out of memory");
+    }
+    return addr;
+}
+
+// The number of allocations made so far, for timing the compiler's passes
+long allocations_made(void) {
+    return allocations;
+}
+
+// Count allocations made by another thread (whose count ends with it) as
+// made by this one
+void count_allocations(long n) {
+    allocations += n;
+}
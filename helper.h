@@ -9,3 +9,6 @@
 
 -----------------------------------------------------------------------*/
 void    *checked_malloc(int num_bytes);
+void    *checked_realloc(void *addr, int num_bytes);
+long    allocations_made(void);
+void    count_allocations(long n);
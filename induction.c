@@ -0,0 +1,644 @@
+/* induction.c */
+
+/*-----------------------------------------------------------------------
+    Developed by: #undef TEAMNAME
+    Induction variable strength reduction of array accesses in while
+    loops, run after semantic analysis.
+
+    A loop is considered when its counter (an int local) is stepped by a
+    constant as the last statement of the body, is written nowhere else
+    in the loop, and the condition compares it against an invariant bound
+    in the direction it moves (i < n or i <= n when counting up, i > n or
+    i >= n when counting down).
+
+    An access whose indices are each an affine function a * i + b of the
+    counter (a and b constants) or invariant in the loop then moves by a
+    fixed number of elements every iteration. It is read and written
+    through an address temporary, bound before the loop and advanced
+    after the counter is stepped, so the loop no longer multiplies by
+    strides, adds offsets or checks bounds for it.
+
+    The checks are replaced by one check per loop entry: as the indices
+    are monotonic in the counter, every access is in bounds if it is for
+    the counter's first and last values. The loop is versioned on this
+    check, and the original loop runs when it fails, so that any fault
+    still happens exactly where it did before.
+-----------------------------------------------------------------------*/
+#include <stdlib.h>
+#include <limits.h>
+#include <string.h>
+#include "induction.h"
+#include "effects.h"
+#include "array_access.h"
+#include "helper.h"
+
+/*----------------------------------------------------------------------
+    Internal structures.
+-----------------------------------------------------------------------*/
+
+// Loops with more statements than this are not duplicated
+#define MAX_VERSIONED_STMTS 64
+
+// An access moving by a fixed number of elements each iteration
+typedef struct access {
+    Expr            *key;       /* the access as written in the loop */
+    symbol          *temp;
+    int             stride;     /* elements moved per iteration */
+    struct access   *next;
+} Access;
+
+// The loop being strength reduced
+typedef struct {
+    sym_table       *prog;
+    scope           *scope;
+    char            *counter;
+    int             step;
+    Names           *writes;    /* names the loop may change */
+    int             low;        /* counter values all accesses allow */
+    int             high;
+    Expr            *checks;    /* bounds of invariant indices */
+    Access          *accesses;
+    int             lineno;
+} IvLoop;
+
+/*----------------------------------------------------------------------
+    Internal function definitions.
+-----------------------------------------------------------------------*/
+void sr_statements(Stmts *stmts, sym_table *prog, scope *s);
+void sr_loop(Stmts *node, sym_table *prog, scope *s);
+
+BOOL is_counter(Expr *e, char *counter);
+
+void sr_stmts(Stmts *stmts, IvLoop *loop);
+void sr_expr(Expr *e, IvLoop *loop);
+void sr_access(Expr *e, IvLoop *loop);
+BOOL try_access(Expr *e, IvLoop *loop);
+void use_access(Expr *e, int stride, IvLoop *loop);
+BOOL affine(Expr *e, char *counter, int *a, int *b);
+BOOL is_invariant_index(Expr *e, IvLoop *loop);
+
+Expr *and_expr(Expr *e1, Expr *e2, int lineno);
+BOOL has_conjunct(Expr *e, Expr *conjunct);
+Expr *compare_expr(BinOp op, Expr *e, int val, int lineno);
+int floor_div(int n, int d);
+int ceil_div(int n, int d);
+
+/*----------------------------------------------------------------------
+    Function implementations
+-----------------------------------------------------------------------*/
+
+void strength_reduce_loops(Program *prog, sym_table *table) {
+    Procs *procs = prog->procedures;
+    while (procs != NULL) {
+        Proc *proc = procs->first;
+        scope *s = find_scope(proc->header->id, table);
+        sr_statements(proc->body->statements, table, s);
+        procs = procs->rest;
+    }
+}
+
+// Reduces every loop in a list of statements, innermost loops first
+void sr_statements(Stmts *stmts, sym_table *prog, scope *s) {
+    while (stmts != NULL) {
+        Stmt *stmt = stmts->first;
+        switch (stmt->kind) {
+            case STMT_COND:
+                sr_statements(stmt->info.cond.then_branch, prog, s);
+                sr_statements(stmt->info.cond.else_branch, prog, s);
+                break;
+
+            case STMT_WHILE:
+                sr_statements(stmt->info.loop.body, prog, s);
+                sr_loop(stmts, prog, s);
+                break;
+
+            default:
+                break;
+        }
+        stmts = stmts->rest;
+    }
+}
+
+// Replaces the loop held in node with
+//
+//      if <all accesses in bounds> then
+//          <bind address temporaries>
+//          while <cond> do <body using temporaries>; <advance them> od
+//      else
+//          <the original loop>
+//      fi
+void sr_loop(Stmts *node, sym_table *prog, scope *s) {
+    Stmt *orig = node->first;
+    While *w = &(orig->info.loop);
+    if (w->body == NULL || count_stmts(w->body) > MAX_VERSIONED_STMTS) {
+        return;
+    }
+
+    // the counter, its step and the last value it takes in the body
+    Stmts *last = w->body;
+    while (last->rest != NULL) {
+        last = last->rest;
+    }
+    IvLoop loop;
+    if (!find_step(last->first, &loop.counter, &loop.step)) {
+        return;
+    }
+    symbol *sym = retrieve_symbol_in_scope(loop.counter, s);
+    if (sym == NULL || sym->kind != SYM_LOCAL || sym->type != SYM_INT
+        || sym->bounds != NULL) {
+        return;
+    }
+
+    loop.prog = prog;
+    loop.scope = s;
+    loop.writes = stmts_writes(w->body, prog, s, NULL);
+    loop.low = INT_MIN;
+    loop.high = INT_MAX;
+    loop.checks = NULL;
+    loop.accesses = NULL;
+    loop.lineno = orig->lineno;
+
+    // the step must be the only write to the counter
+    Stmts *stmts = w->body;
+    Names *others = NULL;
+    while (stmts != last) {
+        others = stmt_writes(stmts->first, prog, s, others);
+        stmts = stmts->rest;
+    }
+    if (has_name(others, loop.counter)) {
+        return;
+    }
+
+    Expr *last_value = find_last_value(w->cond, loop.counter, loop.step);
+    if (last_value == NULL
+        || names_intersect(expr_reads(last_value, s, NULL), loop.writes)
+        || can_fault(last_value)) {
+        return;
+    }
+
+    // find the accesses in a copy of the body
+    Stmts *body = copy_stmts(w->body);
+    sr_stmts(body, &loop);
+    if (loop.accesses == NULL || loop.low > loop.high) {
+        return;
+    }
+
+    // the counter's first and last values must both be in range
+    int lineno = loop.lineno;
+    Expr *first_value = new_id_expr(loop.counter, INT_TYPE, lineno);
+    Expr *check = loop.checks;
+    check = and_expr(check, compare_expr(BINOP_GTEQ, first_value,
+                                         loop.low, lineno), lineno);
+    check = and_expr(check, compare_expr(BINOP_LTEQ, copy_expr(first_value),
+                                         loop.high, lineno), lineno);
+    check = and_expr(check, compare_expr(BINOP_GTEQ, last_value,
+                                         loop.low, lineno), lineno);
+    check = and_expr(check, compare_expr(BINOP_LTEQ, copy_expr(last_value),
+                                         loop.high, lineno), lineno);
+
+    // bind the temporaries, and advance them after the step
+    Stmts *binds = NULL;
+    Stmts *body_end = body;
+    while (body_end->rest != NULL) {
+        body_end = body_end->rest;
+    }
+    Access *access = loop.accesses;
+    while (access != NULL) {
+        Type t = access->key->inferred_type;
+        char *id = get_symbol_id(access->temp);
+
+        Stmt *bind = new_stmt(STMT_BIND, lineno);
+        bind->info.assign.asg_ident = new_id_expr(id, t, lineno);
+        bind->info.assign.asg_expr = access->key;
+        binds = new_stmts_node(bind, binds);
+
+        Stmt *advance = new_stmt(STMT_ADVANCE, lineno);
+        advance->info.assign.asg_ident = new_id_expr(id, t, lineno);
+        advance->info.assign.asg_expr = new_int_expr(access->stride, lineno);
+        body_end->rest = new_stmts_node(advance, NULL);
+        body_end = body_end->rest;
+
+        access = access->next;
+    }
+
+    Stmt *fast = new_stmt(STMT_WHILE, lineno);
+    fast->info.loop.cond = copy_expr(w->cond);
+    fast->info.loop.body = body;
+    Stmts *then_branch = binds;
+    while (binds->rest != NULL) {
+        binds = binds->rest;
+    }
+    binds->rest = new_stmts_node(fast, NULL);
+
+    Stmt *version = new_stmt(STMT_COND, lineno);
+    version->info.cond.cond = check;
+    version->info.cond.then_branch = then_branch;
+    version->info.cond.else_branch = new_stmts_node(orig, NULL);
+    node->first = version;
+}
+
+/*----------------------------------------------------------------------
+    Recognising counted loops
+-----------------------------------------------------------------------*/
+
+// Recognises i := i + k, i := k + i and i := i - k, for a non-zero int
+// constant k
+BOOL find_step(Stmt *stmt, char **counter, int *step) {
+    if (stmt->kind != STMT_ASSIGN
+        || stmt->info.assign.asg_ident->kind != EXPR_ID) {
+        return FALSE;
+    }
+    char *id = stmt->info.assign.asg_ident->id;
+    Expr *e = stmt->info.assign.asg_expr;
+    if (e->kind != EXPR_BINOP) {
+        return FALSE;
+    }
+
+    Expr *k = NULL;
+    if (e->binop == BINOP_ADD && is_counter(e->e1, id)) {
+        k = e->e2;
+    } else if (e->binop == BINOP_ADD && is_counter(e->e2, id)) {
+        k = e->e1;
+    } else if (e->binop == BINOP_SUB && is_counter(e->e1, id)) {
+        k = e->e2;
+    }
+    if (k == NULL || k->kind != EXPR_CONST || k->constant.type != INT_TYPE
+        || k->constant.val.int_val == 0) {
+        return FALSE;
+    }
+
+    *counter = id;
+    *step = k->constant.val.int_val;
+    if (e->binop == BINOP_SUB) {
+        *step = -*step;
+    }
+    return TRUE;
+}
+
+// For a condition comparing the counter against a bound, in the direction
+// the counter moves, returns the last value of the counter for which the
+// body runs (or NULL if the condition is of any other form)
+Expr *find_last_value(Expr *cond, char *counter, int step) {
+    if (cond->kind != EXPR_BINOP) {
+        return NULL;
+    }
+
+    // put the comparison in the form counter op bound
+    BinOp op = cond->binop;
+    Expr *bound;
+    if (is_counter(cond->e1, counter)) {
+        bound = cond->e2;
+    } else if (is_counter(cond->e2, counter)) {
+        bound = cond->e1;
+        switch (op) {
+            case BINOP_LT:   op = BINOP_GT;   break;
+            case BINOP_LTEQ: op = BINOP_GTEQ; break;
+            case BINOP_GT:   op = BINOP_LT;   break;
+            case BINOP_GTEQ: op = BINOP_LTEQ; break;
+            default:         return NULL;
+        }
+    } else {
+        return NULL;
+    }
+    if (bound->inferred_type != INT_TYPE) {
+        return NULL;
+    }
+
+    int lineno = cond->lineno;
+    switch (op) {
+        case BINOP_LT:
+            if (step < 0) {
+                return NULL;
+            }
+            return new_binop_expr(BINOP_SUB, copy_expr(bound),
+                                  new_int_expr(1, lineno), INT_TYPE, lineno);
+        case BINOP_GT:
+            if (step > 0) {
+                return NULL;
+            }
+            return new_binop_expr(BINOP_ADD, copy_expr(bound),
+                                  new_int_expr(1, lineno), INT_TYPE, lineno);
+        case BINOP_LTEQ:
+            return step > 0 ? copy_expr(bound) : NULL;
+
+        case BINOP_GTEQ:
+            return step < 0 ? copy_expr(bound) : NULL;
+
+        default:
+            return NULL;
+    }
+}
+
+BOOL is_counter(Expr *e, char *counter) {
+    return e->kind == EXPR_ID && streq(e->id, counter);
+}
+
+/*----------------------------------------------------------------------
+    Finding accesses that move with the counter
+-----------------------------------------------------------------------*/
+
+void sr_stmts(Stmts *stmts, IvLoop *loop) {
+    Exprs *args;
+    Params *params;
+
+    while (stmts != NULL) {
+        SInfo *info = &(stmts->first->info);
+        switch (stmts->first->kind) {
+            case STMT_ASSIGN:
+                sr_expr(info->assign.asg_expr, loop);
+                sr_access(info->assign.asg_ident, loop);
+                break;
+
+            case STMT_BIND:
+            case STMT_ADVANCE:
+                break;
+
+            case STMT_READ:
+                sr_access(info->read, loop);
+                break;
+
+            case STMT_WRITE:
+                sr_expr(info->write, loop);
+                break;
+
+            case STMT_FUNC:
+                params = find_scope(info->func->id, loop->prog)->params;
+                args = info->func->args;
+                while (args != NULL) {
+                    if (params->first->ind == REF_IND) {
+                        sr_access(args->first, loop);
+                    } else {
+                        sr_expr(args->first, loop);
+                    }
+                    args = args->rest;
+                    params = params->rest;
+                }
+                break;
+
+            case STMT_COND:
+                sr_expr(info->cond.cond, loop);
+                sr_stmts(info->cond.then_branch, loop);
+                sr_stmts(info->cond.else_branch, loop);
+                break;
+
+            case STMT_WHILE:
+                sr_expr(info->loop.cond, loop);
+                sr_stmts(info->loop.body, loop);
+                break;
+        }
+        stmts = stmts->rest;
+    }
+}
+
+void sr_expr(Expr *e, IvLoop *loop) {
+    switch (e->kind) {
+        case EXPR_ID:
+        case EXPR_CONST:
+            break;
+
+        case EXPR_BINOP:
+            sr_expr(e->e1, loop);
+            sr_expr(e->e2, loop);
+            break;
+
+        case EXPR_UNOP:
+            sr_expr(e->e1, loop);
+            break;
+
+        case EXPR_ARRAY:
+            sr_access(e, loop);
+            break;
+    }
+}
+
+// Uses an address temporary for an array access (read or written) if it
+// moves with the counter, or else looks for accesses in its indices
+void sr_access(Expr *e, IvLoop *loop) {
+    if (e->kind != EXPR_ARRAY || is_static_access(e)) {
+        return;
+    }
+    if (try_access(e, loop)) {
+        return;
+    }
+
+    Exprs *indices = e->indices;
+    while (indices != NULL) {
+        sr_expr(indices->first, loop);
+        indices = indices->rest;
+    }
+}
+
+// Checks every index is affine in the counter or invariant, narrowing the
+// counter values allowed by each affine index's bounds
+BOOL try_access(Expr *e, IvLoop *loop) {
+    symbol *sym = retrieve_symbol_in_scope(e->id, loop->scope);
+    Bounds *bounds = sym->bounds;
+    Exprs *indices = e->indices;
+    Expr *checks = NULL;
+    int low = loop->low;
+    int high = loop->high;
+    int stride = 0;
+    BOOL moves = FALSE;
+    int a, b;
+
+    while (indices != NULL) {
+        Expr *index = indices->first;
+        Bound *bound = bounds->first;
+
+        if (affine(index, loop->counter, &a, &b)) {
+            if (a == 0) {
+                // a constant index, which is either always in bounds or
+                // always faults
+                if (b < bound->lower || b > bound->upper) {
+                    return FALSE;
+                }
+            } else {
+                // lower <= a * i + b <= upper
+                if (a > 0) {
+                    low = max(low, ceil_div(bound->lower - b, a));
+                    high = min(high, floor_div(bound->upper - b, a));
+                } else {
+                    low = max(low, ceil_div(bound->upper - b, a));
+                    high = min(high, floor_div(bound->lower - b, a));
+                }
+                stride += a * bound->offset_size;
+                moves = TRUE;
+            }
+        } else if (is_invariant_index(index, loop)) {
+            checks = and_expr(checks, compare_expr(BINOP_GTEQ,
+                              copy_expr(index), bound->lower, loop->lineno),
+                              loop->lineno);
+            checks = and_expr(checks, compare_expr(BINOP_LTEQ,
+                              copy_expr(index), bound->upper, loop->lineno),
+                              loop->lineno);
+        } else {
+            return FALSE;
+        }
+
+        indices = indices->rest;
+        bounds = bounds->rest;
+    }
+
+    if (!moves || low > high) {
+        return FALSE;
+    }
+
+    loop->low = low;
+    loop->high = high;
+    if (checks != NULL) {
+        loop->checks = and_expr(loop->checks, checks, loop->lineno);
+    }
+    use_access(e, stride * loop->step, loop);
+    return TRUE;
+}
+
+// Rewrites the access to go through its address temporary, sharing one
+// temporary between identical accesses
+void use_access(Expr *e, int stride, IvLoop *loop) {
+    Access *access = loop->accesses;
+    while (access != NULL) {
+        if (exprs_equal(access->key, e)) {
+            make_id_expr(e, get_symbol_id(access->temp));
+            return;
+        }
+        access = access->next;
+    }
+
+    access = (Access *) checked_malloc(sizeof(Access));
+    access->key = copy_expr(e);
+    access->temp = create_temp_symbol(loop->prog, loop->scope,
+                                      e->inferred_type, TRUE);
+    access->temp->target = e->id;
+    access->stride = stride;
+    access->next = loop->accesses;
+    loop->accesses = access;
+
+    make_id_expr(e, get_symbol_id(access->temp));
+}
+
+// Whether e is a * counter + b for int constants a and b
+BOOL affine(Expr *e, char *counter, int *a, int *b) {
+    int a1, b1, a2, b2;
+
+    switch (e->kind) {
+        case EXPR_ID:
+            if (!streq(e->id, counter)) {
+                return FALSE;
+            }
+            *a = 1;
+            *b = 0;
+            return TRUE;
+
+        case EXPR_CONST:
+            if (e->constant.type != INT_TYPE) {
+                return FALSE;
+            }
+            *a = 0;
+            *b = e->constant.val.int_val;
+            return TRUE;
+
+        case EXPR_UNOP:
+            if (e->unop != UNOP_MINUS || !affine(e->e1, counter, &a1, &b1)) {
+                return FALSE;
+            }
+            *a = -a1;
+            *b = -b1;
+            return TRUE;
+
+        case EXPR_BINOP:
+            if (!affine(e->e1, counter, &a1, &b1)
+                || !affine(e->e2, counter, &a2, &b2)) {
+                return FALSE;
+            }
+            switch (e->binop) {
+                case BINOP_ADD:
+                    *a = a1 + a2;
+                    *b = b1 + b2;
+                    return TRUE;
+
+                case BINOP_SUB:
+                    *a = a1 - a2;
+                    *b = b1 - b2;
+                    return TRUE;
+
+                case BINOP_MUL:
+                    // one side must be constant to stay affine
+                    if (a1 != 0 && a2 != 0) {
+                        return FALSE;
+                    }
+                    *a = a1 * b2 + a2 * b1;
+                    *b = b1 * b2;
+                    return TRUE;
+
+                default:
+                    return FALSE;
+            }
+
+        case EXPR_ARRAY:
+            return FALSE;
+    }
+    return FALSE;
+}
+
+// An index the loop cannot change, and that can be evaluated (in the
+// check before the loop) without faulting
+BOOL is_invariant_index(Expr *e, IvLoop *loop) {
+    return !can_fault(e)
+           && !names_intersect(expr_reads(e, loop->scope, NULL),
+                               loop->writes);
+}
+
+/*----------------------------------------------------------------------
+    Helper functions
+-----------------------------------------------------------------------*/
+
+// Conjunction of two conditions, either of which may be missing, leaving
+// out any conjunct of e2 already tested by e1 (accesses sharing an
+// invariant index would otherwise check it repeatedly)
+Expr *and_expr(Expr *e1, Expr *e2, int lineno) {
+    if (e2 == NULL) {
+        return e1;
+    }
+    if (e2->kind == EXPR_BINOP && e2->binop == BINOP_AND) {
+        e1 = and_expr(e1, e2->e1, lineno);
+        return and_expr(e1, e2->e2, lineno);
+    }
+    if (e1 == NULL) {
+        return e2;
+    }
+    if (has_conjunct(e1, e2)) {
+        return e1;
+    }
+    return new_binop_expr(BINOP_AND, e1, e2, BOOL_TYPE, lineno);
+}
+
+BOOL has_conjunct(Expr *e, Expr *conjunct) {
+    if (e->kind == EXPR_BINOP && e->binop == BINOP_AND) {
+        return has_conjunct(e->e1, conjunct)
+               || has_conjunct(e->e2, conjunct);
+    }
+    return exprs_equal(e, conjunct);
+}
+
+// Compares an int expression against a constant
+Expr *compare_expr(BinOp op, Expr *e, int val, int lineno) {
+    return new_binop_expr(op, e, new_int_expr(val, lineno), BOOL_TYPE,
+                          lineno);
+}
+
+// Division rounding down or up, whatever the signs
+int floor_div(int n, int d) {
+    int q = n / d;
+    if ((n % d != 0) && ((n < 0) != (d < 0))) {
+        q--;
+    }
+    return q;
+}
+
+int ceil_div(int n, int d) {
+    int q = n / d;
+    if ((n % d != 0) && ((n < 0) == (d < 0))) {
+        q++;
+    }
+    return q;
+}
@@ -0,0 +1,28 @@
+/* induction.h */
+
+/*-----------------------------------------------------------------------
+    Developed by: #undef TEAMNAME
+    Provides function definitions and external access rights for
+    induction.c
+-----------------------------------------------------------------------*/
+#include "ast.h"
+#include "symbol.h"
+
+/*----------------------------------------------------------------------
+    External Functions that will be accessed by other C files.
+-----------------------------------------------------------------------*/
+// Replaces array accesses indexed by a loop counter with address
+// temporaries that are advanced each iteration, so the loop neither
+// recalculates their offsets nor checks their bounds. Must run after
+// analysis, as it relies on inferred types and adds temporaries to the
+// symbol table.
+void strength_reduce_loops(Program *prog, sym_table *table);
+
+// Recognises a counter step i := i + k, k + i or i - k (k a non-zero int
+// constant) as the statement, giving the counter and its signed step
+BOOL find_step(Stmt *stmt, char **counter, int *step);
+
+// The last value of the counter for which a loop with the condition runs,
+// if the condition compares it against a bound in the direction it steps
+// (NULL otherwise)
+Expr *find_last_value(Expr *cond, char *counter, int step);
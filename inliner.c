@@ -0,0 +1,562 @@
+/* inliner.c */
+
+/*-----------------------------------------------------------------------
+    Developed by: #undef TEAMNAME
+    Procedure inlining, run after semantic analysis.
+
+    A call to a small proc that cannot reach itself through further calls
+    is replaced by a copy of the proc's body, saving the argument set up,
+    the call itself and the callee's prologue and epilogue. Procs are
+    inlined into their callers bottom up, so the body copied into a caller
+    already has its own small callees inlined, and its size is measured
+    after that.
+
+    In the copy of the body:
+    - a val parameter becomes a temporary assigned the argument, unless the
+      body never writes the parameter and the argument is a constant (which
+      can then be folded) or a variable the call cannot change, which are
+      used directly;
+    - a ref parameter is replaced by the variable passed, or by an address
+      temporary bound to the array element passed (bounds checked where the
+      call was), so that writes reach the caller's storage;
+    - each local becomes a temporary, set to zero where the call was (as
+      the callee's prologue would have done) unless the body starts by
+      assigning it.
+    Procs declaring arrays are never inlined, as their locals would need a
+    block of slots in the caller.
+-----------------------------------------------------------------------*/
+#include <stdlib.h>
+#include <string.h>
+#include "inliner.h"
+#include "callgraph.h"
+#include "effects.h"
+#include "array_access.h"
+#include "helper.h"
+
+/*----------------------------------------------------------------------
+    Internal structures.
+-----------------------------------------------------------------------*/
+
+// How far inlining into a proc has got
+typedef enum {
+    PROC_UNSEEN, PROC_ACTIVE, PROC_DONE
+} ProcState;
+
+// What is known about each proc of the program
+typedef struct proc_info {
+    Proc                *proc;
+    scope               *scope;
+    ProcState           state;
+    BOOL                recursive;  /* may reach itself through calls */
+    BOOL                has_arrays;
+    int                 size;       /* once its own callees are inlined */
+    struct proc_info    *next;
+} ProcInfo;
+
+// What a name of the callee becomes in the caller
+typedef struct renaming {
+    char                *id;
+    Expr                *replacement;
+    struct renaming     *next;
+} Renaming;
+
+typedef struct {
+    sym_table           *prog;
+    ProcInfo            *procs;
+    int                 threshold;
+    int                 inlined;
+} Inliner;
+
+/*----------------------------------------------------------------------
+    Internal function definitions.
+-----------------------------------------------------------------------*/
+void inline_into(ProcInfo *caller, Inliner *in);
+void inline_statements(Stmts **link, BOOL in_loop, ProcInfo *caller,
+                       Inliner *in);
+Stmts **inline_call(Stmts **link, BOOL in_loop, ProcInfo *caller,
+                    Inliner *in);
+BOOL should_inline(Function *f, BOOL in_loop, ProcInfo *callee, Inliner *in);
+
+void rename_stmts(Stmts *stmts, Renaming **names, ProcInfo *callee,
+                  ProcInfo *caller, Inliner *in);
+void rename_expr(Expr *e, Renaming **names, ProcInfo *callee,
+                 ProcInfo *caller, Inliner *in);
+Renaming *add_renaming(Renaming *names, char *id, Expr *replacement);
+Expr *new_temp(Type t, BOOL is_address, Stmts **pre, Expr *value,
+               ProcInfo *caller, Inliner *in, int lineno);
+
+ProcInfo *find_info(char *id, Inliner *in);
+BOOL assigned_first(Stmts *stmts, char *id, ProcInfo *callee);
+BOOL is_unchanged_var(Expr *arg, Param *p, Exprs *args, Names *writes,
+                      ProcInfo *callee, ProcInfo *caller);
+BOOL has_arrays(Decls *decls);
+int stmts_size(Stmts *stmts);
+int exprs_size(Exprs *es);
+
+/*----------------------------------------------------------------------
+    Function implementations
+-----------------------------------------------------------------------*/
+
+int inline_procs(Program *prog, sym_table *table, int threshold) {
+    Inliner in;
+    in.prog = table;
+    in.procs = NULL;
+    in.threshold = threshold;
+    in.inlined = 0;
+
+    // gather the procs, in program order. Recursion is decided on the
+    // program as written.
+    CallGraph *graph = build_call_graph(prog);
+    ProcInfo *last = NULL;
+    Procs *procs = prog->procedures;
+    while (procs != NULL) {
+        Proc *proc = procs->first;
+        ProcInfo *info = (ProcInfo *) checked_malloc(sizeof(ProcInfo));
+        info->proc = proc;
+        info->scope = find_scope(proc->header->id, table);
+        info->state = PROC_UNSEEN;
+        info->recursive = find_call_node(graph, proc->header->id)->recursive;
+        info->has_arrays = has_arrays(proc->body->decls);
+        info->size = 0;
+        info->next = NULL;
+        if (last == NULL) {
+            in.procs = info;
+        } else {
+            last->next = info;
+        }
+        last = info;
+        procs = procs->rest;
+    }
+
+    ProcInfo *info;
+    for (info = in.procs; info != NULL; info = info->next) {
+        inline_into(info, &in);
+    }
+    return in.inlined;
+}
+
+// Inlines calls in a proc's body, after first inlining into each proc it
+// calls. A proc reached again while it is still active is recursive, and
+// is left alone.
+void inline_into(ProcInfo *caller, Inliner *in) {
+    if (caller->state != PROC_UNSEEN) {
+        return;
+    }
+    caller->state = PROC_ACTIVE;
+    inline_statements(&(caller->proc->body->statements), FALSE, caller, in);
+    caller->size = stmts_size(caller->proc->body->statements);
+    caller->state = PROC_DONE;
+}
+
+// Inlines the calls in the list starting at *link, which may replace or
+// remove the nodes holding them
+void inline_statements(Stmts **link, BOOL in_loop, ProcInfo *caller,
+                       Inliner *in) {
+    while (*link != NULL) {
+        Stmt *stmt = (*link)->first;
+        switch (stmt->kind) {
+            case STMT_COND:
+                inline_statements(&(stmt->info.cond.then_branch), in_loop,
+                                  caller, in);
+                inline_statements(&(stmt->info.cond.else_branch), in_loop,
+                                  caller, in);
+                break;
+
+            case STMT_WHILE:
+                inline_statements(&(stmt->info.loop.body), TRUE, caller, in);
+                break;
+
+            case STMT_FUNC:
+                link = inline_call(link, in_loop, caller, in);
+                continue;
+
+            default:
+                break;
+        }
+        link = &((*link)->rest);
+    }
+}
+
+// Replaces the call held in *link by the callee's body, if it is worth it.
+// Returns the link following the inlined code.
+Stmts **inline_call(Stmts **link, BOOL in_loop, ProcInfo *caller,
+                    Inliner *in) {
+    Stmts *node = *link;
+    Function *f = node->first->info.func;
+    ProcInfo *callee = find_info(f->id, in);
+    inline_into(callee, in);
+    if (!should_inline(f, in_loop, callee, in)) {
+        return &(node->rest);
+    }
+
+    int lineno = node->first->lineno;
+    Stmts *pre = NULL;
+    Renaming *names = NULL;
+    Expr *rep;
+    Body *body = callee->proc->body;
+    Names *writes = stmts_writes(body->statements, in->prog, callee->scope,
+                                 NULL);
+    BOOL args_fault = FALSE;
+
+    // bind the parameters to the arguments, in the order the call would
+    // have evaluated them
+    Params *params = callee->scope->params;
+    Exprs *args = f->args;
+    while (params != NULL) {
+        Param *p = params->first;
+        Expr *arg = args->first;
+        rep = arg;
+        args_fault = args_fault || can_fault(arg);
+        if (p->ind == REF_IND) {
+            if (arg->kind == EXPR_ARRAY && !is_static_access(arg)) {
+                rep = new_temp(p->type, TRUE, &pre, arg, caller, in,
+                               lineno);
+            }
+        } else if (arg->kind == EXPR_CONST && !has_name(writes, p->id)) {
+            if (p->type == FLOAT_TYPE && arg->constant.type == INT_TYPE) {
+                rep = new_zero_expr(FLOAT_TYPE, arg->lineno);
+                rep->constant.val.float_val = arg->constant.val.int_val;
+            }
+        } else if (!is_unchanged_var(arg, p, f->args, writes, callee,
+                                     caller)) {
+            // a copy of the value as it is at the call, even of an element
+            rep = new_temp(p->type, FALSE, &pre, arg, caller, in, lineno);
+        }
+        names = add_renaming(names, p->id, rep);
+        params = params->rest;
+        args = args->rest;
+    }
+
+    // the locals start as zero, as they would in the callee's prologue,
+    // unless the body sets them before reading them
+    Decls *decls = body->decls;
+    while (decls != NULL) {
+        Decl *d = decls->first;
+        if (assigned_first(body->statements, d->id, callee)) {
+            symbol *temp = create_temp_symbol(in->prog, caller->scope,
+                                              d->type, FALSE);
+            rep = new_id_expr(get_symbol_id(temp), d->type, lineno);
+        } else {
+            rep = new_temp(d->type, FALSE, &pre,
+                           new_zero_expr(d->type, lineno), caller, in, lineno);
+        }
+        names = add_renaming(names, d->id, rep);
+        decls = decls->rest;
+    }
+
+    Stmts *copy = copy_stmts(body->statements);
+    rename_stmts(copy, &names, callee, caller, in);
+
+    // a body left empty (by dead branch removal or specialisation) only
+    // needs the arguments evaluated, if that may fault
+    if (copy == NULL && !args_fault) {
+        pre = NULL;
+    }
+
+    // splice the inlined code in place of the call
+    Stmts *code = copy;
+    if (pre != NULL) {
+        code = pre;
+        Stmts *last = pre;
+        while (last->rest != NULL) {
+            last = last->rest;
+        }
+        last->rest = copy;
+    }
+    in->inlined++;
+    if (code == NULL) {
+        *link = node->rest;
+        return link;
+    }
+
+    *link = code;
+    while (code->rest != NULL) {
+        code = code->rest;
+    }
+    code->rest = node->rest;
+    return &(code->rest);
+}
+
+// A call is inlined when the callee is small enough (allowing more inside
+// loops, where the call is made repeatedly), cannot reach itself, and each
+// ref argument is a variable or element of exactly the parameter's type
+BOOL should_inline(Function *f, BOOL in_loop, ProcInfo *callee, Inliner *in) {
+    int limit = in_loop ? 2 * in->threshold : in->threshold;
+    if (callee->state != PROC_DONE || callee->recursive
+        || callee->has_arrays || callee->size > limit) {
+        return FALSE;
+    }
+
+    Params *params = callee->scope->params;
+    Exprs *args = f->args;
+    while (params != NULL) {
+        Param *p = params->first;
+        Expr *arg = args->first;
+        if (p->ind == REF_IND
+            && ((arg->kind != EXPR_ID && arg->kind != EXPR_ARRAY)
+                || arg->inferred_type != p->type)) {
+            return FALSE;
+        }
+        params = params->rest;
+        args = args->rest;
+    }
+    return TRUE;
+}
+
+/*----------------------------------------------------------------------
+    Renaming the callee's names in the copy of its body
+-----------------------------------------------------------------------*/
+
+void rename_stmts(Stmts *stmts, Renaming **names, ProcInfo *callee,
+                  ProcInfo *caller, Inliner *in) {
+    while (stmts != NULL) {
+        Stmt *stmt = stmts->first;
+        SInfo *info = &(stmt->info);
+        Exprs *args;
+
+        switch (stmt->kind) {
+            case STMT_ASSIGN:
+            case STMT_BIND:
+            case STMT_ADVANCE:
+                rename_expr(info->assign.asg_ident, names, callee, caller, in);
+                rename_expr(info->assign.asg_expr, names, callee, caller, in);
+                break;
+
+            case STMT_COND:
+                rename_expr(info->cond.cond, names, callee, caller, in);
+                rename_stmts(info->cond.then_branch, names, callee, caller,
+                             in);
+                rename_stmts(info->cond.else_branch, names, callee, caller,
+                             in);
+                break;
+
+            case STMT_WHILE:
+                rename_expr(info->loop.cond, names, callee, caller, in);
+                rename_stmts(info->loop.body, names, callee, caller, in);
+                break;
+
+            case STMT_READ:
+                rename_expr(info->read, names, callee, caller, in);
+                break;
+
+            case STMT_WRITE:
+                rename_expr(info->write, names, callee, caller, in);
+                break;
+
+            case STMT_FUNC:
+                args = info->func->args;
+                while (args != NULL) {
+                    rename_expr(args->first, names, callee, caller, in);
+                    args = args->rest;
+                }
+                break;
+        }
+        stmts = stmts->rest;
+    }
+}
+
+void rename_expr(Expr *e, Renaming **names, ProcInfo *callee,
+                 ProcInfo *caller, Inliner *in) {
+    Renaming *r;
+    Expr *rep;
+
+    switch (e->kind) {
+        case EXPR_ID:
+            r = *names;
+            while (r != NULL && !streq(r->id, e->id)) {
+                r = r->next;
+            }
+            if (r == NULL) {
+                // a temporary of the callee (from procs inlined into it)
+                symbol *sym = retrieve_symbol_in_scope(e->id, callee->scope);
+                symbol *temp = create_temp_symbol(in->prog, caller->scope,
+                                                  get_type(sym), FALSE);
+                *names = add_renaming(*names, e->id,
+                                      new_id_expr(get_symbol_id(temp),
+                                                  get_type(sym), e->lineno));
+                r = *names;
+            }
+            if (r->replacement->kind == EXPR_ID) {
+                make_id_expr(e, r->replacement->id);
+            } else {
+                rep = copy_expr(r->replacement);
+                rep->lineno = e->lineno;
+                *e = *rep;
+            }
+            break;
+
+        case EXPR_BINOP:
+            rename_expr(e->e1, names, callee, caller, in);
+            rename_expr(e->e2, names, callee, caller, in);
+            break;
+
+        case EXPR_UNOP:
+            rename_expr(e->e1, names, callee, caller, in);
+            break;
+
+        case EXPR_CONST:
+        case EXPR_ARRAY:
+            // procs with arrays are never inlined
+            break;
+    }
+}
+
+Renaming *add_renaming(Renaming *names, char *id, Expr *replacement) {
+    Renaming *r = (Renaming *) checked_malloc(sizeof(Renaming));
+    r->id = id;
+    r->replacement = replacement;
+    r->next = names;
+    return r;
+}
+
+// Creates a temporary of the caller set to value (or, for an address
+// temporary, bound to the address of the array element value), returning
+// an expression reading it
+Expr *new_temp(Type t, BOOL is_address, Stmts **pre, Expr *value,
+               ProcInfo *caller, Inliner *in, int lineno) {
+    symbol *temp = create_temp_symbol(in->prog, caller->scope, t, is_address);
+    if (is_address) {
+        temp->target = value->id;
+    }
+
+    Stmt *def = new_stmt(is_address ? STMT_BIND : STMT_ASSIGN, lineno);
+    def->info.assign.asg_ident = new_id_expr(get_symbol_id(temp), t, lineno);
+    def->info.assign.asg_expr = value;
+    *pre = append_stmt(*pre, def);
+    return new_id_expr(get_symbol_id(temp), t, lineno);
+}
+
+/*----------------------------------------------------------------------
+    Helper functions
+-----------------------------------------------------------------------*/
+
+ProcInfo *find_info(char *id, Inliner *in) {
+    ProcInfo *info = in->procs;
+    while (info != NULL && !streq(info->proc->header->id, id)) {
+        info = info->next;
+    }
+    return info;
+}
+
+// Whether a val parameter can read the caller's variable passed to it
+// directly: the body must never write the parameter, and the variable must
+// not change during the call. Only a ref parameter can change it, so it
+// must be a local or val parameter of the caller (which no other ref
+// parameter can alias) not also passed by reference.
+BOOL is_unchanged_var(Expr *arg, Param *p, Exprs *args, Names *writes,
+                      ProcInfo *callee, ProcInfo *caller) {
+    if (arg->kind != EXPR_ID || arg->inferred_type != p->type
+        || has_name(writes, p->id)) {
+        return FALSE;
+    }
+    symbol *sym = retrieve_symbol_in_scope(arg->id, caller->scope);
+    if (sym->kind == SYM_PARAM_REF) {
+        return FALSE;
+    }
+
+    Params *params = callee->scope->params;
+    while (params != NULL) {
+        if (params->first->ind == REF_IND && args->first->kind == EXPR_ID
+            && streq(args->first->id, arg->id)) {
+            return FALSE;
+        }
+        params = params->rest;
+        args = args->rest;
+    }
+    return TRUE;
+}
+
+// Whether one of the assignments a body starts with sets a local before
+// anything reads it
+BOOL assigned_first(Stmts *stmts, char *id, ProcInfo *callee) {
+    while (stmts != NULL && stmts->first->kind == STMT_ASSIGN) {
+        Assign *a = &(stmts->first->info.assign);
+        if (has_name(expr_reads(a->asg_expr, callee->scope, NULL), id)) {
+            return FALSE;
+        }
+        if (streq(a->asg_ident->id, id)) {
+            return TRUE;
+        }
+        stmts = stmts->rest;
+    }
+    return FALSE;
+}
+
+BOOL has_arrays(Decls *decls) {
+    while (decls != NULL) {
+        if (decls->first->array != NULL) {
+            return TRUE;
+        }
+        decls = decls->rest;
+    }
+    return FALSE;
+}
+
+// The size of some code, counting each statement and expression node
+int stmts_size(Stmts *stmts) {
+    int size = 0;
+    while (stmts != NULL) {
+        Stmt *stmt = stmts->first;
+        SInfo *info = &(stmt->info);
+        size++;
+
+        switch (stmt->kind) {
+            case STMT_ASSIGN:
+            case STMT_BIND:
+            case STMT_ADVANCE:
+                size += expr_size(info->assign.asg_ident);
+                size += expr_size(info->assign.asg_expr);
+                break;
+
+            case STMT_COND:
+                size += expr_size(info->cond.cond);
+                size += stmts_size(info->cond.then_branch);
+                size += stmts_size(info->cond.else_branch);
+                break;
+
+            case STMT_WHILE:
+                size += expr_size(info->loop.cond);
+                size += stmts_size(info->loop.body);
+                break;
+
+            case STMT_READ:
+                size += expr_size(info->read);
+                break;
+
+            case STMT_WRITE:
+                size += expr_size(info->write);
+                break;
+
+            case STMT_FUNC:
+                size += exprs_size(info->func->args);
+                break;
+        }
+        stmts = stmts->rest;
+    }
+    return size;
+}
+
+int expr_size(Expr *e) {
+    switch (e->kind) {
+        case EXPR_BINOP:
+            return 1 + expr_size(e->e1) + expr_size(e->e2);
+
+        case EXPR_UNOP:
+            return 1 + expr_size(e->e1);
+
+        case EXPR_ARRAY:
+            return 1 + exprs_size(e->indices);
+
+        default:
+            return 1;
+    }
+}
+
+int exprs_size(Exprs *es) {
+    int size = 0;
+    while (es != NULL) {
+        size += expr_size(es->first);
+        es = es->rest;
+    }
+    return size;
+}
@@ -0,0 +1,26 @@
+/* inliner.h */
+
+/*-----------------------------------------------------------------------
+    Developed by: #undef TEAMNAME
+    Provides function definitions and external access rights for
+    inliner.c
+-----------------------------------------------------------------------*/
+#include "ast.h"
+#include "symbol.h"
+
+/*----------------------------------------------------------------------
+    External Functions that will be accessed by other C files.
+-----------------------------------------------------------------------*/
+// The largest proc body (counted in statements and expression nodes) that
+// is inlined at a call outside of a loop. Calls inside a loop are worth
+// more, and may inline bodies up to twice this size.
+#define INLINE_THRESHOLD 40
+
+// Replaces calls to small, non-recursive procs with copies of their
+// bodies, whose parameters and locals become compiler temporaries of the
+// caller. Must run after analysis, as it relies on inferred types and adds
+// temporaries to the symbol table. Returns the number of calls inlined.
+int inline_procs(Program *prog, sym_table *table, int threshold);
+
+// The size of an expression, counting each node
+int expr_size(Expr *e);
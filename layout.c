@@ -0,0 +1,433 @@
+/* layout.c */
+
+/*-----------------------------------------------------------------------
+    Developed by: #undef TEAMNAME
+    Basic block layout of the generated Oz program, run before the
+    peephole optimiser.
+
+    Codegen emits the same shapes of labels and branches for every if
+    and while, so jumps often go to other jumps or to the very next
+    line, and many labels are never branched to. The program is cleaned
+    up in rounds until nothing changes:
+
+    - a branch to a label whose code is an unconditional jump goes to
+      that jump's label instead (jump threading)
+    - a conditional branch over an unconditional jump is inverted, to
+      branch straight to the jump's label
+    - a branch to the code straight after it is removed
+    - the blocks of each proc are laid out in chains, each block followed
+      by the block it jumps to when no other block falls into it, so that
+      the jump can be removed
+    - code no path from the start of the program or of a proc reaches is
+      removed, and then labels no branch refers to
+
+    A block starts at a proc or at labels (with the comments just before
+    them), and just after a branch, and ends where the next one starts.
+-----------------------------------------------------------------------*/
+#include <stdlib.h>
+#include <string.h>
+#include "layout.h"
+#include "helper.h"
+
+// Rounds of clean up before giving up on reaching a fixed point
+#define MAX_ROUNDS 8
+
+/*----------------------------------------------------------------------
+    Internal function definitions.
+-----------------------------------------------------------------------*/
+int thread_jumps(OzProgram *p);
+int invert_branches(OzProgram *p);
+int drop_next_branches(OzProgram *p);
+int order_blocks(OzProgram *p);
+int drop_unreachable(OzProgram *p);
+int drop_unused_labels(OzProgram *p);
+
+int *find_labels(OzProgram *p, int *nlabels);
+int *find_blocks(OzProgram *p, int *nblocks);
+int next_code(OzProgram *p, int i);
+BOOL reaches_without_code(OzProgram *p, int from, int to);
+int branch_target(OzLine *l);
+void set_branch_target(OzLine *l, int label);
+BOOL ends_flow(OzLine *l);
+BOOL *no_lines_dropped(OzProgram *p);
+
+/*----------------------------------------------------------------------
+    Function implementations
+-----------------------------------------------------------------------*/
+
+int layout_program(OzProgram *p) {
+    int total = 0, changes, rounds = 0;
+    do {
+        changes = thread_jumps(p);
+        changes += invert_branches(p);
+        changes += drop_next_branches(p);
+        changes += order_blocks(p);
+        changes += drop_unreachable(p);
+        changes += drop_unused_labels(p);
+        total += changes;
+    } while (changes > 0 && ++rounds < MAX_ROUNDS);
+    return total;
+}
+
+/*----------------------------------------------------------------------
+    The clean ups. Each returns the number of changes it made.
+-----------------------------------------------------------------------*/
+
+// Branches to a jump go where the jump goes (stopping at a loop of jumps)
+int thread_jumps(OzProgram *p) {
+    int nlabels;
+    int *labels = find_labels(p, &nlabels);
+    int changes = 0;
+    int i, steps;
+    for (i = 0; i < p->nlines; i++) {
+        int label = branch_target(&p->lines[i]);
+        if (label < 0) {
+            continue;
+        }
+        int to = label;
+        for (steps = 0; steps < nlabels; steps++) {
+            int at = next_code(p, labels[to]);
+            if (at == p->nlines || !is_oz_op(&p->lines[at], OP_BRANCH_UNCOND)
+                || p->lines[at].arg1 == to) {
+                break;
+            }
+            to = p->lines[at].arg1;
+        }
+        if (to != label) {
+            set_branch_target(&p->lines[i], to);
+            changes++;
+        }
+    }
+    free(labels);
+    return changes;
+}
+
+// branch_on_false r, L1; branch_uncond L2; L1:  =>  branch_on_true r, L2;
+int invert_branches(OzProgram *p) {
+    int nlabels;
+    int *labels = find_labels(p, &nlabels);
+    BOOL *dropped = no_lines_dropped(p);
+    int changes = 0;
+    int i, j;
+    for (i = 0; i < p->nlines; i++) {
+        OzLine *branch = &p->lines[i];
+        if (!is_oz_op(branch, OP_BRANCH_ON_TRUE)
+            && !is_oz_op(branch, OP_BRANCH_ON_FALSE)) {
+            continue;
+        }
+        for (j = i + 1; j < p->nlines && p->lines[j].kind == OZ_COMMENT;
+             j++) {
+        }
+        if (j == p->nlines || !is_oz_op(&p->lines[j], OP_BRANCH_UNCOND)
+            || !reaches_without_code(p, j + 1, labels[branch->arg2])) {
+            continue;
+        }
+        branch->code = is_oz_op(branch, OP_BRANCH_ON_TRUE) ? OP_BRANCH_ON_FALSE
+                                                       : OP_BRANCH_ON_TRUE;
+        branch->arg2 = p->lines[j].arg1;
+        dropped[j] = TRUE;
+        changes++;
+        i = j;
+    }
+    drop_oz_lines(p, dropped);
+    free(dropped);
+    free(labels);
+    return changes;
+}
+
+// A branch to the code that follows it anyway does nothing
+int drop_next_branches(OzProgram *p) {
+    int nlabels;
+    int *labels = find_labels(p, &nlabels);
+    BOOL *dropped = no_lines_dropped(p);
+    int changes = 0;
+    int i;
+    for (i = 0; i < p->nlines; i++) {
+        int label = branch_target(&p->lines[i]);
+        if (label >= 0 && reaches_without_code(p, i + 1, labels[label])) {
+            dropped[i] = TRUE;
+            changes++;
+        }
+    }
+    drop_oz_lines(p, dropped);
+    free(dropped);
+    free(labels);
+    return changes;
+}
+
+// Lays out each proc's blocks in chains. A block is followed by the one
+// it falls into, or else by the one it jumps to if no block falls into
+// that one and it is not yet placed, dropping the jump; a chain ends at
+// a block that jumps elsewhere, and the next starts at the first block
+// (in the original order) not yet placed. The block starting a proc
+// stays first, and each block a block falls into stays straight after
+// it, so only the dropped jumps change what runs.
+int order_blocks(OzProgram *p) {
+    int nlabels, nblocks;
+    int *labels = find_labels(p, &nlabels);
+    int *starts = find_blocks(p, &nblocks);
+    int *block_of = checked_malloc(p->nlines * sizeof(int));
+    int *last = checked_malloc(nblocks * sizeof(int));
+    int *region = checked_malloc(nblocks * sizeof(int));
+    BOOL *falls = checked_malloc(nblocks * sizeof(BOOL));
+    BOOL *placed = checked_malloc(nblocks * sizeof(BOOL));
+    int *order = checked_malloc(nblocks * sizeof(int));
+    BOOL *dropped = no_lines_dropped(p);
+    int b, i, norder = 0, changes = 0;
+
+    // the blocks of a proc share the index of its first block as region
+    for (b = 0; b < nblocks; b++) {
+        last[b] = -1;
+        region[b] = b > 0 ? region[b - 1] : 0;
+        for (i = starts[b]; i < starts[b + 1]; i++) {
+            block_of[i] = b;
+            if (p->lines[i].kind != OZ_COMMENT) {
+                last[b] = i;
+            }
+            if (p->lines[i].kind == OZ_PROC) {
+                region[b] = b;
+            }
+        }
+        falls[b] = last[b] < 0 || !ends_flow(&p->lines[last[b]]);
+        placed[b] = FALSE;
+    }
+
+    int first;
+    for (first = 0; first < nblocks; first++) {
+        b = first;
+        while (b >= 0 && !placed[b]) {
+            placed[b] = TRUE;
+            order[norder++] = b;
+            if (falls[b]) {
+                b = b + 1 < nblocks ? b + 1 : -1;
+                continue;
+            }
+            OzLine *jump = &p->lines[last[b]];
+            int to = is_oz_op(jump, OP_BRANCH_UNCOND)
+                     ? block_of[labels[jump->arg1]] : -1;
+            if (to > 0 && region[to] == region[b] && to != region[b]
+                && !placed[to] && !falls[to - 1]) {
+                dropped[last[b]] = TRUE;
+                changes++;
+                b = to;
+            } else {
+                b = -1;
+            }
+        }
+    }
+
+    if (changes > 0) {
+        OzLine *lines = checked_malloc(p->size * sizeof(OzLine));
+        int n = 0;
+        for (b = 0; b < norder; b++) {
+            for (i = starts[order[b]]; i < starts[order[b] + 1]; i++) {
+                if (!dropped[i]) {
+                    lines[n++] = p->lines[i];
+                }
+            }
+        }
+        free(p->lines);
+        p->lines = lines;
+        p->nlines = n;
+    }
+
+    free(labels);
+    free(starts);
+    free(block_of);
+    free(last);
+    free(region);
+    free(falls);
+    free(placed);
+    free(order);
+    free(dropped);
+    return changes;
+}
+
+// Removes the code no path from the start of the program or of a proc
+// reaches. Comments go too, unless the code after them is reached.
+int drop_unreachable(OzProgram *p) {
+    int nlabels;
+    int *labels = find_labels(p, &nlabels);
+    BOOL *reached = checked_malloc(p->nlines * sizeof(BOOL));
+    int *todo = checked_malloc((p->nlines + 1) * sizeof(int));
+    int ntodo = 0;
+    int i;
+    for (i = 0; i < p->nlines; i++) {
+        reached[i] = FALSE;
+        if (i == 0 || p->lines[i].kind == OZ_PROC) {
+            todo[ntodo++] = i;
+        }
+    }
+
+    // each line reached leads to the next, unless it ends the flow, and
+    // to the label it branches to
+    while (ntodo > 0) {
+        for (i = todo[--ntodo]; i < p->nlines && !reached[i]; i++) {
+            OzLine *line = &p->lines[i];
+            reached[i] = TRUE;
+            int label = branch_target(line);
+            if (label >= 0 && !reached[labels[label]]) {
+                todo[ntodo++] = labels[label];
+            }
+            if (ends_flow(line)) {
+                break;
+            }
+        }
+    }
+
+    BOOL *dropped = no_lines_dropped(p);
+    int changes = 0;
+    BOOL next_reached = FALSE;
+    for (i = p->nlines - 1; i >= 0; i--) {
+        if (p->lines[i].kind == OZ_COMMENT) {
+            dropped[i] = !next_reached;
+        } else if (!reached[i]) {
+            dropped[i] = TRUE;
+            next_reached = FALSE;
+            changes++;
+        } else {
+            next_reached = TRUE;
+        }
+    }
+    drop_oz_lines(p, dropped);
+    free(dropped);
+    free(reached);
+    free(todo);
+    free(labels);
+    return changes;
+}
+
+int drop_unused_labels(OzProgram *p) {
+    int nlabels;
+    int *labels = find_labels(p, &nlabels);
+    BOOL *used = checked_malloc((nlabels + 1) * sizeof(BOOL));
+    int i;
+    for (i = 0; i <= nlabels; i++) {
+        used[i] = FALSE;
+    }
+    for (i = 0; i < p->nlines; i++) {
+        int label = branch_target(&p->lines[i]);
+        if (label >= 0) {
+            used[label] = TRUE;
+        }
+    }
+
+    BOOL *dropped = no_lines_dropped(p);
+    int changes = 0;
+    for (i = 0; i < p->nlines; i++) {
+        if (p->lines[i].kind == OZ_LABEL && !used[p->lines[i].arg1]) {
+            dropped[i] = TRUE;
+            changes++;
+        }
+    }
+    drop_oz_lines(p, dropped);
+    free(dropped);
+    free(used);
+    free(labels);
+    return changes;
+}
+
+/*----------------------------------------------------------------------
+    Helpers
+-----------------------------------------------------------------------*/
+
+// The line of each label, by number, and one more than the highest label
+int *find_labels(OzProgram *p, int *nlabels) {
+    int i;
+    *nlabels = 0;
+    for (i = 0; i < p->nlines; i++) {
+        if (p->lines[i].kind == OZ_LABEL) {
+            *nlabels = max(*nlabels, p->lines[i].arg1 + 1);
+        }
+    }
+    int *labels = checked_malloc((*nlabels + 1) * sizeof(int));
+    for (i = 0; i < *nlabels; i++) {
+        labels[i] = p->nlines;
+    }
+    for (i = 0; i < p->nlines; i++) {
+        if (p->lines[i].kind == OZ_LABEL) {
+            labels[p->lines[i].arg1] = i;
+        }
+    }
+    return labels;
+}
+
+// The first line of each block, followed by p->nlines
+int *find_blocks(OzProgram *p, int *nblocks) {
+    int *starts = checked_malloc((p->nlines + 1) * sizeof(int));
+    int i, n = 0;
+    BOOL after_branch = TRUE;
+    for (i = 0; i < p->nlines; i++) {
+        OzLine *line = &p->lines[i];
+        BOOL labels = line->kind == OZ_LABEL
+                      && (i == 0 || p->lines[i - 1].kind != OZ_LABEL);
+        if (after_branch || labels || line->kind == OZ_PROC) {
+            // the comments just before a proc or labels go with them
+            int from = i;
+            while (!after_branch && from > 0
+                   && p->lines[from - 1].kind == OZ_COMMENT) {
+                from--;
+            }
+            if (n == 0 || from > starts[n - 1]) {
+                starts[n++] = from;
+            }
+        }
+        after_branch = line->kind == OZ_OP
+                       && (branch_target(line) >= 0 || ends_flow(line));
+    }
+    starts[n] = p->nlines;
+    *nblocks = n;
+    return starts;
+}
+
+// The first line from i that is neither a comment nor a label
+int next_code(OzProgram *p, int i) {
+    while (i < p->nlines && (p->lines[i].kind == OZ_COMMENT
+                             || p->lines[i].kind == OZ_LABEL)) {
+        i++;
+    }
+    return i;
+}
+
+// Whether there are only comments and labels from line from to line to
+BOOL reaches_without_code(OzProgram *p, int from, int to) {
+    return to >= from && to < p->nlines && next_code(p, from) >= to;
+}
+
+// The label a branch goes to, or -1 for any other line
+int branch_target(OzLine *l) {
+    if (l->kind != OZ_OP) {
+        return -1;
+    }
+    switch (l->code) {
+        case OP_BRANCH_UNCOND:
+            return l->arg1;
+
+        case OP_BRANCH_ON_TRUE:
+        case OP_BRANCH_ON_FALSE:
+            return l->arg2;
+
+        default:
+            return -1;
+    }
+}
+
+void set_branch_target(OzLine *l, int label) {
+    if (l->code == OP_BRANCH_UNCOND) {
+        l->arg1 = label;
+    } else {
+        l->arg2 = label;
+    }
+}
+
+// Whether the line after a line never runs straight after it
+BOOL ends_flow(OzLine *l) {
+    return is_oz_op(l, OP_BRANCH_UNCOND) || is_oz_op(l, OP_BRANCH_PROC)
+           || is_oz_op(l, OP_RETURN) || is_oz_op(l, OP_HALT);
+}
+
+BOOL *no_lines_dropped(OzProgram *p) {
+    BOOL *dropped = checked_malloc((p->nlines + 1) * sizeof(BOOL));
+    memset(dropped, 0, (p->nlines + 1) * sizeof(BOOL));
+    return dropped;
+}
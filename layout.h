@@ -0,0 +1,22 @@
+/* layout.h */
+
+/*-----------------------------------------------------------------------
+    Developed by: #undef TEAMNAME
+    Provides function definitions and external access rights for
+    layout.c
+-----------------------------------------------------------------------*/
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include "ast.h"
+#include "oztree.h"
+
+/*----------------------------------------------------------------------
+    External Functions that will be accessed by other C files.
+-----------------------------------------------------------------------*/
+// Threads jumps, removes unreachable code and unused labels, and orders
+// each proc's blocks so that jumps become fall throughs. Returns the
+// number of changes made.
+int layout_program(OzProgram *p);
+
+#endif
@@ -0,0 +1,371 @@
+/* licm.c */
+
+/*-----------------------------------------------------------------------
+    Developed by: #undef TEAMNAME
+    Loop invariant code motion for while loops, run after semantic
+    analysis.
+
+    An expression in a loop is invariant when the loop writes none of the
+    names it reads. Invariant expressions (and the addresses of array
+    elements whose indices are invariant, which includes their offset
+    calculation and bounds checks) are computed once into temporaries in
+    a preheader just before the loop, and the loop reads the temporaries.
+
+    Hoisting must not introduce faults. Expressions that cannot fault are
+    always hoisted. Those that may fault (division, array access) are only
+    hoisted when the loop would evaluate them on its first iteration before
+    doing any input or output, and are guarded in the preheader by the
+    loop condition, so they are only evaluated when the loop is entered.
+-----------------------------------------------------------------------*/
+#include <stdlib.h>
+#include "licm.h"
+#include "effects.h"
+#include "array_access.h"
+#include "helper.h"
+
+/*----------------------------------------------------------------------
+    Internal structures.
+-----------------------------------------------------------------------*/
+
+// An expression already hoisted out of the current loop
+typedef struct hoisted {
+    BOOL            is_address;
+    Expr            *key;       /* as computed in the preheader */
+    symbol          *temp;
+    struct hoisted  *next;
+} Hoisted;
+
+// The loop being optimised
+typedef struct {
+    sym_table       *prog;
+    scope           *scope;
+    Names           *writes;    /* names the loop may change */
+    BOOL            guaranteed; /* evaluated on entry, before any i/o */
+    BOOL            faulted;    /* something left in the loop may fault */
+    Hoisted         *hoisted;
+    Stmts           *safe;      /* preheader code that cannot fault */
+    Stmts           *guarded;   /* preheader code that may fault */
+    int             lineno;
+} Loop;
+
+/*----------------------------------------------------------------------
+    Internal function definitions.
+-----------------------------------------------------------------------*/
+void licm_statements(Stmts *stmts, sym_table *prog, scope *s);
+Stmts *licm_loop(Stmts *node, sym_table *prog, scope *s);
+
+void hoist_statements(Stmts *stmts, Loop *loop);
+void hoist_statement(Stmt *stmt, Loop *loop);
+void hoist_expr(Expr *e, Loop *loop);
+void hoist_cond(Expr *e, Loop *loop);
+void hoist_indices(Exprs *indices, Loop *loop);
+void hoist_lvalue(Expr *lvalue, Loop *loop);
+void hoist(Expr *e, BOOL is_address, Loop *loop);
+
+BOOL may_hoist_fault(Loop *loop);
+BOOL is_invariant(Expr *e, Loop *loop);
+
+/*----------------------------------------------------------------------
+    Function implementations
+-----------------------------------------------------------------------*/
+
+void hoist_loop_invariants(Program *prog, sym_table *table) {
+    Procs *procs = prog->procedures;
+    while (procs != NULL) {
+        Proc *proc = procs->first;
+        scope *s = find_scope(proc->header->id, table);
+        licm_statements(proc->body->statements, table, s);
+        procs = procs->rest;
+    }
+}
+
+// Optimises every loop in a list of statements, innermost loops first, so
+// what is hoisted out of an inner loop may then be hoisted out of the
+// loops around it
+void licm_statements(Stmts *stmts, sym_table *prog, scope *s) {
+    while (stmts != NULL) {
+        Stmt *stmt = stmts->first;
+        switch (stmt->kind) {
+            case STMT_COND:
+                licm_statements(stmt->info.cond.then_branch, prog, s);
+                licm_statements(stmt->info.cond.else_branch, prog, s);
+                break;
+
+            case STMT_WHILE:
+                licm_statements(stmt->info.loop.body, prog, s);
+                stmts = licm_loop(stmts, prog, s);
+                break;
+
+            default:
+                break;
+        }
+        stmts = stmts->rest;
+    }
+}
+
+// Hoists what it can out of the loop held in node, inserting the preheader
+// before it. Returns the list node now holding the loop.
+Stmts *licm_loop(Stmts *node, sym_table *prog, scope *s) {
+    While *w = &(node->first->info.loop);
+    Loop loop;
+    loop.prog = prog;
+    loop.scope = s;
+    loop.writes = stmts_writes(w->body, prog, s, NULL);
+    loop.hoisted = NULL;
+    loop.safe = NULL;
+    loop.guarded = NULL;
+    loop.lineno = node->first->lineno;
+
+    // the guard is the condition as written, before anything is hoisted
+    Expr *guard = copy_expr(w->cond);
+
+    // the condition is always evaluated on entry, and the body is then
+    // evaluated up to its first input or output
+    loop.guaranteed = TRUE;
+    loop.faulted = FALSE;
+    hoist_cond(w->cond, &loop);
+    hoist_statements(w->body, &loop);
+
+    Stmts *pre = loop.safe;
+    if (loop.guarded != NULL) {
+        Stmt *cond = new_stmt(STMT_COND, loop.lineno);
+        cond->info.cond.cond = guard;
+        cond->info.cond.then_branch = loop.guarded;
+        cond->info.cond.else_branch = NULL;
+        pre = append_stmt(pre, cond);
+    }
+    if (pre == NULL) {
+        return node;
+    }
+
+    // splice the preheader in before the loop
+    Stmts *moved = new_stmts_node(node->first, node->rest);
+    Stmts *last = pre;
+    while (last->rest != NULL) {
+        last = last->rest;
+    }
+    last->rest = moved;
+    node->first = pre->first;
+    node->rest = pre->rest;
+    return moved;
+}
+
+/*----------------------------------------------------------------------
+    Finding invariant expressions in a loop
+-----------------------------------------------------------------------*/
+
+void hoist_statements(Stmts *stmts, Loop *loop) {
+    while (stmts != NULL) {
+        hoist_statement(stmts->first, loop);
+        stmts = stmts->rest;
+    }
+}
+
+void hoist_statement(Stmt *stmt, Loop *loop) {
+    SInfo *info = &(stmt->info);
+    Exprs *args;
+    Params *params;
+
+    switch (stmt->kind) {
+        case STMT_ASSIGN:
+            hoist_expr(info->assign.asg_expr, loop);
+            hoist_lvalue(info->assign.asg_ident, loop);
+            break;
+
+        case STMT_BIND:
+            hoist_indices(info->assign.asg_expr->indices, loop);
+            loop->faulted = TRUE;
+            break;
+
+        case STMT_ADVANCE:
+            break;
+
+        case STMT_READ:
+            hoist_lvalue(info->read, loop);
+            loop->guaranteed = FALSE;
+            break;
+
+        case STMT_WRITE:
+            hoist_expr(info->write, loop);
+            loop->guaranteed = FALSE;
+            break;
+
+        case STMT_FUNC:
+            params = find_scope(info->func->id, loop->prog)->params;
+            args = info->func->args;
+            while (args != NULL) {
+                if (params->first->ind == REF_IND) {
+                    hoist_lvalue(args->first, loop);
+                } else {
+                    hoist_expr(args->first, loop);
+                }
+                args = args->rest;
+                params = params->rest;
+            }
+            loop->guaranteed = FALSE;
+            break;
+
+        case STMT_COND:
+            // only the condition is sure to be evaluated
+            hoist_cond(info->cond.cond, loop);
+            loop->guaranteed = FALSE;
+            hoist_statements(info->cond.then_branch, loop);
+            hoist_statements(info->cond.else_branch, loop);
+            break;
+
+        case STMT_WHILE:
+            hoist_cond(info->loop.cond, loop);
+            loop->guaranteed = FALSE;
+            hoist_statements(info->loop.body, loop);
+            break;
+    }
+}
+
+// Hoists the largest invariant parts of an expression that are worth a
+// temporary
+void hoist_expr(Expr *e, Loop *loop) {
+    switch (e->kind) {
+        case EXPR_ID:
+        case EXPR_CONST:
+            break;
+
+        case EXPR_BINOP:
+        case EXPR_UNOP:
+            if (is_invariant(e, loop)
+                && (may_hoist_fault(loop) || !can_fault(e))) {
+                hoist(e, FALSE, loop);
+                break;
+            }
+            hoist_expr(e->e1, loop);
+            if (e->kind == EXPR_BINOP) {
+                hoist_expr(e->e2, loop);
+            }
+            if (op_can_fault(e)) {
+                loop->faulted = TRUE;
+            }
+            break;
+
+        case EXPR_ARRAY:
+            if (is_static_access(e)) {
+                loop->faulted = TRUE;
+                break;
+            }
+            // an invariant element, or else an invariant address whose
+            // contents may change in the loop (both may be out of bounds)
+            if (may_hoist_fault(loop) && is_invariant(e, loop)) {
+                hoist(e, FALSE, loop);
+            } else {
+                hoist_lvalue(e, loop);
+            }
+            break;
+    }
+}
+
+// Hoists from a condition that only feeds a branch, where the right operand
+// of and/or is only evaluated if it decides the outcome. Such a condition
+// may only be hoisted whole if evaluating all of it cannot fault.
+void hoist_cond(Expr *e, Loop *loop) {
+    BOOL guaranteed;
+
+    if (!is_jump_cond(e)) {
+        hoist_expr(e, loop);
+        return;
+    }
+    if (is_invariant(e, loop) && !can_fault(e)) {
+        hoist(e, FALSE, loop);
+        return;
+    }
+
+    hoist_cond(e->e1, loop);
+    if (e->kind == EXPR_BINOP) {
+        guaranteed = loop->guaranteed;
+        loop->guaranteed = FALSE;
+        hoist_cond(e->e2, loop);
+        loop->guaranteed = guaranteed;
+    }
+}
+
+// The address of an array element only depends on its indices
+void hoist_lvalue(Expr *lvalue, Loop *loop) {
+    if (lvalue->kind != EXPR_ARRAY) {
+        return;
+    }
+    if (is_static_access(lvalue)) {
+        loop->faulted = TRUE;
+        return;
+    }
+
+    Names *reads = exprs_reads(lvalue->indices, loop->scope, NULL);
+    if (may_hoist_fault(loop) && !names_intersect(reads, loop->writes)) {
+        hoist(lvalue, TRUE, loop);
+    } else {
+        hoist_indices(lvalue->indices, loop);
+        loop->faulted = TRUE;
+    }
+}
+
+void hoist_indices(Exprs *indices, Loop *loop) {
+    while (indices != NULL) {
+        Expr *index = indices->first;
+        if (is_offset_index(index)) {
+            hoist_expr(index->e1, loop);
+            hoist_expr(index->e2, loop);
+        } else {
+            hoist_expr(index, loop);
+        }
+        indices = indices->rest;
+    }
+}
+
+// Computes an expression (or an array element's address) into a temporary
+// in the preheader, reusing one if the same expression was already hoisted,
+// and rewrites the expression to read it
+void hoist(Expr *e, BOOL is_address, Loop *loop) {
+    Hoisted *h = loop->hoisted;
+    while (h != NULL) {
+        if (h->is_address == is_address && exprs_equal(h->key, e)) {
+            make_id_expr(e, get_symbol_id(h->temp));
+            return;
+        }
+        h = h->next;
+    }
+
+    Type t = e->inferred_type;
+    symbol *temp = create_temp_symbol(loop->prog, loop->scope, t, is_address);
+    if (is_address) {
+        temp->target = e->id;
+    }
+
+    Stmt *def = new_stmt(is_address ? STMT_BIND : STMT_ASSIGN, loop->lineno);
+    def->info.assign.asg_ident = new_id_expr(get_symbol_id(temp), t,
+                                             loop->lineno);
+    def->info.assign.asg_expr = copy_expr(e);
+    if (is_address || can_fault(e)) {
+        loop->guarded = append_stmt(loop->guarded, def);
+    } else {
+        loop->safe = append_stmt(loop->safe, def);
+    }
+
+    h = (Hoisted *) checked_malloc(sizeof(Hoisted));
+    h->is_address = is_address;
+    h->key = def->info.assign.asg_expr;
+    h->temp = temp;
+    h->next = loop->hoisted;
+    loop->hoisted = h;
+
+    make_id_expr(e, get_symbol_id(temp));
+}
+
+/*----------------------------------------------------------------------
+    Helper functions
+-----------------------------------------------------------------------*/
+
+// Code that may fault can only move to the preheader if it was going to
+// run anyway, and before anything left in the loop could fault first
+BOOL may_hoist_fault(Loop *loop) {
+    return loop->guaranteed && !loop->faulted;
+}
+
+BOOL is_invariant(Expr *e, Loop *loop) {
+    return !names_intersect(expr_reads(e, loop->scope, NULL), loop->writes);
+}
@@ -0,0 +1,18 @@
+/* licm.h */
+
+/*-----------------------------------------------------------------------
+    Developed by: #undef TEAMNAME
+    Provides function definitions and external access rights for
+    licm.c
+-----------------------------------------------------------------------*/
+#include "ast.h"
+#include "symbol.h"
+
+/*----------------------------------------------------------------------
+    External Functions that will be accessed by other C files.
+-----------------------------------------------------------------------*/
+// Moves computations that do not change between iterations of a while
+// loop into compiler temporaries assigned just before the loop. Must run
+// after analysis, as it relies on inferred types and adds temporaries to
+// the symbol table.
+void hoist_loop_invariants(Program *prog, sym_table *table);
@@ -0,0 +1,64 @@
+/* oz_bench.c */
+
+/*-----------------------------------------------------------------------
+    Developed by: #undef TEAMNAME
+    Times the generation of a large Oz program, as a stream of the
+    instructions codegen emits most (constants, arithmetic, stores and
+    labels), and reports the peak memory used while holding it. Then
+    times writing it out as text, to the given file or /dev/null.
+
+    Usage: oz_bench [number of lines [output file]]
+-----------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "ast.h"
+#include "oztree.h"
+#include "emit.h"
+
+#define DEFAULT_LINES 10000000
+
+int main(int argc, char **argv) {
+    long nlines = DEFAULT_LINES;
+    char *out = "/dev/null";
+    if (argc >= 2) {
+        nlines = atol(argv[1]);
+    }
+    if (argc >= 3) {
+        out = argv[2];
+    }
+
+    OzProgram *p = new_oz_program();
+    clock_t start = clock();
+    long i;
+    for (i = 0; i < nlines; i += 4) {
+        gen_int_const(p, 1, (int) i);
+        gen_triop(p, OP_ADD_INT, 0, 0, 1);
+        gen_binop(p, OP_STORE, 3, 0);
+        gen_label(p, (int) i);
+    }
+    double secs = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    long peak_kb = usage.ru_maxrss;
+
+    printf("%ld lines in %.3fs: %.1f M lines/s\n", (long) p->nlines, secs,
+           p->nlines / secs / 1e6);
+    printf("peak memory %ld MB, %.1f bytes per line\n", peak_kb / 1024,
+           peak_kb * 1024.0 / p->nlines);
+
+    FILE *fp = fopen(out, "w");
+    if (fp == NULL) {
+        perror(out);
+        return 1;
+    }
+    start = clock();
+    write_oz_text(fp, p);
+    fclose(fp);
+    secs = (double) (clock() - start) / CLOCKS_PER_SEC;
+    printf("written in %.3fs: %.1f M lines/s\n", secs,
+           p->nlines / secs / 1e6);
+    return 0;
+}
@@ -0,0 +1,41 @@
+/* oz_text.c */
+
+/*-----------------------------------------------------------------------
+    Developed by: #undef TEAMNAME
+    Converts a program in the binary Oz format (as written by wiz -b)
+    back into Oz assembly text, exactly as wiz would have written it.
+
+    Usage: oz_text [binary file]
+    Reads standard input if no file is given, and writes to standard
+    output.
+-----------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include "ast.h"
+#include "oztree.h"
+#include "ozbin.h"
+#include "emit.h"
+
+int main(int argc, char **argv) {
+    FILE *in = stdin;
+    if (argc > 2) {
+        fprintf(stderr, "usage: %s [binary file]\n", argv[0]);
+        return 1;
+    }
+    if (argc == 2) {
+        in = fopen(argv[1], "rb");
+        if (in == NULL) {
+            perror(argv[1]);
+            return 1;
+        }
+    }
+
+    OzProgram *p = read_oz_binary(in);
+    if (p == NULL) {
+        fprintf(stderr, "%s: not a binary Oz program\n",
+                argc == 2 ? argv[1] : "stdin");
+        return 1;
+    }
+    write_oz_text(stdout, p);
+    return 0;
+}
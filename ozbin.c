@@ -0,0 +1,465 @@
+/* ozbin.c */
+
+/*-----------------------------------------------------------------------
+    Developed by: #undef TEAMNAME
+    A compact binary form of Oz programs, for programs too large to be
+    worth writing and parsing as text. oz_text turns it back into the
+    exact text wiz writes without -b.
+
+    The format is, in order:
+
+    - the magic bytes "OZB" and a version byte (1)
+    - the strings: their count, then each one's length and bytes. These
+      are the proc names, string constants and builtin names the lines
+      refer to, each kept once.
+    - the procs: their count, then each one's name (as a string index)
+      and the index of the line that starts it
+    - the lines: their count, then each line as a byte and its operands:
+      - an op is its op code (below 0x80), followed by its args in the
+        order emit.c writes them
+      - a label is 0x80 and its number
+      - a proc is 0x81 and its name
+      - a builtin call is 0x82 and its name
+      - a comment is 0x83 and its section
+
+    Every number is a varint: 7 bits at a time, least significant first,
+    with the top bit set on all bytes but the last. Registers, labels,
+    sections and string indexes are unsigned. Ints (slots, frame sizes and
+    constants) are zigzag encoded first, so that small negative ints stay
+    short. A real constant is its 4 bytes, least significant first.
+-----------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ozbin.h"
+#include "emit.h"
+#include "helper.h"
+#include "error_printer.h"
+
+#define MAGIC "OZB\1"
+#define MAGIC_LENGTH 4
+
+// The first byte of each line that is not an op
+#define LINE_LABEL 0x80
+#define LINE_PROC 0x81
+#define LINE_BUILTIN 0x82
+#define LINE_COMMENT 0x83
+
+#define NUM_BUILTINS (BUILTIN_PRINT_STRING + 1)
+#define NUM_SECTIONS (SECTION_EPILOGUE + 1)
+
+// Bytes read from the file at a time
+#define READ_CHUNK (1 << 16)
+
+/*----------------------------------------------------------------------
+    Internal structures.
+-----------------------------------------------------------------------*/
+
+// The strings written, each once, and where each of the program's
+// strings (and each builtin's name) ended up among them
+typedef struct {
+    char    **strings;
+    int     nstrings;
+    int     *slots;         /* hash table of indexes into strings, or -1 */
+    int     nslots;
+    int     *index;         /* by the program's string id */
+    int     builtin[NUM_BUILTINS];
+} Strings;
+
+// A binary program being read, and how far through it the reader is
+typedef struct {
+    unsigned char   *bytes;
+    long            size;
+    long            at;
+    BOOL            bad;
+} Reader;
+
+/*----------------------------------------------------------------------
+    Internal function definitions.
+-----------------------------------------------------------------------*/
+void collect_strings(Strings *s, OzProgram *p);
+int distinct_string(Strings *s, char *string);
+unsigned string_hash(char *string);
+void write_varint(FILE *fp, unsigned value);
+void write_int(FILE *fp, int value);
+void write_real(FILE *fp, float value);
+
+BOOL read_lines(Reader *r, OzProgram *p, char **strings, int nstrings);
+BOOL read_op(Reader *r, OzProgram *p, int code, int nstrings);
+unsigned read_varint(Reader *r);
+int read_int(Reader *r);
+float read_real(Reader *r);
+int read_count(Reader *r, long limit);
+BOOL read_file(FILE *fp, Reader *r);
+
+/*----------------------------------------------------------------------
+    Function implementations
+-----------------------------------------------------------------------*/
+
+void write_oz_binary(FILE *fp, OzProgram *p) {
+    Strings s;
+    int i, j, nprocs = 0;
+
+    collect_strings(&s, p);
+    fwrite(MAGIC, 1, MAGIC_LENGTH, fp);
+    write_varint(fp, s.nstrings);
+    for (i = 0; i < s.nstrings; i++) {
+        int length = strlen(s.strings[i]);
+        write_varint(fp, length);
+        fwrite(s.strings[i], 1, length, fp);
+    }
+
+    for (i = 0; i < p->nlines; i++) {
+        if (p->lines[i].kind == OZ_PROC) {
+            nprocs++;
+        }
+    }
+    write_varint(fp, nprocs);
+    for (i = 0; i < p->nlines; i++) {
+        if (p->lines[i].kind == OZ_PROC) {
+            write_varint(fp, s.index[p->lines[i].arg1]);
+            write_varint(fp, i);
+        }
+    }
+
+    write_varint(fp, p->nlines);
+    for (i = 0; i < p->nlines; i++) {
+        OzLine *line = &(p->lines[i]);
+        switch (line->kind) {
+            case OZ_LABEL:
+                putc(LINE_LABEL, fp);
+                write_varint(fp, line->arg1);
+                break;
+
+            case OZ_PROC:
+                putc(LINE_PROC, fp);
+                write_varint(fp, s.index[line->arg1]);
+                break;
+
+            case OZ_BUILTIN:
+                putc(LINE_BUILTIN, fp);
+                write_varint(fp, s.builtin[line->arg1]);
+                break;
+
+            case OZ_COMMENT:
+                putc(LINE_COMMENT, fp);
+                write_varint(fp, line->arg1);
+                break;
+
+            case OZ_OP: {
+                const char *operands = oz_operands(line->code);
+                int args[3];
+                if (operands == NULL) {
+                    report_error_and_exit("operation not yet implemented!");
+                }
+                args[0] = line->arg1;
+                args[1] = line->arg2;
+                args[2] = line->arg3;
+                putc(line->code, fp);
+                for (j = 0; operands[j] != '\0'; j++) {
+                    switch (operands[j]) {
+                        case 'i':
+                            write_int(fp, args[j]);
+                            break;
+
+                        case 'f':
+                            write_real(fp, line->real);
+                            break;
+
+                        case 'p':
+                        case 's':
+                            write_varint(fp, s.index[args[j]]);
+                            break;
+
+                        default:
+                            write_varint(fp, args[j]);
+                            break;
+                    }
+                }
+                break;
+            }
+        }
+    }
+    fflush(fp);
+
+    free(s.strings);
+    free(s.slots);
+    free(s.index);
+}
+
+OzProgram *read_oz_binary(FILE *fp) {
+    Reader r;
+    int i, nstrings, nprocs;
+    if (!read_file(fp, &r)) {
+        return NULL;
+    }
+
+    if (r.size < MAGIC_LENGTH
+        || memcmp(r.bytes, MAGIC, MAGIC_LENGTH) != 0) {
+        free(r.bytes);
+        return NULL;
+    }
+    r.at = MAGIC_LENGTH;
+    OzProgram *p = new_oz_program();
+
+    // every string takes at least a byte, so the count is at most the size
+    nstrings = read_count(&r, r.size);
+    char **strings = checked_malloc((nstrings + 1) * sizeof(char *));
+    for (i = 0; i < nstrings && !r.bad; i++) {
+        int length = read_count(&r, r.size - r.at);
+        strings[i] = checked_malloc(length + 1);
+        if (!r.bad) {
+            memcpy(strings[i], r.bytes + r.at, length);
+            r.at += length;
+        }
+        strings[i][length] = '\0';
+    }
+
+    // the procs are only checked against the lines they point to
+    nprocs = read_count(&r, r.size);
+    int *procs = checked_malloc((2 * nprocs + 1) * sizeof(int));
+    for (i = 0; i < nprocs && !r.bad; i++) {
+        procs[2 * i] = read_count(&r, nstrings - 1);
+        procs[2 * i + 1] = read_count(&r, r.size);
+    }
+
+    BOOL ok = !r.bad && read_lines(&r, p, strings, nstrings);
+    for (i = 0; ok && i < nprocs; i++) {
+        int name = procs[2 * i], line = procs[2 * i + 1];
+        ok = line < p->nlines && p->lines[line].kind == OZ_PROC
+             && streq(oz_string(p, p->lines[line].arg1), strings[name]);
+    }
+    ok = ok && r.at == r.size;
+
+    free(procs);
+    free(strings);
+    free(r.bytes);
+    return ok ? p : NULL;
+}
+
+/*----------------------------------------------------------------------
+    Writing
+-----------------------------------------------------------------------*/
+
+// Gathers the distinct strings of a program, and the builtins' names
+void collect_strings(Strings *s, OzProgram *p) {
+    int i;
+    s->nslots = 16;
+    while (s->nslots < 2 * (p->nstrings + NUM_BUILTINS)) {
+        s->nslots *= 2;
+    }
+    s->slots = checked_malloc(s->nslots * sizeof(int));
+    for (i = 0; i < s->nslots; i++) {
+        s->slots[i] = -1;
+    }
+    s->strings = checked_malloc((p->nstrings + NUM_BUILTINS) *
+                                sizeof(char *));
+    s->nstrings = 0;
+    s->index = checked_malloc((p->nstrings + 1) * sizeof(int));
+
+    for (i = 0; i < p->nstrings; i++) {
+        s->index[i] = distinct_string(s, oz_string(p, i));
+    }
+    for (i = 0; i < NUM_BUILTINS; i++) {
+        s->builtin[i] = distinct_string(s, (char *) builtinnames[i]);
+    }
+}
+
+// The index of a string among those written, adding it if it is new
+int distinct_string(Strings *s, char *string) {
+    int slot = string_hash(string) & (s->nslots - 1);
+    while (s->slots[slot] >= 0) {
+        if (streq(s->strings[s->slots[slot]], string)) {
+            return s->slots[slot];
+        }
+        slot = (slot + 1) & (s->nslots - 1);
+    }
+    s->slots[slot] = s->nstrings;
+    s->strings[s->nstrings] = string;
+    return s->nstrings++;
+}
+
+unsigned string_hash(char *string) {
+    unsigned hash = 5381;
+    while (*string != '\0') {
+        hash = hash * 33 + (unsigned char) *string++;
+    }
+    return hash;
+}
+
+void write_varint(FILE *fp, unsigned value) {
+    while (value >= 0x80) {
+        putc((value & 0x7f) | 0x80, fp);
+        value >>= 7;
+    }
+    putc(value, fp);
+}
+
+// Zigzag encodes an int (0, -1, 1, -2, ... as 0, 1, 2, 3, ...)
+void write_int(FILE *fp, int value) {
+    unsigned bits = (unsigned) value;
+    write_varint(fp, value < 0 ? ~(bits << 1) : bits << 1);
+}
+
+void write_real(FILE *fp, float value) {
+    unsigned bits;
+    int i;
+    memcpy(&bits, &value, sizeof(bits));
+    for (i = 0; i < 4; i++) {
+        putc((bits >> (8 * i)) & 0xff, fp);
+    }
+}
+
+/*----------------------------------------------------------------------
+    Reading. A read past the end of the bytes, or of a value out of
+    range, marks the reader bad rather than stopping at once.
+-----------------------------------------------------------------------*/
+
+BOOL read_lines(Reader *r, OzProgram *p, char **strings, int nstrings) {
+    int i, j, nlines = read_count(r, r->size);
+    for (i = 0; i < nstrings; i++) {
+        add_string(p, strings[i]);
+    }
+
+    for (i = 0; i < nlines && !r->bad; i++) {
+        int kind = r->at < r->size ? r->bytes[r->at++] : -1;
+        int value;
+        switch (kind) {
+            case LINE_LABEL:
+                new_line(p, OZ_LABEL)->arg1 = read_varint(r);
+                break;
+
+            case LINE_PROC:
+                new_line(p, OZ_PROC)->arg1 = read_count(r, nstrings - 1);
+                break;
+
+            case LINE_BUILTIN:
+                value = read_count(r, nstrings - 1);
+                for (j = 0; !r->bad && j < NUM_BUILTINS; j++) {
+                    if (streq(strings[value], builtinnames[j])) {
+                        break;
+                    }
+                }
+                r->bad = r->bad || j == NUM_BUILTINS;
+                new_line(p, OZ_BUILTIN)->arg1 = j;
+                break;
+
+            case LINE_COMMENT:
+                new_line(p, OZ_COMMENT)->arg1 =
+                    read_count(r, NUM_SECTIONS - 1);
+                break;
+
+            default:
+                r->bad = r->bad || kind < 0
+                         || !read_op(r, p, kind, nstrings);
+                break;
+        }
+    }
+    return !r->bad;
+}
+
+BOOL read_op(Reader *r, OzProgram *p, int code, int nstrings) {
+    const char *operands = oz_operands(code);
+    int args[3] = { 0, 0, 0 };
+    int j;
+    if (operands == NULL) {
+        return FALSE;
+    }
+
+    OzLine *op = new_line(p, OZ_OP);
+    op->code = code;
+    for (j = 0; operands[j] != '\0'; j++) {
+        switch (operands[j]) {
+            case 'i':
+                args[j] = read_int(r);
+                break;
+
+            case 'f':
+                op->real = read_real(r);
+                break;
+
+            case 'p':
+            case 's':
+                args[j] = read_count(r, nstrings - 1);
+                break;
+
+            default:
+                args[j] = read_count(r, (int) (~0u >> 1));
+                break;
+        }
+    }
+    op->arg1 = args[0];
+    op->arg2 = args[1];
+    op->arg3 = args[2];
+    return !r->bad;
+}
+
+unsigned read_varint(Reader *r) {
+    unsigned value = 0;
+    int shift;
+    for (shift = 0; shift < 35; shift += 7) {
+        if (r->at >= r->size) {
+            break;
+        }
+        unsigned char byte = r->bytes[r->at++];
+        value |= (unsigned) (byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+    r->bad = TRUE;
+    return 0;
+}
+
+int read_int(Reader *r) {
+    unsigned bits = read_varint(r);
+    return (bits & 1) ? (int) ~(bits >> 1) : (int) (bits >> 1);
+}
+
+float read_real(Reader *r) {
+    unsigned bits = 0;
+    float value;
+    int i;
+    if (r->at + 4 > r->size) {
+        r->bad = TRUE;
+        return 0.0f;
+    }
+    for (i = 0; i < 4; i++) {
+        bits |= (unsigned) r->bytes[r->at++] << (8 * i);
+    }
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Reads a count or index, which must be at most limit
+int read_count(Reader *r, long limit) {
+    unsigned value = read_varint(r);
+    if (limit < 0 || value > (unsigned long) limit) {
+        r->bad = TRUE;
+        return 0;
+    }
+    return (int) value;
+}
+
+// Reads the whole of fp into memory
+BOOL read_file(FILE *fp, Reader *r) {
+    long capacity = READ_CHUNK;
+    size_t got;
+    r->bytes = checked_malloc(capacity);
+    r->size = 0;
+    r->at = 0;
+    r->bad = FALSE;
+    while ((got = fread(r->bytes + r->size, 1, capacity - r->size, fp))
+           > 0) {
+        r->size += got;
+        if (r->size == capacity) {
+            capacity *= 2;
+            r->bytes = checked_realloc(r->bytes, capacity);
+        }
+    }
+    if (ferror(fp)) {
+        free(r->bytes);
+        return FALSE;
+    }
+    return TRUE;
+}
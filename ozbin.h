@@ -0,0 +1,25 @@
+/* ozbin.h */
+
+/*-----------------------------------------------------------------------
+    Developed by: #undef TEAMNAME
+    Provides function definitions and external access rights for
+    ozbin.c
+-----------------------------------------------------------------------*/
+#ifndef OZBIN_H
+#define OZBIN_H
+
+#include <stdio.h>
+#include "ast.h"
+#include "oztree.h"
+
+/*----------------------------------------------------------------------
+    External Functions that will be accessed by other C files.
+-----------------------------------------------------------------------*/
+// Writes a program to fp in the binary Oz format
+void write_oz_binary(FILE *fp, OzProgram *p);
+
+// Reads a program in the binary Oz format from fp, or returns NULL if fp
+// does not hold one
+OzProgram *read_oz_binary(FILE *fp);
+
+#endif
@@ -6,7 +6,9 @@
  *---------------------------------------------------------------------------*/
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include "ast.h"
 #include "symbol.h"
 #include "oztree.h"
@@ -14,6 +16,9 @@
 #include "error_printer.h"
 #include "pretty.h"
 #include "array_access.h"
+#include "passes.h"
+#include "regalloc.h"
+#include "inliner.h"
 #include "std.h"
 
 #define PROGENTRY "main"
@@ -24,11 +29,67 @@ const char *builtinnames[] = { BUILTINNAMES };
 #define BOUNDS_ERROR "[FATAL]: array element out of bounds!\\n"
 #define DIV_ERROR "[FATAL]: division by zero!\\n"
 
+// The lines and strings a program has room for before it first grows
+#define INITIAL_LINES 1024
+#define INITIAL_STRINGS 64
+
+// The largest loop condition (in expression nodes) that is repeated at the
+// top of a rotated loop, rather than jumped to at its bottom
+#define MAX_REPEATED_COND 24
+
+// Arrays with more elements than this are set to zero by a loop in the
+// prologue rather than a store for each element, and the loop stores this
+// many elements each time round
+#define MAX_UNLOOPED_INIT 64
+#define INIT_LOOP_STORES 8
+
+// The registers array bounds are held in while they are checked, numbered
+// on from those of the proc's variables, and how many of them a loop
+// leaves free when it holds the bounds it checks throughout
+#define MAX_BOUND_REGS 8
+#define MIN_FREE_BOUND_REGS 2
+
 typedef enum {
     OUT_OF_BOUNDS_LABEL, DIV_BY_ZERO_LABEL, FIRST_AVAILABLE_LABEL
 } ReservedLabel;
 
-int next_label = FIRST_AVAILABLE_LABEL;
+// Each thread generating procs numbers its labels on from the same base,
+// and they are renumbered when the procs are joined (see join_fragment)
+_Thread_local int next_label = FIRST_AVAILABLE_LABEL;
+
+// A register holding an array bound, and whether it is kept for the
+// whole of the loop being generated
+typedef struct {
+    int     value;
+    BOOL    held;
+    BOOL    pinned;
+} BoundReg;
+
+// The bound registers of the proc being generated. What they hold is
+// forgotten at each label, call and proc, so a bound is only reused in
+// the straight-line code after it was set, or in a loop that set it
+// before its head and has no calls.
+_Thread_local BoundReg bound_regs[MAX_BOUND_REGS];
+_Thread_local int first_bound_reg;
+_Thread_local int next_bound_reg;
+
+// The threads procs are generated on, set by -j
+int codegen_threads = 1;
+
+// The procs of a program being generated on several threads. Each thread
+// takes the next proc not yet taken, and generates it into a program of
+// its own (a fragment), numbering its labels from base.
+typedef struct {
+    Proc            **procs;
+    int             nprocs;
+    void            *tables;
+    int             base;
+    OzProgram       **fragments;
+    int             *nlabels;
+    int             next;
+    long            allocations;
+    pthread_mutex_t lock;
+} ProcJobs;
 
 
 /*-----------------------------------------------------------------------------
@@ -37,11 +98,17 @@ int next_label = FIRST_AVAILABLE_LABEL;
  *---------------------------------------------------------------------------*/
 
 void gen_oz_procs(OzProgram *p, Procs *procs, void *tables);
+void gen_oz_proc(OzProgram *p, Proc *proc, void *tables);
+void gen_oz_procs_parallel(OzProgram *p, Procs *procs, void *tables);
+void *gen_oz_proc_jobs(void *arg);
+void join_fragment(OzProgram *p, OzProgram *fragment, int base, int shift);
 void gen_oz_prologue(OzProgram *p, Params *params, Decls *decls, void *table);
 void gen_oz_epilogue(OzProgram *p, void *table);
 void gen_oz_params(OzProgram *p, Params *params, void *table);
 void gen_oz_decls(OzProgram *p, Decls *decls, void *table);
 void gen_oz_init_array(OzProgram *p, int slot, int reg, Bounds *bounds);
+void gen_oz_init_loop(OzProgram *p, int slot, int reg, int size, int free);
+int array_slots(Bounds *bounds);
 void gen_oz_out_of_bounds(OzProgram *p);
 void gen_oz_div_by_zero(OzProgram *p);
 
@@ -49,11 +116,23 @@ void gen_oz_stmts(OzProgram *p, Stmts *stmts, void *tables, void *table);
 void gen_oz_write(OzProgram *p, Expr *write, void *table);
 void gen_oz_read(OzProgram *p, Expr *read, void *table);
 void gen_oz_assign(OzProgram *p, Assign *assign, void *table);
+void gen_oz_bind(OzProgram *p, Assign *bind, void *table);
+void gen_oz_advance(OzProgram *p, Assign *advance, void *table);
 void gen_oz_call(OzProgram *p, Function *call, void *tables, void *table);
+void gen_oz_arg(OzProgram *p, int reg, Expr *arg, Param *param, void *table);
+int arg_reg_need(Expr *arg, Param *param);
+BOOL order_args(Expr **args, Param **params, int nargs, int *order);
+void gen_oz_arg_moves(OzProgram *p, int *held_in, int nargs);
 void gen_oz_cond(OzProgram *p, Cond *cond, void *tables, void *table);
 void gen_oz_while(OzProgram *p, While *loop, void *tables, void *table);
+void gen_oz_branch(OzProgram *p, Expr *cond, BOOL jump_if, int label,
+                   void *table);
 
 void gen_oz_expr(OzProgram *p, int reg, Expr *expr, void *table);
+int gen_oz_operand(OzProgram *p, int reg, Expr *expr, void *table);
+int gen_oz_var(OzProgram *p, int reg, symbol *sym);
+void gen_oz_var_into(OzProgram *p, int reg, symbol *sym);
+void gen_oz_set_var(OzProgram *p, symbol *sym, int reg);
 void gen_oz_expr_id(OzProgram *p, int reg, char *id, void *table);
 void gen_oz_expr_const(OzProgram *p, int reg, Constant *constant);
 void gen_oz_expr_array_val(OzProgram *p, int reg, Expr *a, void *table);
@@ -63,25 +142,19 @@ void gen_oz_expr_binop_bool(OzProgram *p, int r1, int r2, int r3, Expr *expr);
 void gen_oz_expr_binop_int(OzProgram *p, int r1, int r2, int r3, Expr *expr);
 void gen_oz_expr_binop_float(OzProgram *p, int r1, int r2, int r3, Expr *expr);
 void gen_oz_expr_unop(OzProgram *p, int reg, Expr *expr, void *table);
+int inverted_compare(Expr *expr);
+int gen_oz_bound(OzProgram *p, int value, int reg);
+int hold_bound(OzProgram *p, int value);
+void forget_bounds(BOOL pinned);
+void pin_loop_bounds(OzProgram *p, While *loop, BOOL *pinned);
+BOOL find_stmts_bounds(Stmts *stmts, int *values, int *n);
+void find_expr_bounds(Expr *expr, int *values, int *n);
+Expr *bool_test(Expr *expr, BOOL *same);
 
-int get_reg_usage(Expr *expr, void *table);
-
-OzLine *new_line(OzProgram *p);
-OzOp *new_op(OzProgram *p);
+void number_stmts(Stmts *stmts, void *table);
+int number_expr(Expr *expr, void *table);
 
-void gen_comment(OzProgram *p, OzCommentSection section);
-void gen_call(OzProgram *p, char *id);
-void gen_call_builtin(OzProgram *p, OzBuiltinId id);
-void gen_halt(OzProgram *p);
-void gen_return(OzProgram *p);
-void gen_proc_label(OzProgram *p, char *id);
-void gen_label(OzProgram *p, int id);
-void gen_int_const(OzProgram *p, int reg, int val);
-void gen_real_const(OzProgram *p, int reg, float val);
-void gen_string_const(OzProgram *p, int reg, char *val);
-void gen_triop(OzProgram *p, OpCode code, int arg1, int arg2, int arg3);
-void gen_binop(OzProgram *p, OpCode code, int arg1, int arg2);
-void gen_unop(OzProgram *p, OpCode code, int arg1);
+OzLine *new_op(OzProgram *p, OpCode code);
 
 
 /*-----------------------------------------------------------------------------
@@ -90,20 +163,45 @@ void gen_unop(OzProgram *p, OpCode code, int arg1);
 
 OzProgram *
 gen_oz_program(Program *p, void *tables) {
-    OzProgram *ozprog = checked_malloc(sizeof(OzProgram));
-    ozprog->start = NULL;
-    ozprog->end   = NULL;
+    OzProgram *ozprog = new_oz_program();
 
     gen_call(ozprog, PROGENTRY);
     gen_halt(ozprog);
     gen_oz_out_of_bounds(ozprog);
     gen_oz_div_by_zero(ozprog);
 
-    gen_oz_procs(ozprog, p->procedures, tables);
+    // tail calls may branch to a proc that is generated after them
+    Procs *procs;
+    for (procs = p->procedures; procs != NULL; procs = procs->rest) {
+        scope *s = find_scope(procs->first->header->id, tables);
+        if (s->frame_reused) {
+            s->frame_label = next_label++;
+        }
+    }
+
+    // numbering builds the array accesses, whose offsets are reduced
+    // through the shared hash-consing table, so it is done for every proc
+    // here rather than on the threads the procs are generated on
+    for (procs = p->procedures; procs != NULL; procs = procs->rest) {
+        number_stmts(procs->first->body->statements,
+                     find_scope(procs->first->header->id, tables));
+    }
+
+    if (codegen_threads > 1 && p->procedures != NULL
+        && p->procedures->rest != NULL) {
+        gen_oz_procs_parallel(ozprog, p->procedures, tables);
+    } else {
+        gen_oz_procs(ozprog, p->procedures, tables);
+    }
 
     return ozprog;
 }
 
+void
+set_codegen_threads(int threads) {
+    codegen_threads = threads;
+}
+
 
 /*-----------------------------------------------------------------------------
  * Convert high level Wiz stuff into Oz structures
@@ -116,16 +214,159 @@ gen_oz_procs(OzProgram *p, Procs *procs, void *tables) {
         return; // no more procs
     }
 
-    Proc *proc = procs->first;
-    void *table = find_scope(proc->header->id, tables);
+    gen_oz_proc(p, procs->first, tables);
+    gen_oz_procs(p, procs->rest, tables);
+}
 
+// Generate Oz code for a single Proc, whose statements are already
+// numbered. Once they are, a proc's code depends only on its own AST and
+// scope, and on the params of the procs it calls, and nothing shared is
+// written, so procs can be generated on different threads.
+void
+gen_oz_proc(OzProgram *p, Proc *proc, void *tables) {
+    void *table = find_scope(proc->header->id, tables);
+    int first = p->nlines;
 
+    first_bound_reg = FIRST_VAR_REG + allocate_registers(proc, tables, table);
     gen_proc_label(p, proc->header->id);
     gen_oz_prologue(p, proc->header->params, proc->body->decls, table);
     gen_oz_stmts(p, proc->body->statements, tables, table);
     gen_oz_epilogue(p, table);
+    place_registers(p, first);
+}
 
-    gen_oz_procs(p, procs->rest, tables);
+// Generate the procs on codegen_threads threads (this one among them),
+// each into a fragment of its own, then join the fragments in source
+// order. The labels of every fragment start at the same base, and are
+// shifted past those of the fragments before it as it is joined, so the
+// program is the same as if the procs had been generated in turn.
+void
+gen_oz_procs_parallel(OzProgram *p, Procs *procs, void *tables) {
+    ProcJobs jobs;
+    Procs *ps;
+    int i, nthreads, started;
+
+    jobs.nprocs = 0;
+    for (ps = procs; ps != NULL; ps = ps->rest) {
+        jobs.nprocs++;
+    }
+    jobs.procs = checked_malloc(jobs.nprocs * sizeof(Proc *));
+    jobs.fragments = checked_malloc(jobs.nprocs * sizeof(OzProgram *));
+    jobs.nlabels = checked_malloc(jobs.nprocs * sizeof(int));
+    for (i = 0, ps = procs; ps != NULL; i++, ps = ps->rest) {
+        jobs.procs[i] = ps->first;
+    }
+    jobs.tables = tables;
+    jobs.base = next_label;
+    jobs.next = 0;
+    jobs.allocations = 0;
+    pthread_mutex_init(&jobs.lock, NULL);
+
+    // if a thread cannot be started, the ones that were do its share
+    nthreads = codegen_threads < jobs.nprocs ? codegen_threads : jobs.nprocs;
+    pthread_t *threads = checked_malloc(nthreads * sizeof(pthread_t));
+    for (started = 0; started < nthreads - 1; started++) {
+        if (pthread_create(&threads[started], NULL, gen_oz_proc_jobs,
+                           &jobs) != 0) {
+            break;
+        }
+    }
+    gen_oz_proc_jobs(&jobs);
+    for (i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    count_allocations(jobs.allocations);
+    pthread_mutex_destroy(&jobs.lock);
+
+    int shift = 0;
+    for (i = 0; i < jobs.nprocs; i++) {
+        join_fragment(p, jobs.fragments[i], jobs.base, shift);
+        shift += jobs.nlabels[i];
+        free(jobs.fragments[i]->lines);
+        free(jobs.fragments[i]->strings);
+        free(jobs.fragments[i]);
+    }
+    next_label = jobs.base + shift;
+
+    free(threads);
+    free(jobs.procs);
+    free(jobs.fragments);
+    free(jobs.nlabels);
+}
+
+// A thread generating procs, taking them one at a time until none are
+// left. The allocations it made are added to the jobs' as it finishes.
+void *
+gen_oz_proc_jobs(void *arg) {
+    ProcJobs *jobs = arg;
+    long allocations = allocations_made();
+    int i;
+
+    for (;;) {
+        pthread_mutex_lock(&jobs->lock);
+        i = jobs->next++;
+        pthread_mutex_unlock(&jobs->lock);
+        if (i >= jobs->nprocs) {
+            break;
+        }
+
+        next_label = jobs->base;
+        jobs->fragments[i] = new_oz_program();
+        gen_oz_proc(jobs->fragments[i], jobs->procs[i], jobs->tables);
+        jobs->nlabels[i] = next_label - jobs->base;
+    }
+
+    pthread_mutex_lock(&jobs->lock);
+    jobs->allocations += allocations_made() - allocations;
+    pthread_mutex_unlock(&jobs->lock);
+    return NULL;
+}
+
+// Append a fragment to a program, moving its strings into the program's
+// and shifting the labels it made (those from base on) by shift. Labels
+// below base (the reserved ones and frame labels) are shared by all.
+void
+join_fragment(OzProgram *p, OzProgram *fragment, int base, int shift) {
+    int i, strings = p->nstrings;
+
+    for (i = 0; i < fragment->nstrings; i++) {
+        add_string(p, fragment->strings[i]);
+    }
+    for (i = 0; i < fragment->nlines; i++) {
+        OzLine *line = new_line(p, fragment->lines[i].kind);
+        *line = fragment->lines[i];
+
+        int *label = NULL;
+        if (line->kind == OZ_LABEL) {
+            label = &line->arg1;
+        } else if (line->kind == OZ_PROC) {
+            line->arg1 += strings;
+        } else if (line->kind == OZ_OP) {
+            switch (line->code) {
+                case OP_BRANCH_UNCOND:
+                    label = &line->arg1;
+                    break;
+
+                case OP_BRANCH_ON_TRUE: case OP_BRANCH_ON_FALSE:
+                    label = &line->arg2;
+                    break;
+
+                case OP_CALL: case OP_BRANCH_PROC:
+                    line->arg1 += strings;
+                    break;
+
+                case OP_STRING_CONST:
+                    line->arg2 += strings;
+                    break;
+
+                default:
+                    break;
+            }
+        }
+        if (label != NULL && *label >= base) {
+            *label += shift;
+        }
+    }
 }
 
 // Generate the prologue component of a Proc
@@ -134,6 +375,9 @@ void
 gen_oz_prologue(OzProgram *p, Params *params, Decls *decls, void *table) {
     gen_comment(p, SECTION_PROLOGUE);
     gen_unop(p, OP_PUSH_STACK_FRAME, slots_needed_for_table(table));
+    if (((scope *)table)->frame_reused) {
+        gen_label(p, ((scope *)table)->frame_label);
+    }
     gen_oz_params(p, params, table);
     gen_oz_decls(p, decls, table);
 }
@@ -156,7 +400,11 @@ gen_oz_params(OzProgram *p, Params *params, void *table) {
         param = params->first;
         sym = retrieve_symbol_in_scope(param->id, (scope *)table);
 
-        gen_binop(p, OP_STORE, sym->slot, count);
+        if (sym->reg == NO_REG) {
+            gen_binop(p, OP_STORE, sym->slot, count);
+        } else if (sym->reg_init) {
+            gen_binop(p, OP_MOVE, sym->reg, count);
+        }
 
         count++;
         params = params->rest;
@@ -183,7 +431,11 @@ gen_oz_decls(OzProgram *p, Decls *decls, void *table) {
 
         sym = retrieve_symbol_in_scope(decl->id, (scope *)table);
 
-        if (!reals && sym->type == SYM_REAL) {
+        if (sym->reg != NO_REG) {
+            // set directly below
+        }
+
+        else if (!reals && sym->type == SYM_REAL) {
             reals = TRUE;
             real_reg = count++;
         }
@@ -211,6 +463,18 @@ gen_oz_decls(OzProgram *p, Decls *decls, void *table) {
         decl = ds->first;
         sym = retrieve_symbol_in_scope(decl->id, (scope *)table);
 
+        // a variable in a register is set there, if it is read before it
+        // is written
+        if (sym->reg != NO_REG) {
+            if (sym->reg_init && sym->type == SYM_REAL) {
+                gen_real_const(p, sym->reg, 0.0f);
+            } else if (sym->reg_init) {
+                gen_int_const(p, sym->reg, 0);
+            }
+            ds = ds->rest;
+            continue;
+        }
+
         if (sym->type == SYM_REAL) {
             reg = real_reg;
         } else {
@@ -220,6 +484,9 @@ gen_oz_decls(OzProgram *p, Decls *decls, void *table) {
         // if not array, just do one, otherwise initalise all stack vars
         if (sym->bounds == NULL) {
             gen_binop(p, OP_STORE, sym->slot, reg);
+        } else if (array_slots(sym->bounds) > MAX_UNLOOPED_INIT) {
+            gen_oz_init_loop(p, sym->slot, reg, array_slots(sym->bounds),
+                             count);
         } else {
             gen_oz_init_array(p, sym->slot, reg, sym->bounds);
         }
@@ -251,6 +518,41 @@ gen_oz_init_array(OzProgram *p, int slot, int reg, Bounds *bounds) {
     }
 }
 
+// The number of slots an array takes, one for each element
+int
+array_slots(Bounds *bounds) {
+    return (bounds->first->upper - bounds->first->lower + 1)
+           * bounds->first->offset_size;
+}
+
+// Initialise the size slots of an array from slot on to the value in reg,
+// with a loop that walks an address down the array, storing through it.
+// Registers from free on are not in use. The elements left over when the
+// loop has stored as many as it can in whole rounds are stored directly.
+void
+gen_oz_init_loop(OzProgram *p, int slot, int reg, int size, int free) {
+    int addr = free, rounds = free + 1, one = free + 2, more = free + 3;
+    int begin_label = next_label++;
+    int looped = size - size % INIT_LOOP_STORES;
+    int i;
+
+    gen_binop(p, OP_LOAD_ADDRESS, addr, slot);
+    gen_int_const(p, rounds, looped / INIT_LOOP_STORES);
+    gen_int_const(p, one, 1);
+    gen_label(p, begin_label);
+    for (i = 0; i < INIT_LOOP_STORES; i++) {
+        gen_binop(p, OP_STORE_INDIRECT, addr, reg);
+        gen_triop(p, OP_SUB_OFFSET, addr, addr, one);
+    }
+    gen_triop(p, OP_SUB_INT, rounds, rounds, one);
+    gen_triop(p, OP_CMP_GE_INT, more, rounds, one);
+    gen_binop(p, OP_BRANCH_ON_TRUE, more, begin_label);
+
+    for (i = looped; i < size; i++) {
+        gen_binop(p, OP_STORE, slot + i, reg);
+    }
+}
+
 // Label to halt the program because someone attempted to access elements
 // outside the bounds of an array!
 void gen_oz_out_of_bounds(OzProgram *p) {
@@ -304,6 +606,14 @@ gen_oz_stmts(OzProgram *p, Stmts *stmts, void *tables, void *table) {
             gen_oz_assign(p, &(stmt->info.assign), table);
             break;
 
+        case STMT_BIND:
+            gen_oz_bind(p, &(stmt->info.assign), table);
+            break;
+
+        case STMT_ADVANCE:
+            gen_oz_advance(p, &(stmt->info.assign), table);
+            break;
+
         case STMT_FUNC:
             gen_oz_call(p, stmt->info.func, tables, table);
             break;
@@ -379,10 +689,14 @@ gen_oz_read(OzProgram *p, Expr *read, void *table) {
 
     // Store the value in the appropirate place
     if (read->kind == EXPR_ARRAY) {
-        //if array access is entirely static, store directly
-        Bounds *bounds = sym->bounds;
-        ArrayAccess *array_access = get_array_access(read, bounds);
-        if (array_access->dynamic_bounds == NULL) {
+        //if array access is entirely static, store directly (or fail, if
+        //it is out of bounds)
+        ArrayAccess *array_access = read->access;
+        if (array_access->dynamic_bounds == NULL
+            && !array_access->is_in_static_bounds) {
+            gen_unop(p, OP_BRANCH_UNCOND, OUT_OF_BOUNDS_LABEL);
+
+        } else if (array_access->dynamic_bounds == NULL) {
             gen_binop(p, OP_STORE, sym->slot + array_access->static_offset, 0);
 
         } else {
@@ -391,11 +705,10 @@ gen_oz_read(OzProgram *p, Expr *read, void *table) {
         }
 
     } else if (sym->kind == SYM_PARAM_REF) {
-        gen_binop(p, OP_LOAD, 1, sym->slot);
-        gen_binop(p, OP_STORE_INDIRECT, 1, 0);
+        gen_binop(p, OP_STORE_INDIRECT, gen_oz_var(p, 1, sym), 0);
 
     } else {
-        gen_binop(p, OP_STORE, sym->slot, 0);
+        gen_oz_set_var(p, sym, 0);
     }
 }
 
@@ -407,33 +720,70 @@ gen_oz_assign(OzProgram *p, Assign *assign, void *table) {
     symbol *sym = retrieve_symbol_in_scope(assign->asg_ident->id, table);
     Type etype = assign->asg_expr->inferred_type;
 
-    // Evaluate the expression
-    gen_oz_expr(p, 0, assign->asg_expr, table);
+    // Evaluate the expression (a variable in a register is used there)
+    int reg = gen_oz_operand(p, 0, assign->asg_expr, table);
 
     // convert to float if needed
     if (sym->type == SYM_REAL && etype == INT_TYPE) {
-        gen_binop(p, OP_INT_TO_REAL, 0, 0);
+        gen_binop(p, OP_INT_TO_REAL, 0, reg);
+        reg = 0;
     }
 
     // Store the value
     if (assign->asg_ident->kind == EXPR_ARRAY) {
-        //if array access is entirely static, store directly
-        Bounds *bounds = sym->bounds;
-        ArrayAccess *array_access = get_array_access(assign->asg_ident, bounds);
-        if (array_access->dynamic_bounds == NULL) {
-            gen_binop(p, OP_STORE, sym->slot + array_access->static_offset, 0);
+        //if array access is entirely static, store directly (or fail, if
+        //it is out of bounds)
+        ArrayAccess *array_access = assign->asg_ident->access;
+        if (array_access->dynamic_bounds == NULL
+            && !array_access->is_in_static_bounds) {
+            gen_unop(p, OP_BRANCH_UNCOND, OUT_OF_BOUNDS_LABEL);
+        } else if (array_access->dynamic_bounds == NULL) {
+            gen_binop(p, OP_STORE, sym->slot + array_access->static_offset,
+                      reg);
         } else {
             gen_oz_expr_array_addr(p, 1, assign->asg_ident, table);
-            gen_binop(p, OP_STORE_INDIRECT, 1, 0);
+            gen_binop(p, OP_STORE_INDIRECT, 1, reg);
         }
 
     } else if (sym->kind == SYM_PARAM_REF) {
-        gen_binop(p, OP_LOAD, 1, sym->slot);
-        gen_binop(p, OP_STORE_INDIRECT, 1, 0);
+        gen_binop(p, OP_STORE_INDIRECT, gen_oz_var(p, 1, sym), reg);
+
+    } else {
+        gen_oz_set_var(p, sym, reg);
+    }
+}
+
+// Generate Oz code binding an address temporary to an array element
+void
+gen_oz_bind(OzProgram *p, Assign *bind, void *table) {
+    gen_comment(p, SECTION_ASSIGN);
+
+    symbol *sym = retrieve_symbol_in_scope(bind->asg_ident->id, table);
 
+    // the address is stored in the slot, so reads and writes of the
+    // temporary go through it like a ref parameter
+    int reg = 0;
+    if (bind->asg_expr->kind == EXPR_ID) {
+        symbol *from = retrieve_symbol_in_scope(bind->asg_expr->id, table);
+        reg = gen_oz_var(p, 0, from);
     } else {
-        gen_binop(p, OP_STORE, sym->slot, 0);
+        gen_oz_expr_array_addr(p, 0, bind->asg_expr, table);
     }
+    gen_oz_set_var(p, sym, reg);
+}
+
+// Generate Oz code moving an address temporary on by a number of elements
+void
+gen_oz_advance(OzProgram *p, Assign *advance, void *table) {
+    gen_comment(p, SECTION_ASSIGN);
+
+    symbol *sym = retrieve_symbol_in_scope(advance->asg_ident->id, table);
+
+    // element addresses decrease as the flat offset increases
+    int reg = gen_oz_var(p, 0, sym);
+    int by = gen_oz_operand(p, 1, advance->asg_expr, table);
+    gen_triop(p, OP_SUB_OFFSET, 0, reg, by);
+    gen_oz_set_var(p, sym, 0);
 }
 
 // Generate Oz code from Wiz Call
@@ -443,45 +793,166 @@ gen_oz_call(OzProgram *p, Function *call, void *tables, void *table) {
 
     scope *call_table = find_scope(call->id, tables);
     Params *params = call_table->params;
-    Param *param;
-    symbol *arg_sym;
-    int reg = 0;
     Exprs *args = call->args;
-    Expr *arg;
+    int nargs = 0;
+    int i;
 
-    // Store all the args in registers
+    // Store all the args in registers, r0 to r(nargs - 1)
     while (args != NULL) {
-        arg = args->first;
-        param = params->first;
+        nargs++;
+        args = args->rest;
+    }
+    Expr **arg_exprs = checked_malloc(nargs * sizeof(Expr *));
+    Param **arg_params = checked_malloc(nargs * sizeof(Param *));
+    int *order = checked_malloc(nargs * sizeof(int));
+    args = call->args;
+    for (i = 0; i < nargs; i++) {
+        arg_exprs[i] = args->first;
+        arg_params[i] = params->first;
+        args = args->rest;
+        params = params->rest;
+    }
+
+    // evaluate the args needing the most registers first if that lowers
+    // the highest register used, then move each into its place
+    if (order_args(arg_exprs, arg_params, nargs, order)) {
+        int *held_in = checked_malloc(nargs * sizeof(int));
+        for (i = 0; i < nargs; i++) {
+            gen_oz_arg(p, i, arg_exprs[order[i]], arg_params[order[i]],
+                       table);
+            held_in[order[i]] = i;
+        }
+        gen_oz_arg_moves(p, held_in, nargs);
+    } else {
+        for (i = 0; i < nargs; i++) {
+            gen_oz_arg(p, i, arg_exprs[i], arg_params[i], table);
+        }
+    }
 
-        // see if we're passing by ref or val
-        if (param->ind == REF_IND) {
-            arg_sym = retrieve_symbol_in_scope(arg->id, table);
+    // a tail call keeps the frame when the callee's is the same size, and
+    // otherwise drops it so that the callee returns straight to our caller
+    if (call->tail) {
+        if (slots_needed_for_table(call_table)
+            == slots_needed_for_table(table)) {
+            gen_unop(p, OP_BRANCH_UNCOND, call_table->frame_label);
+        } else {
+            gen_unop(p, OP_POP_STACK_FRAME, slots_needed_for_table(table));
+            gen_branch_proc(p, call->id);
+        }
+        return;
+    }
 
-            if (arg_sym->kind == SYM_PARAM_REF) {
-                gen_binop(p, OP_LOAD, reg, arg_sym->slot);
-            } else if (arg->kind == EXPR_ARRAY) {
-                gen_oz_expr_array_addr(p, reg, arg, table);
-            } else {
-                gen_binop(p, OP_LOAD_ADDRESS, reg, arg_sym->slot);
-            }
+    // call the proc, saving the registers of the variables still needed
+    // after it, which it may overwrite
+    Spills *spills;
+    for (spills = call->spills; spills != NULL; spills = spills->rest) {
+        gen_binop(p, OP_STORE, spills->first->slot, spills->first->reg);
+    }
+    gen_call(p, call->id);
+    for (spills = call->spills; spills != NULL; spills = spills->rest) {
+        gen_binop(p, OP_LOAD, spills->first->reg, spills->first->slot);
+    }
+}
 
+// Generate Oz code storing an argument in reg, passed by ref or by val
+void
+gen_oz_arg(OzProgram *p, int reg, Expr *arg, Param *param, void *table) {
+    if (param->ind == REF_IND) {
+        symbol *arg_sym = retrieve_symbol_in_scope(arg->id, table);
+
+        if (arg_sym->kind == SYM_PARAM_REF) {
+            gen_oz_var_into(p, reg, arg_sym);
+        } else if (arg->kind == EXPR_ARRAY) {
+            gen_oz_expr_array_addr(p, reg, arg, table);
         } else {
-            gen_oz_expr(p, reg, arg, table);
-            // are we passing an int value to a float param?
-            if (arg->inferred_type == INT_TYPE && param->type == FLOAT_TYPE) {
-                gen_binop(p, OP_INT_TO_REAL, reg, reg);
-            }
+            gen_binop(p, OP_LOAD_ADDRESS, reg, arg_sym->slot);
         }
 
-        // other args
-        reg++;
-        params = params->rest;
-        args = args->rest;
+    } else {
+        gen_oz_expr(p, reg, arg, table);
+        // are we passing an int value to a float param?
+        if (arg->inferred_type == INT_TYPE && param->type == FLOAT_TYPE) {
+            gen_binop(p, OP_INT_TO_REAL, reg, reg);
+        }
     }
+}
 
-    // call the proc
-    gen_call(p, call->id);
+// The extra registers needed to store an argument. An array element's
+// address takes one more than its value when the access is static.
+int
+arg_reg_need(Expr *arg, Param *param) {
+    if (param->ind == REF_IND && arg->kind == EXPR_ARRAY) {
+        return max(arg->reg_need, 1);
+    }
+    return param->ind == REF_IND ? 0 : arg->reg_need;
+}
+
+// Sets order to the args sorted by the registers they need, the most
+// first (keeping their order on a tie). Returns TRUE if evaluating them
+// in that order, into r0, r1 and so on, uses fewer registers than
+// evaluating them as written, counting the one needed to swap registers
+// when moving them into place.
+BOOL
+order_args(Expr **args, Param **params, int nargs, int *order) {
+    int *need = checked_malloc(nargs * sizeof(int));
+    int written_peak = 0, ordered_peak = nargs;
+    int i, j;
+    for (i = 0; i < nargs; i++) {
+        need[i] = arg_reg_need(args[i], params[i]);
+        written_peak = max(written_peak, i + need[i]);
+        // insertion sort, which is stable
+        for (j = i; j > 0 && need[order[j - 1]] < need[i]; j--) {
+            order[j] = order[j - 1];
+        }
+        order[j] = i;
+    }
+    for (i = 0; i < nargs; i++) {
+        ordered_peak = max(ordered_peak, i + need[order[i]]);
+    }
+    free(need);
+    return ordered_peak < written_peak;
+}
+
+// Generate Oz code moving each arg i from held_in[i] to ri. A register is
+// only overwritten once the arg held in it has moved, and a cycle of args
+// is broken by moving one of them to r(nargs), which no arg uses.
+void
+gen_oz_arg_moves(OzProgram *p, int *held_in, int nargs) {
+    int i, j;
+    BOOL moved = TRUE;
+    while (moved) {
+        moved = FALSE;
+        for (i = 0; i < nargs; i++) {
+            if (held_in[i] == i) {
+                continue;
+            }
+            BOOL ri_in_use = FALSE;
+            for (j = 0; j < nargs; j++) {
+                if (j != i && held_in[j] == i) {
+                    ri_in_use = TRUE;
+                }
+            }
+            if (!ri_in_use) {
+                gen_binop(p, OP_MOVE, i, held_in[i]);
+                held_in[i] = i;
+                moved = TRUE;
+            }
+        }
+        if (moved) {
+            continue;
+        }
+
+        // only cycles are left: free a register in one of them
+        for (i = 0; i < nargs && held_in[i] == i; i++) {
+        }
+        if (i < nargs) {
+            for (j = 0; j < nargs && held_in[j] != i; j++) {
+            }
+            gen_binop(p, OP_MOVE, nargs, i);
+            held_in[j] = nargs;
+            moved = TRUE;
+        }
+    }
 }
 
 // Generate Oz code from Wiz Cond
@@ -498,9 +969,9 @@ gen_oz_cond(OzProgram *p, Cond *cond, void *tables, void *table) {
     }
     after_label = next_label++;
 
-    // Evaluate the conditional
-    gen_oz_expr(p, 0, cond->cond, table);
-    gen_binop(p, OP_BRANCH_ON_FALSE, 0, else_branch ? else_label : after_label);
+    // Evaluate the conditional, skipping the then body if false
+    gen_oz_branch(p, cond->cond, FALSE,
+                  else_branch ? else_label : after_label, table);
 
     gen_oz_stmts(p, cond->then_branch, tables, table); // then body
 
@@ -515,20 +986,116 @@ gen_oz_cond(OzProgram *p, Cond *cond, void *tables, void *table) {
     gen_label(p, after_label);
 }
 
-// Generate Oz code from Wiz While
+// Generate Oz code from Wiz While. A rotated loop tests its condition at
+// the bottom, branching back to the top of the body while it holds, so
+// each iteration runs one branch rather than a conditional branch out and
+// a jump back. It is entered by testing the condition once on the way in,
+// or for a large condition by jumping to the test at the bottom.
 void
 gen_oz_while(OzProgram *p, While *loop, void *tables, void *table) {
     gen_comment(p, SECTION_WHILE);
 
     int begin_label = next_label++;
     int after_label = next_label++;
+    BOOL pinned[MAX_BOUND_REGS];
+    int k;
+
+    // the bounds checked in the loop are set once, before it
+    pin_loop_bounds(p, loop, pinned);
+
+    if (!pass_enabled(PASS_ROTATE_LOOPS)) {
+        gen_label(p, begin_label);              // Where the loop begins
+        gen_oz_branch(p, loop->cond, FALSE, after_label, table);
+        gen_oz_stmts(p, loop->body, tables, table); // the loop body
+        gen_unop(p, OP_BRANCH_UNCOND, begin_label); // restart loop
+        gen_label(p, after_label);              // exit jump point
+        for (k = 0; k < MAX_BOUND_REGS; k++) {
+            bound_regs[k].pinned &= !pinned[k];
+        }
+        return;
+    }
 
-    gen_label(p, begin_label);                  // Where the loop begins
-    gen_oz_expr(p, 0, loop->cond, table);       // the condition to match
-    gen_binop(p, OP_BRANCH_ON_FALSE, 0, after_label); // exit loop if false
-    gen_oz_stmts(p, loop->body, tables, table); // the loop body
-    gen_unop(p, OP_BRANCH_UNCOND, begin_label); // restart loop
+    int test_label = -1;
+    if (expr_size(loop->cond) <= MAX_REPEATED_COND) {
+        gen_oz_branch(p, loop->cond, FALSE, after_label, table);
+    } else {
+        test_label = next_label++;
+        gen_unop(p, OP_BRANCH_UNCOND, test_label);
+    }
+    gen_label(p, begin_label);                  // the loop body
+    gen_oz_stmts(p, loop->body, tables, table);
+    if (test_label >= 0) {
+        gen_label(p, test_label);
+    }
+    gen_oz_branch(p, loop->cond, TRUE, begin_label, table); // loop again
     gen_label(p, after_label);                  // exit jump point
+    for (k = 0; k < MAX_BOUND_REGS; k++) {
+        bound_regs[k].pinned &= !pinned[k];
+    }
+}
+
+
+// Generate Oz code that jumps to label if cond evaluates to jump_if, and
+// otherwise falls through. The boolean operators become jumps rather than
+// values, so the right operand of and/or is only evaluated if it decides
+// the outcome, a not flips the sense of the jump, and a bool compared
+// with a constant is tested directly.
+void
+gen_oz_branch(OzProgram *p, Expr *cond, BOOL jump_if, int label,
+              void *table) {
+    BOOL is_and, value;
+    int skip_label;
+    Expr *test;
+
+    switch (cond->kind) {
+        case EXPR_CONST:
+            // the branch is decided at compile time
+            value = cond->constant.val.bool_val ? TRUE : FALSE;
+            if (value == jump_if) {
+                gen_unop(p, OP_BRANCH_UNCOND, label);
+            }
+            return;
+
+        case EXPR_UNOP:
+            if (cond->unop == UNOP_NOT) {
+                gen_oz_branch(p, cond->e1, !jump_if, label, table);
+                return;
+            }
+            break;
+
+        case EXPR_BINOP:
+            test = bool_test(cond, &value);
+            if (test != NULL) {
+                // b = true jumps as b does, b = false the other way
+                gen_oz_branch(p, test, value ? jump_if : !jump_if, label,
+                              table);
+                return;
+            }
+            if (cond->binop != BINOP_AND && cond->binop != BINOP_OR) {
+                break;
+            }
+            is_and = (cond->binop == BINOP_AND);
+            if (jump_if != is_and) {
+                // and is false (or is true) as soon as either side is
+                gen_oz_branch(p, cond->e1, jump_if, label, table);
+                gen_oz_branch(p, cond->e2, jump_if, label, table);
+            } else {
+                // and is true (or is false) only if both sides are
+                skip_label = next_label++;
+                gen_oz_branch(p, cond->e1, !jump_if, skip_label, table);
+                gen_oz_branch(p, cond->e2, jump_if, label, table);
+                gen_label(p, skip_label);
+            }
+            return;
+
+        default:
+            break;
+    }
+
+    // otherwise evaluate the condition as a value and test it
+    int reg = gen_oz_operand(p, 0, cond, table);
+    gen_binop(p, jump_if ? OP_BRANCH_ON_TRUE : OP_BRANCH_ON_FALSE, reg,
+              label);
 }
 
 
@@ -573,14 +1140,72 @@ gen_oz_expr_id(OzProgram *p, int reg, char *id, void *table) {
     if (sym->kind == SYM_PARAM_REF) {
         //first load address of the variable to register reg
         //use regular load as the value is already an address
-        gen_binop(p, OP_LOAD, reg, sym->slot);
+        //(unless the address is kept in a register)
+        int addr = gen_oz_var(p, reg, sym);
         //then load indirectly using this address
-        gen_binop(p, OP_LOAD_INDIRECT, reg, reg);
+        gen_binop(p, OP_LOAD_INDIRECT, reg, addr);
+    } else {
+        gen_oz_var_into(p, reg, sym);
+    }
+}
+
+// Generate Oz code for an operand of an op, returning the register it is
+// in. A variable kept in a register is used where it is, and anything
+// else is evaluated into reg.
+int
+gen_oz_operand(OzProgram *p, int reg, Expr *expr, void *table) {
+    if (expr->kind == EXPR_ID) {
+        symbol *sym = retrieve_symbol_in_scope(expr->id, table);
+        if (sym->reg != NO_REG && sym->kind != SYM_PARAM_REF) {
+            return sym->reg;
+        }
+    }
+    gen_oz_expr(p, reg, expr, table);
+    return reg;
+}
+
+// Returns the register holding a variable's own value (for a ref, its
+// address), loading it into reg if it is kept in its slot
+int
+gen_oz_var(OzProgram *p, int reg, symbol *sym) {
+    if (sym->reg != NO_REG) {
+        return sym->reg;
+    }
+    gen_binop(p, OP_LOAD, reg, sym->slot);
+    return reg;
+}
+
+// Generate Oz code copying a variable's own value into reg
+void
+gen_oz_var_into(OzProgram *p, int reg, symbol *sym) {
+    if (sym->reg != NO_REG) {
+        gen_binop(p, OP_MOVE, reg, sym->reg);
     } else {
         gen_binop(p, OP_LOAD, reg, sym->slot);
     }
 }
 
+// Generate Oz code setting a variable's own value to the one in reg,
+// which is not needed afterwards. When the value was just computed into
+// reg, the op that computed it writes the variable's register instead.
+void
+gen_oz_set_var(OzProgram *p, symbol *sym, int reg) {
+    if (sym->reg == NO_REG) {
+        gen_binop(p, OP_STORE, sym->slot, reg);
+        return;
+    }
+    if (sym->reg == reg) {
+        return;
+    }
+    OzLine *last = &(p->lines[p->nlines - 1]);
+    if (reg < FIRST_VAR_REG && last->kind == OZ_OP
+        && oz_writes_arg1(last->code) && last->arg1 == reg) {
+        last->arg1 = sym->reg;
+    } else {
+        gen_binop(p, OP_MOVE, sym->reg, reg);
+    }
+}
+
 // Generate Oz code from Wiz EXPR_CONST Expr
 void
 gen_oz_expr_const(OzProgram *p, int reg, Constant *constant) {
@@ -611,12 +1236,15 @@ gen_oz_expr_const(OzProgram *p, int reg, Constant *constant) {
 // evaluate an array expr, storing value in reg
 void
 gen_oz_expr_array_val(OzProgram *p, int reg, Expr *a, void *table) {
-    //if array access is static, load directly
+    //if array access is static, load directly (or fail, if out of bounds)
     symbol *sym = retrieve_symbol_in_scope(a->id, table);
-    Bounds *bounds = sym->bounds;
-    ArrayAccess *array_access = get_array_access(a, bounds);
+    ArrayAccess *array_access = a->access;
+
+    if (array_access->dynamic_bounds == NULL
+        && !array_access->is_in_static_bounds) {
+        gen_unop(p, OP_BRANCH_UNCOND, OUT_OF_BOUNDS_LABEL);
 
-    if (array_access->dynamic_bounds == NULL) {
+    } else if (array_access->dynamic_bounds == NULL) {
         gen_binop(p, OP_LOAD, reg, sym->slot + array_access->static_offset);
 
     } else {
@@ -629,8 +1257,7 @@ gen_oz_expr_array_val(OzProgram *p, int reg, Expr *a, void *table) {
 void
 gen_oz_expr_array_addr(OzProgram *p, int reg, Expr *a, void *table) {
     symbol *sym = retrieve_symbol_in_scope(a->id, table);
-    Bounds *bounds = sym->bounds;
-    ArrayAccess *array_access = get_array_access(a, bounds);
+    ArrayAccess *array_access = a->access;
     Exprs *dynamic_offsets = array_access->dynamic_offsets;
     Intervals *dynamic_bounds = array_access->dynamic_bounds;
 
@@ -651,20 +1278,20 @@ gen_oz_expr_array_addr(OzProgram *p, int reg, Expr *a, void *table) {
         Expr *dynamic_offset = dynamic_offsets->first;
         Interval *bounds = dynamic_bounds->first;
         // calculate the dynamic offset:
-        gen_oz_expr(p, reg + 1, dynamic_offset, table);
+        int offset = gen_oz_operand(p, reg + 1, dynamic_offset, table);
 
         // check that it is in bounds
         // offset < min_offset
-        gen_int_const(p, reg + 2, bounds->lower);
-        gen_triop(p, OP_CMP_LT_INT, reg + 2, reg + 1, reg + 2);
+        int limit = gen_oz_bound(p, bounds->lower, reg + 2);
+        gen_triop(p, OP_CMP_LT_INT, reg + 2, offset, limit);
         gen_binop(p, OP_BRANCH_ON_TRUE, reg + 2, OUT_OF_BOUNDS_LABEL);
         // offset > max_offset
-        gen_int_const(p, reg + 2, bounds->upper);
-        gen_triop(p, OP_CMP_GT_INT, reg + 2, reg + 1, reg + 2);
+        limit = gen_oz_bound(p, bounds->upper, reg + 2);
+        gen_triop(p, OP_CMP_GT_INT, reg + 2, offset, limit);
         gen_binop(p, OP_BRANCH_ON_TRUE, reg + 2, OUT_OF_BOUNDS_LABEL);
 
         // add to the total offset so far
-        gen_triop(p, OP_ADD_INT, reg, reg, reg + 1);
+        gen_triop(p, OP_ADD_INT, reg, reg, offset);
 
         //advance the lists we are iterating through
         dynamic_offsets = dynamic_offsets->rest;
@@ -676,6 +1303,178 @@ gen_oz_expr_array_addr(OzProgram *p, int reg, Expr *a, void *table) {
     gen_triop(p, OP_SUB_OFFSET, reg, reg + 1, reg);
 }
 
+// The register holding an array bound to check against, which is set to
+// the bound first unless it already holds it. The bound is put in reg if
+// it cannot be held in a bound register.
+int
+gen_oz_bound(OzProgram *p, int value, int reg) {
+    if (pass_enabled(PASS_BOUND_REGS)) {
+        int held = hold_bound(p, value);
+        if (held >= 0) {
+            return held;
+        }
+    }
+    gen_int_const(p, reg, value);
+    return reg;
+}
+
+// The bound register holding a value, setting one to it if none does.
+// Only unpinned registers are reused, each in turn, and -1 is returned if
+// they are all pinned.
+int
+hold_bound(OzProgram *p, int value) {
+    int k, tries;
+    for (k = 0; k < MAX_BOUND_REGS; k++) {
+        if (bound_regs[k].held && bound_regs[k].value == value) {
+            return first_bound_reg + k;
+        }
+    }
+    for (tries = 0; tries < MAX_BOUND_REGS; tries++) {
+        k = next_bound_reg;
+        next_bound_reg = (next_bound_reg + 1) % MAX_BOUND_REGS;
+        if (!bound_regs[k].pinned) {
+            bound_regs[k].value = value;
+            bound_regs[k].held = TRUE;
+            gen_int_const(p, first_bound_reg + k, value);
+            return first_bound_reg + k;
+        }
+    }
+    return -1;
+}
+
+// Forget what the bound registers hold, other than the pinned ones unless
+// pinned is set (as everything is lost to a call)
+void
+forget_bounds(BOOL pinned) {
+    int k;
+    for (k = 0; k < MAX_BOUND_REGS; k++) {
+        if (pinned || !bound_regs[k].pinned) {
+            bound_regs[k].held = FALSE;
+            bound_regs[k].pinned = FALSE;
+        }
+    }
+}
+
+// Set the bounds a loop checks before it, and pin them for the whole loop,
+// marking in pinned those it pinned. A loop with a call in it loses its
+// registers, so is left alone, and the bound registers other loops have
+// pinned are kept, as are a few for the checks of other bounds.
+void
+pin_loop_bounds(OzProgram *p, While *loop, BOOL *pinned) {
+    int values[MAX_BOUND_REGS];
+    int n = 0, free = 0, i, k;
+
+    for (k = 0; k < MAX_BOUND_REGS; k++) {
+        pinned[k] = FALSE;
+        free += !bound_regs[k].pinned;
+    }
+    if (!pass_enabled(PASS_BOUND_REGS)) {
+        return;
+    }
+    find_expr_bounds(loop->cond, values, &n);
+    if (!find_stmts_bounds(loop->body, values, &n)) {
+        return;
+    }
+
+    for (i = 0; i < n && free > MIN_FREE_BOUND_REGS; i++) {
+        k = hold_bound(p, values[i]) - first_bound_reg;
+        if (!bound_regs[k].pinned) {
+            bound_regs[k].pinned = TRUE;
+            pinned[k] = TRUE;
+            free--;
+        }
+    }
+}
+
+// Add the bounds checked in some statements to values (up to
+// MAX_BOUND_REGS of them), returning FALSE if the statements make a call
+BOOL
+find_stmts_bounds(Stmts *stmts, int *values, int *n) {
+    for (; stmts != NULL; stmts = stmts->rest) {
+        Stmt *stmt = stmts->first;
+        switch (stmt->kind) {
+            case STMT_ASSIGN:
+            case STMT_BIND:
+            case STMT_ADVANCE:
+                find_expr_bounds(stmt->info.assign.asg_ident, values, n);
+                find_expr_bounds(stmt->info.assign.asg_expr, values, n);
+                break;
+
+            case STMT_READ:
+                find_expr_bounds(stmt->info.read, values, n);
+                break;
+
+            case STMT_WRITE:
+                find_expr_bounds(stmt->info.write, values, n);
+                break;
+
+            case STMT_FUNC:
+                return FALSE;
+
+            case STMT_COND:
+                find_expr_bounds(stmt->info.cond.cond, values, n);
+                if (!find_stmts_bounds(stmt->info.cond.then_branch, values,
+                                       n)
+                    || !find_stmts_bounds(stmt->info.cond.else_branch,
+                                          values, n)) {
+                    return FALSE;
+                }
+                break;
+
+            case STMT_WHILE:
+                find_expr_bounds(stmt->info.loop.cond, values, n);
+                if (!find_stmts_bounds(stmt->info.loop.body, values, n)) {
+                    return FALSE;
+                }
+                break;
+        }
+    }
+    return TRUE;
+}
+
+// Add the bounds checked in an expression to values, as above
+void
+find_expr_bounds(Expr *expr, int *values, int *n) {
+    Exprs *offsets;
+    Intervals *bounds;
+    int i;
+    switch (expr->kind) {
+        case EXPR_BINOP:
+            find_expr_bounds(expr->e1, values, n);
+            find_expr_bounds(expr->e2, values, n);
+            break;
+
+        case EXPR_UNOP:
+            find_expr_bounds(expr->e1, values, n);
+            break;
+
+        case EXPR_ARRAY:
+            if (expr->access == NULL || !expr->access->is_in_static_bounds) {
+                break;
+            }
+            offsets = expr->access->dynamic_offsets;
+            bounds = expr->access->dynamic_bounds;
+            for (; offsets != NULL;
+                 offsets = offsets->rest, bounds = bounds->rest) {
+                int limits[2] = { bounds->first->lower, bounds->first->upper };
+                for (i = 0; i < 2; i++) {
+                    int k = 0;
+                    while (k < *n && values[k] != limits[i]) {
+                        k++;
+                    }
+                    if (k == *n && *n < MAX_BOUND_REGS) {
+                        values[(*n)++] = limits[i];
+                    }
+                }
+                find_expr_bounds(offsets->first, values, n);
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
 
 /*-----------------------------------------------------------------------------
  * Convert Wiz binary/unary operations into Oz structures
@@ -687,22 +1486,36 @@ gen_oz_expr_binop(OzProgram *p, int reg, Expr *expr, void *table) {
     int e1type = expr->e1->inferred_type;
     int e2type = expr->e2->inferred_type;
 
+    // a bool compared with a constant is the bool, or its negation
+    BOOL same;
+    Expr *test = bool_test(expr, &same);
+    if (test != NULL) {
+        if (same) {
+            gen_oz_expr(p, reg, test, table);
+        } else {
+            gen_binop(p, OP_NOT, reg, gen_oz_operand(p, reg, test, table));
+        }
+        return;
+    }
+
     // Eval sub expressions
     // evaluate the more register intensive sub-expression in reg, and the
-    // lower in reg+1, in order to minimise total register usage
-    int reg_usage_1 = get_reg_usage(expr->e1, table);
-    int reg_usage_2 = get_reg_usage(expr->e2, table);
-    int expr1_reg, expr2_reg;
-    if (reg_usage_1 >= reg_usage_2) {
-        expr1_reg = reg;
-        expr2_reg = reg + 1;
-        gen_oz_expr(p, reg, expr->e1, table);
-        gen_oz_expr(p, reg + 1, expr->e2, table);
+    // lower in reg+1, in order to minimise total register usage (unless
+    // reg-order is switched off, when e1 always goes first)
+    // (a variable kept in a register is used where it is)
+    int reg_usage_1 = expr->e1->reg_need;
+    int reg_usage_2 = expr->e2->reg_need;
+    int scratch1, scratch2, expr1_reg, expr2_reg;
+    if (reg_usage_1 >= reg_usage_2 || !pass_enabled(PASS_REG_ORDER)) {
+        scratch1 = reg;
+        scratch2 = reg + 1;
+        expr1_reg = gen_oz_operand(p, scratch1, expr->e1, table);
+        expr2_reg = gen_oz_operand(p, scratch2, expr->e2, table);
     } else {
-        expr1_reg = reg + 1;
-        expr2_reg = reg;
-        gen_oz_expr(p, reg, expr->e2, table);
-        gen_oz_expr(p, reg + 1, expr->e1, table);
+        scratch1 = reg + 1;
+        scratch2 = reg;
+        expr2_reg = gen_oz_operand(p, scratch2, expr->e2, table);
+        expr1_reg = gen_oz_operand(p, scratch1, expr->e1, table);
     }
 
     // check for div by 0
@@ -719,9 +1532,11 @@ gen_oz_expr_binop(OzProgram *p, int reg, Expr *expr, void *table) {
 
     // deal with operations with both int and float
     if (e1type == INT_TYPE && e2type == FLOAT_TYPE) {
-        gen_binop(p, OP_INT_TO_REAL, expr1_reg, expr1_reg);
+        gen_binop(p, OP_INT_TO_REAL, scratch1, expr1_reg);
+        expr1_reg = scratch1;
     } else if (e1type == FLOAT_TYPE && e2type == INT_TYPE) {
-        gen_binop(p, OP_INT_TO_REAL, expr2_reg, expr2_reg);
+        gen_binop(p, OP_INT_TO_REAL, scratch2, expr2_reg);
+        expr2_reg = scratch2;
     }
 
     // generate the code
@@ -862,27 +1677,44 @@ void
 gen_oz_expr_unop(OzProgram *p, int reg, Expr *expr, void *table) {
     Type t = expr->inferred_type;
 
+    // not of a comparison is the inverted comparison, and not of not is
+    // the value itself, so neither needs a not
+    if (expr->unop == UNOP_NOT) {
+        int inverse = inverted_compare(expr->e1);
+        if (inverse >= 0) {
+            Expr compare = *(expr->e1);
+            compare.binop = inverse;
+            gen_oz_expr_binop(p, reg, &compare, table);
+            return;
+        }
+        if (expr->e1->kind == EXPR_UNOP && expr->e1->unop == UNOP_NOT) {
+            gen_oz_expr(p, reg, expr->e1->e1, table);
+            return;
+        }
+    }
+
     // Eval sub expression
-    gen_oz_expr(p, reg, expr->e1, table);
+    int e1_reg = gen_oz_operand(p, reg, expr->e1, table);
 
     // Do we need to worry about converting float to int?
     if (t == FLOAT_TYPE && expr->e1->inferred_type == INT_TYPE) {
-        gen_binop(p, OP_INT_TO_REAL, reg, reg);
+        gen_binop(p, OP_INT_TO_REAL, reg, e1_reg);
+        e1_reg = reg;
     }
 
     // generate the op of this expr
     if (t == BOOL_TYPE && expr->unop == UNOP_NOT) {
-        gen_binop(p, OP_NOT, reg, reg);
+        gen_binop(p, OP_NOT, reg, e1_reg);
     }
 
     else if (t == INT_TYPE && expr->unop == UNOP_MINUS) {
         gen_int_const(p, reg + 1, 0);
-        gen_triop(p, OP_SUB_INT, reg, reg + 1, reg);
+        gen_triop(p, OP_SUB_INT, reg, reg + 1, e1_reg);
     }
 
     else if (t == FLOAT_TYPE && expr->unop == UNOP_MINUS) {
         gen_real_const(p, reg + 1, 0.0f);
-        gen_triop(p, OP_SUB_REAL, reg, reg + 1, reg);
+        gen_triop(p, OP_SUB_REAL, reg, reg + 1, e1_reg);
     }
 
     else {
@@ -891,18 +1723,122 @@ gen_oz_expr_unop(OzProgram *p, int reg, Expr *expr, void *table) {
 }
 
 
+// The comparison that holds exactly when expr does not, or -1 if expr is
+// not a comparison with one. An ordered comparison of reals has none, as
+// both it and its inverse are false when either side is not a number.
+int
+inverted_compare(Expr *expr) {
+    if (expr->kind != EXPR_BINOP) {
+        return -1;
+    }
+    BOOL real = expr->e1->inferred_type == FLOAT_TYPE
+                || expr->e2->inferred_type == FLOAT_TYPE;
+    switch (expr->binop) {
+        case BINOP_EQ:
+            return BINOP_NTEQ;
+
+        case BINOP_NTEQ:
+            return BINOP_EQ;
+
+        case BINOP_LT:
+            return real ? -1 : BINOP_GTEQ;
+
+        case BINOP_LTEQ:
+            return real ? -1 : BINOP_GT;
+
+        case BINOP_GT:
+            return real ? -1 : BINOP_LTEQ;
+
+        case BINOP_GTEQ:
+            return real ? -1 : BINOP_LT;
+
+        default:
+            return -1;
+    }
+}
+
+// If expr compares a bool with a constant (b = true, false != b, ...),
+// the bool it tests, with same set to whether expr equals it rather than
+// its negation. Otherwise NULL.
+Expr *
+bool_test(Expr *expr, BOOL *same) {
+    if (expr->kind != EXPR_BINOP
+        || (expr->binop != BINOP_EQ && expr->binop != BINOP_NTEQ)
+        || expr->e1->inferred_type != BOOL_TYPE
+        || expr->e2->inferred_type != BOOL_TYPE) {
+        return NULL;
+    }
+
+    Expr *constant = expr->e2, *test = expr->e1;
+    if (expr->e1->kind == EXPR_CONST) {
+        constant = expr->e1;
+        test = expr->e2;
+    }
+    if (constant->kind != EXPR_CONST) {
+        return NULL;
+    }
+    BOOL value = constant->constant.val.bool_val ? TRUE : FALSE;
+    *same = (value == (expr->binop == BINOP_EQ));
+    return test;
+}
+
+
 /*-----------------------------------------------------------------------------
-    Helper function for generating expression code with minimal register
-    usage (calculates the number of extra registes (not including the
-    register where result will be saved), needed to evaluate a given
-    expression
+    Helper functions for generating expression code with minimal register
+    usage. Before a proc is generated, every expression in it is numbered
+    bottom up, once per node, with the number of extra registers (not
+    including the register where the result will be saved) needed to
+    evaluate it, and each array expression gets its ArrayAccess. Code
+    generation then reads both straight off the nodes.
 -----------------------------------------------------------------------------*/
+void
+number_stmts(Stmts *stmts, void *table) {
+    Exprs *args;
+    while (stmts != NULL) {
+        Stmt *stmt = stmts->first;
+        switch (stmt->kind) {
+            case STMT_ASSIGN:
+            case STMT_BIND:
+            case STMT_ADVANCE:
+                number_expr(stmt->info.assign.asg_ident, table);
+                number_expr(stmt->info.assign.asg_expr, table);
+                break;
+
+            case STMT_READ:
+                number_expr(stmt->info.read, table);
+                break;
+
+            case STMT_WRITE:
+                number_expr(stmt->info.write, table);
+                break;
+
+            case STMT_FUNC:
+                for (args = stmt->info.func->args; args != NULL;
+                     args = args->rest) {
+                    number_expr(args->first, table);
+                }
+                break;
+
+            case STMT_COND:
+                number_expr(stmt->info.cond.cond, table);
+                number_stmts(stmt->info.cond.then_branch, table);
+                number_stmts(stmt->info.cond.else_branch, table);
+                break;
+
+            case STMT_WHILE:
+                number_expr(stmt->info.loop.cond, table);
+                number_stmts(stmt->info.loop.body, table);
+                break;
+        }
+        stmts = stmts->rest;
+    }
+}
+
+// Numbers an expression and its sub-expressions, returning its number
 int
-get_reg_usage(Expr *expr, void *table) {
+number_expr(Expr *expr, void *table) {
     int reg_usage_1, reg_usage_2, min_count, max_count, reg_usage_total;
     symbol *sym;
-    Bounds *bounds;
-    ArrayAccess *array_access;
     Exprs *exprs;
     // Switch based on expression kind
     switch (expr->kind) {
@@ -910,60 +1846,48 @@ get_reg_usage(Expr *expr, void *table) {
         case EXPR_CONST:
             // no exra registers needed in these cases
             // (no intermediates involved)
-            return 0;
+            reg_usage_total = 0;
             break;
 
         case EXPR_BINOP:
             // assuming our optimization to reduce unnecessary register usage,
             // we store the sub-expression with greater register usage in
             // reg, and the other in reg+1, so calculate accordingly
-            reg_usage_1 = get_reg_usage(expr->e1, table);
-            reg_usage_2 = get_reg_usage(expr->e2, table);
+            reg_usage_1 = number_expr(expr->e1, table);
+            reg_usage_2 = number_expr(expr->e2, table);
             min_count = min(reg_usage_1, reg_usage_2);
             max_count = max(reg_usage_1, reg_usage_2);
             reg_usage_total = max(max_count, min_count + 1);
             // if the binop expression is DIV, need at least one extra
             // register for comparison of RHS to zero
             if (expr->binop == BINOP_DIV) {
-                return max(reg_usage_total, 2);
-            } else {
-                return reg_usage_total;
+                reg_usage_total = max(reg_usage_total, 2);
             }
             break;
 
         case EXPR_UNOP:
             // for UNOP_MINUS case, use an additional register at least to
             // store the 0 for subtration
-            reg_usage_1 = get_reg_usage(expr->e1, table);
+            reg_usage_total = number_expr(expr->e1, table);
             if (expr->unop == UNOP_MINUS) {
-                return max(reg_usage_1, 1);
-            } else {
-                return reg_usage_1;
+                reg_usage_total = max(reg_usage_total, 1);
             }
             break;
 
         case EXPR_ARRAY:
-            // if array access is static do not need any extra regs
+            // the dynamic offsets are what gets evaluated, so they are
+            // numbered rather than the indices they were built from
             sym = retrieve_symbol_in_scope(expr->id, table);
-            bounds = sym->bounds;
-            array_access = get_array_access(expr, bounds);
-            exprs = array_access->dynamic_offsets;
-            if (exprs == NULL) {
-                return 0;
-            } else {
-                // otherwise need to compare to register usage of
-                // each index expression
-                reg_usage_total = 0;
-                while (exprs != NULL) {
-                    // each expr requires an extra register to save its
-                    // result, and in addition uses at least one additional
-                    // register for bounds checking
-                    reg_usage_1 = max(get_reg_usage(exprs->first,
-                                                    table) + 1, 2);
-                    reg_usage_total = max(reg_usage_1, reg_usage_total);
-                    exprs = exprs->rest;
-                }
-                return reg_usage_total;
+            expr->access = get_array_access(expr, sym->bounds);
+            reg_usage_total = 0;
+            exprs = expr->access->dynamic_offsets;
+            while (exprs != NULL) {
+                // each expr requires an extra register to save its
+                // result, and in addition uses at least one additional
+                // register for bounds checking
+                reg_usage_1 = max(number_expr(exprs->first, table) + 1, 2);
+                reg_usage_total = max(reg_usage_1, reg_usage_total);
+                exprs = exprs->rest;
             }
             break;
 
@@ -971,190 +1895,221 @@ get_reg_usage(Expr *expr, void *table) {
             report_error_and_exit("unknown expr type!");
             return 0; // never hit, but gcc complains otherwise
     }
+    expr->reg_need = reg_usage_total;
+    return reg_usage_total;
 }
 
 /*-----------------------------------------------------------------------------
  * Create new Oz structures to represent code
  *---------------------------------------------------------------------------*/
 
-// Add a new line to the end of the program, and return it
-OzLine *
-new_line(OzProgram *p) {
-    OzLine *new_line = checked_malloc(sizeof(OzLine));
-    OzLines *lines = checked_malloc(sizeof(OzLines));
-    lines->first = new_line;
-    lines->rest = NULL;
-
-    if (p->start == NULL) {
-        p->start = lines;
-        p->end = lines;
-    } else {
-        p->end->rest = lines;
-        p->end = lines;
+// Create an empty program, with room for its first lines and strings
+OzProgram *
+new_oz_program(void) {
+    OzProgram *p = checked_malloc(sizeof(OzProgram));
+    p->size = INITIAL_LINES;
+    p->nlines = 0;
+    p->lines = checked_malloc(p->size * sizeof(OzLine));
+    p->strings_size = INITIAL_STRINGS;
+    p->nstrings = 0;
+    p->strings = checked_malloc(p->strings_size * sizeof(char *));
+    return p;
+}
+
+char *
+oz_string(OzProgram *p, int id) {
+    return p->strings[id];
+}
+
+// Which args of an op are registers
+int
+oz_reg_args(OpCode code) {
+    switch (code) {
+        case OP_PUSH_STACK_FRAME: case OP_POP_STACK_FRAME: case OP_HALT:
+        case OP_BRANCH_UNCOND: case OP_BRANCH_PROC: case OP_CALL:
+        case OP_CALL_BUILTIN: case OP_RETURN: case OP_DEBUG_SLOT:
+        case OP_DEBUG_STACK:
+            return 0;
+
+        case OP_LOAD: case OP_LOAD_ADDRESS: case OP_INT_CONST:
+        case OP_REAL_CONST: case OP_STRING_CONST: case OP_BRANCH_ON_TRUE:
+        case OP_BRANCH_ON_FALSE: case OP_DEBUG_REG:
+            return REG_ARG1;
+
+        case OP_STORE:
+            return REG_ARG2;
+
+        case OP_LOAD_INDIRECT: case OP_STORE_INDIRECT: case OP_INT_TO_REAL:
+        case OP_MOVE: case OP_NOT:
+            return REG_ARG1 | REG_ARG2;
+
+        default:
+            return REG_ARG1 | REG_ARG2 | REG_ARG3;
+    }
+}
+
+// Whether an op writes the register in its first arg
+BOOL
+oz_writes_arg1(OpCode code) {
+    switch (code) {
+        case OP_STORE_INDIRECT: case OP_BRANCH_ON_TRUE:
+        case OP_BRANCH_ON_FALSE: case OP_DEBUG_REG:
+            return FALSE;
+
+        default:
+            return (oz_reg_args(code) & REG_ARG1) != 0;
     }
+}
 
-    return new_line;
+// Whether a line is the given op
+BOOL
+is_oz_op(OzLine *l, OpCode code) {
+    return l->kind == OZ_OP && l->code == code;
 }
 
-// Add a new (blank) OzOp to the end of the program, and return it
-OzOp *
-new_op(OzProgram *p) {
-    OzOp *new_op = checked_malloc(sizeof(OzOp));
-    new_op->arg1 = NULL;
-    new_op->arg2 = NULL;
-    new_op->arg3 = NULL;
+// Remove the dropped lines from a program, keeping the rest in order
+void
+drop_oz_lines(OzProgram *p, BOOL *dropped) {
+    int i, kept = 0;
+    for (i = 0; i < p->nlines; i++) {
+        if (!dropped[i]) {
+            p->lines[kept++] = p->lines[i];
+        }
+    }
+    p->nlines = kept;
+}
 
-    OzLine *line = new_line(p);
-    line->kind = OZ_OP;
-    line->val = (void *) new_op;
+// Add a new line to the end of the program, and return it. The array of
+// lines doubles when full, so adding a line takes constant amortised time
+// and no allocation of its own.
+OzLine *
+new_line(OzProgram *p, OzKind kind) {
+    if (p->nlines == p->size) {
+        p->size *= 2;
+        p->lines = checked_realloc(p->lines, p->size * sizeof(OzLine));
+    }
+
+    OzLine *line = &(p->lines[p->nlines++]);
+    line->kind = kind;
+    line->code = OP_HALT;
+    line->arg1 = 0;
+    line->arg2 = 0;
+    line->arg3 = 0;
+    line->real = 0.0f;
+    return line;
+}
+
+// Add a new op (with no operands yet) to the end of the program
+OzLine *
+new_op(OzProgram *p, OpCode code) {
+    OzLine *line = new_line(p, OZ_OP);
+    line->code = code;
+    return line;
+}
 
-    return new_op;
+// Add a string to the program's strings, returning its id
+int
+add_string(OzProgram *p, char *s) {
+    if (p->nstrings == p->strings_size) {
+        p->strings_size *= 2;
+        p->strings = checked_realloc(p->strings,
+                                     p->strings_size * sizeof(char *));
+    }
+    p->strings[p->nstrings] = s;
+    return p->nstrings++;
 }
 
 
 /*-----------------------------------------------------------------------------
  * Create Oz command for a particular operation, appending it to the end of the
  * program
- * All are self explanatory (gen_comment generates an OzComment, etc.)
+ * All are self explanatory (gen_comment generates an OZ_COMMENT line, etc.)
  *---------------------------------------------------------------------------*/
 
 void
 gen_comment(OzProgram *p, OzCommentSection section) {
-    OzComment *new_comment = checked_malloc(sizeof(OzComment));
-    new_comment->section = section;
-
-    OzLine *line = new_line(p);
-    line->kind = OZ_COMMENT;
-    line->val = (void *) new_comment;
+    new_line(p, OZ_COMMENT)->arg1 = section;
 }
 
 void
 gen_call(OzProgram *p, char *id) {
-    OzOp *op = new_op(p);
-    op->code = OP_CALL;
-    op->arg1 = id;
+    forget_bounds(TRUE);
+    new_op(p, OP_CALL)->arg1 = add_string(p, id);
 }
 
 void
-gen_call_builtin(OzProgram *p, OzBuiltinId id) {
-    OzBuiltin *b = checked_malloc(sizeof(OzBuiltin));
-    b->id = id;
+gen_branch_proc(OzProgram *p, char *id) {
+    forget_bounds(TRUE);
+    new_op(p, OP_BRANCH_PROC)->arg1 = add_string(p, id);
+}
 
-    OzLine *line = new_line(p);
-    line->kind = OZ_BUILTIN;
-    line->val = (void *) b;
+void
+gen_call_builtin(OzProgram *p, OzBuiltinId id) {
+    new_line(p, OZ_BUILTIN)->arg1 = id;
 }
 
 void
 gen_halt(OzProgram *p) {
-    OzOp *op = new_op(p);
-    op->code = OP_HALT;
+    new_op(p, OP_HALT);
 }
 
 void
 gen_return(OzProgram *p) {
-    OzOp *op = new_op(p);
-    op->code = OP_RETURN;
+    new_op(p, OP_RETURN);
 }
 
 void
 gen_proc_label(OzProgram *p, char *id) {
-    OzProc *proc = checked_malloc(sizeof(OzProc));
-    proc->id = id;
-
-    OzLine *line = new_line(p);
-    line->kind = OZ_PROC;
-    line->val = (void *) proc;
+    // a proc's bound registers are taken from the first, whatever the
+    // procs generated before it on this thread took
+    forget_bounds(TRUE);
+    next_bound_reg = 0;
+    new_line(p, OZ_PROC)->arg1 = add_string(p, id);
 }
 
 void
 gen_label(OzProgram *p, int id) {
-    OzLabel *label = checked_malloc(sizeof(OzLabel));
-    label->id = id;
-
-    OzLine *line = new_line(p);
-    line->kind = OZ_LABEL;
-    line->val = (void *) label;
+    forget_bounds(FALSE);
+    new_line(p, OZ_LABEL)->arg1 = id;
 }
 
 void
 gen_int_const(OzProgram *p, int reg, int val) {
-    int *preg = checked_malloc(sizeof(int));
-    *preg = reg;
-
-    int *pval = checked_malloc(sizeof(int));
-    *pval = val;
-
-    OzOp *op = new_op(p);
-    op->code = OP_INT_CONST;
-    op->arg1 = (void *) preg;
-    op->arg2 = (void *) pval;
+    OzLine *op = new_op(p, OP_INT_CONST);
+    op->arg1 = reg;
+    op->arg2 = val;
 }
 
 void
 gen_real_const(OzProgram *p, int reg, float val) {
-    int *preg = checked_malloc(sizeof(int));
-    *preg = reg;
-
-    float *pval = checked_malloc(sizeof(float));
-    *pval = val;
-
-    OzOp *op = new_op(p);
-    op->code = OP_REAL_CONST;
-    op->arg1 = (void *) preg;
-    op->arg2 = (void *) pval;
+    OzLine *op = new_op(p, OP_REAL_CONST);
+    op->arg1 = reg;
+    op->real = val;
 }
 
 void
 gen_string_const(OzProgram *p, int reg, char *val) {
-    int *preg = checked_malloc(sizeof(int));
-    *preg = reg;
-
-    OzOp *op = new_op(p);
-    op->code = OP_STRING_CONST;
-    op->arg1 = (void *) preg;
-    op->arg2 = (void *) val;
+    OzLine *op = new_op(p, OP_STRING_CONST);
+    op->arg1 = reg;
+    op->arg2 = add_string(p, val);
 }
 
 void
 gen_triop(OzProgram *p, OpCode code, int arg1, int arg2, int arg3) {
-    int *p1 = checked_malloc(sizeof(int));
-    *p1 = arg1;
-
-    int *p2 = checked_malloc(sizeof(int));
-    *p2 = arg2;
-
-    int *p3 = checked_malloc(sizeof(int));
-    *p3 = arg3;
-
-    OzOp *op = new_op(p);
-    op->code = code;
-    op->arg1 = (void *) p1;
-    op->arg2 = (void *) p2;
-    op->arg3 = (void *) p3;
+    OzLine *op = new_op(p, code);
+    op->arg1 = arg1;
+    op->arg2 = arg2;
+    op->arg3 = arg3;
 }
 
 void
 gen_binop(OzProgram *p, OpCode code, int arg1, int arg2) {
-    int *p1 = checked_malloc(sizeof(int));
-    *p1 = arg1;
-
-    int *p2 = checked_malloc(sizeof(int));
-    *p2 = arg2;
-
-    OzOp *op = new_op(p);
-    op->code = code;
-    op->arg1 = (void *) p1;
-    op->arg2 = (void *) p2;
+    OzLine *op = new_op(p, code);
+    op->arg1 = arg1;
+    op->arg2 = arg2;
 }
 
 void
 gen_unop(OzProgram *p, OpCode code, int arg1) {
-    int *p1 = checked_malloc(sizeof(int));
-    *p1 = arg1;
-
-    OzOp *op = new_op(p);
-    op->code = code;
-    op->arg1 = (void *) p1;
+    new_op(p, code)->arg1 = arg1;
 }
-
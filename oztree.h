@@ -33,7 +33,7 @@ typedef enum {
     OP_AND, OP_OR, OP_NOT,
 
     // Branching
-    OP_BRANCH_ON_TRUE, OP_BRANCH_ON_FALSE, OP_BRANCH_UNCOND,
+    OP_BRANCH_ON_TRUE, OP_BRANCH_ON_FALSE, OP_BRANCH_UNCOND, OP_BRANCH_PROC,
 
     // Function calling
     OP_CALL, OP_CALL_BUILTIN, OP_RETURN,
@@ -76,54 +76,91 @@ typedef enum {
     OZ_BUILTIN, OZ_PROC, OZ_LABEL, OZ_OP, OZ_COMMENT
 } OzKind;
 
-// how we represent which builtin we want to call
+// One "line" in Oz code. Lines are fixed size records held in place in
+// the program, with their operands inline:
+// - OZ_OP: the op's code, with its registers, slots, labels and int
+//   constants in arg1 to arg3, a real constant in real, and a proc name
+//   (call, branch to a proc) or string constant as a string id in arg1
+//   or arg2 respectively
+// - OZ_BUILTIN: the OzBuiltinId in arg1
+// - OZ_PROC: the string id of the proc's name in arg1
+// - OZ_LABEL: the label number in arg1
+// - OZ_COMMENT: the OzCommentSection in arg1
 typedef struct {
-    OzBuiltinId id;
-} OzBuiltin;
-
-// How we represent an Oz operation
-typedef struct {
-    OpCode code;
-    void   *arg1;
-    void   *arg2;
-    void   *arg3;
-} OzOp;
+    OzKind  kind;
+    OpCode  code;
+    int     arg1;
+    int     arg2;
+    int     arg3;
+    float   real;
+} OzLine;
 
-// A label for a section in code
+// Entire Oz program: its lines in order, in an array that doubles in size
+// when full, and the strings they refer to by id
 typedef struct {
-    int id;
-} OzLabel;
+    OzLine  *lines;
+    int     nlines;
+    int     size;
+    char    **strings;
+    int     nstrings;
+    int     strings_size;
+} OzProgram;
 
-// A label for a section in code
-typedef struct {
-    char *id;
-} OzProc;
 
-// Represent a comment indicating a section
-typedef struct {
-    OzCommentSection section;
-} OzComment;
+// Which args of an op are registers, as a mask of these
+#define REG_ARG1 1
+#define REG_ARG2 2
+#define REG_ARG3 4
 
-// One "line" in Oz code
-typedef struct {
-    OzKind kind;
-    void   *val;
-} OzLine;
+int oz_reg_args(OpCode code);
 
-// Linked list of ordered Oz lines
-typedef struct oozlines {
-    OzLine          *first;
-    struct oozlines *rest;
-} OzLines;
+// Whether an op writes the register in its first arg
+BOOL oz_writes_arg1(OpCode code);
 
-// Entire Oz program. Allow for skipping to end of linked list when compiling
-typedef struct {
-    OzLines *start;
-    OzLines *end;
-} OzProgram;
+// Whether a line is the given op
+BOOL is_oz_op(OzLine *l, OpCode code);
 
 
 // Create an Oz program struct from a Wiz AST
 OzProgram *gen_oz_program(Program *p, void *tables);
 
+// Generate the procs of a program on this many threads (1 by default).
+// The program made is the same whatever the number.
+void set_codegen_threads(int threads);
+
+// Create an empty Oz program
+OzProgram *new_oz_program(void);
+
+// The string with the given id
+char *oz_string(OzProgram *p, int id);
+
+// Remove the lines marked in dropped (one flag per line) from a program
+void drop_oz_lines(OzProgram *p, BOOL *dropped);
+
+// Add a line of the given kind, with its args zeroed, to the end of a
+// program and return it
+OzLine *new_line(OzProgram *p, OzKind kind);
+
+// Add a string to a program's strings, returning its id
+int add_string(OzProgram *p, char *s);
+
+/*-----------------------------------------------------------------------------
+ * Append a line to the end of a program
+ *---------------------------------------------------------------------------*/
+
+void gen_comment(OzProgram *p, OzCommentSection section);
+void gen_call(OzProgram *p, char *id);
+void gen_branch_proc(OzProgram *p, char *id);
+void gen_call_builtin(OzProgram *p, OzBuiltinId id);
+void gen_halt(OzProgram *p);
+void gen_return(OzProgram *p);
+void gen_proc_label(OzProgram *p, char *id);
+void gen_label(OzProgram *p, int id);
+void gen_int_const(OzProgram *p, int reg, int val);
+void gen_real_const(OzProgram *p, int reg, float val);
+void gen_string_const(OzProgram *p, int reg, char *val);
+void gen_triop(OzProgram *p, OpCode code, int arg1, int arg2, int arg3);
+void gen_binop(OzProgram *p, OpCode code, int arg1, int arg2);
+void gen_unop(OzProgram *p, OpCode code, int arg1);
+
 #endif /* OZTREE_H */
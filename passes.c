@@ -0,0 +1,501 @@
+/* passes.c */
+
+/*-----------------------------------------------------------------------
+    Developed by: #undef TEAMNAME
+    The pass manager, which decides which optimisations run from the
+    optimisation level and the -f<pass> / -fno-<pass> options, runs them
+    in order and can time each one.
+
+    The cheap passes that only tidy the program (removing dead procs and
+    branches, and reducing expressions) are run together until none of
+    them changes anything, after analysis and after each pass that can
+    give them more to do. A pass that does not count its changes is
+    taken to have changed the program if its fingerprint, a hash over
+    every node of the AST, is not the same afterwards. Fingerprints are
+    only taken where that is needed, or for -time-passes.
+
+    With -time-passes, a line is written to stderr for each pass run,
+    giving its wall time, the allocations it made, and the number of AST
+    and Oz nodes before and after it.
+-----------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/time.h>
+#include "passes.h"
+#include "analyse.h"
+#include "wizoptimiser.h"
+#include "callgraph.h"
+#include "specialise.h"
+#include "inliner.h"
+#include "unroll.h"
+#include "licm.h"
+#include "induction.h"
+#include "cse.h"
+#include "tailcall.h"
+#include "layout.h"
+#include "peephole.h"
+#include "helper.h"
+
+// Rounds of the cheap passes before giving up on a fixed point
+#define MAX_SIMPLIFY_ROUNDS 8
+
+// How a pass was set by name
+#define SET_BY_LEVEL 0
+#define SET_ON 1
+#define SET_OFF 2
+
+/*----------------------------------------------------------------------
+    Internal structures.
+-----------------------------------------------------------------------*/
+
+// A pass and the least level it runs at. Passes without a function are
+// settings read elsewhere, through pass_enabled. A pass that counts its
+// changes is trusted when it makes none.
+typedef struct {
+    char    *name;
+    int     level;
+    BOOL    switchable;
+    BOOL    counts;
+    int     (*run)(PassContext *ctx);
+} Pass;
+
+// The size and fingerprint of an AST
+typedef struct {
+    int         nodes;
+    unsigned    hash;
+} Fingerprint;
+
+/*----------------------------------------------------------------------
+    Internal function definitions.
+-----------------------------------------------------------------------*/
+int run_reduce(PassContext *ctx);
+int run_dead_procs(PassContext *ctx);
+int run_dead_branches(PassContext *ctx);
+int run_cse(PassContext *ctx);
+int run_specialise(PassContext *ctx);
+int run_inline(PassContext *ctx);
+int run_unroll(PassContext *ctx);
+int run_licm(PassContext *ctx);
+int run_strength_reduce(PassContext *ctx);
+int run_tail_calls(PassContext *ctx);
+int run_infer_types(PassContext *ctx);
+int run_codegen(PassContext *ctx);
+int run_layout(PassContext *ctx);
+int run_peephole(PassContext *ctx);
+
+int simplify(PassContext *ctx);
+
+void fingerprint_program(Program *prog, Fingerprint *fp);
+void fingerprint_stmts(Stmts *stmts, Fingerprint *fp);
+void fingerprint_expr(Expr *e, Fingerprint *fp);
+void mix(Fingerprint *fp, unsigned value);
+void mix_string(Fingerprint *fp, char *s);
+int count_oz_lines(OzProgram *oz);
+double now_ms(void);
+
+/*----------------------------------------------------------------------
+    The passes, in the order of PassId
+-----------------------------------------------------------------------*/
+Pass passes[NUM_PASSES] = {
+    { "reduce",             1,  TRUE,   TRUE,   run_reduce },
+    { "dead-procs",         1,  TRUE,   TRUE,   run_dead_procs },
+    { "dead-branches",      1,  TRUE,   FALSE,  run_dead_branches },
+    { "cse",                1,  TRUE,   FALSE,  run_cse },
+    { "array-folding",      1,  TRUE,   FALSE,  NULL },
+    { "reg-order",          1,  TRUE,   FALSE,  NULL },
+    { "rotate-loops",       1,  TRUE,   FALSE,  NULL },
+    { "bound-regs",         1,  TRUE,   FALSE,  NULL },
+    { "layout",             1,  TRUE,   TRUE,   run_layout },
+    { "peephole",           1,  TRUE,   TRUE,   run_peephole },
+    { "specialise",         2,  TRUE,   TRUE,   run_specialise },
+    { "inline",             2,  TRUE,   TRUE,   run_inline },
+    { "unroll",             2,  TRUE,   TRUE,   run_unroll },
+    { "licm",               2,  TRUE,   FALSE,  run_licm },
+    { "strength-reduce",    2,  TRUE,   FALSE,  run_strength_reduce },
+    { "tail-calls",         2,  TRUE,   TRUE,   run_tail_calls },
+    { "regalloc",           2,  TRUE,   FALSE,  NULL },
+    { "hash-cons",          3,  TRUE,   FALSE,  NULL },
+    { "infer-types",        0,  FALSE,  TRUE,   run_infer_types },
+    { "codegen",            0,  FALSE,  TRUE,   run_codegen }
+};
+
+int opt_level = DEFAULT_OPT_LEVEL;
+int pass_settings[NUM_PASSES];  /* SET_BY_LEVEL unless named */
+BOOL time_passes = FALSE;
+BOOL printed_header = FALSE;
+BOOL simplifying = FALSE;   /* in the cheap passes' fixed point */
+Fingerprint last_reduced = { -1, 0 };   /* the program reduce last left */
+BOOL types_stale = FALSE;   /* reduce has left untyped nodes since analysis */
+
+/*----------------------------------------------------------------------
+    Function implementations
+-----------------------------------------------------------------------*/
+
+void set_opt_level(int level) {
+    opt_level = level;
+}
+
+BOOL set_pass_option(char *arg) {
+    if (strncmp(arg, "-f", 2) != 0) {
+        return FALSE;
+    }
+    char *name = arg + 2;
+    BOOL on = TRUE;
+    if (strncmp(name, "no-", 3) == 0) {
+        name += 3;
+        on = FALSE;
+    }
+    int i;
+    for (i = 0; i < NUM_PASSES; i++) {
+        if (passes[i].switchable && streq(passes[i].name, name)) {
+            pass_settings[i] = on ? SET_ON : SET_OFF;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+void set_time_passes(BOOL on) {
+    time_passes = on;
+}
+
+void configure_passes(void) {
+    set_hash_consing(pass_enabled(PASS_HASH_CONS));
+}
+
+BOOL pass_enabled(PassId id) {
+    if (pass_settings[id] != SET_BY_LEVEL) {
+        return pass_settings[id] == SET_ON;
+    }
+    return opt_level >= passes[id].level;
+}
+
+int run_pass(PassId id, PassContext *ctx) {
+    Pass *pass = &passes[id];
+    if (pass->run == NULL || !pass_enabled(id)) {
+        return 0;
+    }
+
+    // a pass that does not count its changes is only fingerprinted when
+    // something will look at them
+    BOOL measure = time_passes || (simplifying && !pass->counts);
+    Fingerprint before, after;
+    if (measure) {
+        fingerprint_program(ctx->prog, &before);
+    }
+    int oz_before = count_oz_lines(ctx->oz);
+    long allocs = allocations_made();
+    double start = now_ms();
+
+    int changes = pass->run(ctx);
+
+    double ms = now_ms() - start;
+    allocs = allocations_made() - allocs;
+    if (measure) {
+        fingerprint_program(ctx->prog, &after);
+    }
+    if (measure && !pass->counts && changes == 0
+        && (before.nodes != after.nodes || before.hash != after.hash)) {
+        changes = 1;
+    }
+
+    if (time_passes) {
+        if (!printed_header) {
+            fprintf(stderr, "%-16s %10s %10s %10s %10s %10s %10s\n",
+                    "pass", "ms", "allocs", "ast before", "ast after",
+                    "oz before", "oz after");
+            printed_header = TRUE;
+        }
+        fprintf(stderr, "%-16s %10.3f %10ld %10d %10d %10d %10d\n",
+                pass->name, ms, allocs, before.nodes, after.nodes,
+                oz_before, count_oz_lines(ctx->oz));
+    }
+    return changes;
+}
+
+// Specialising, inlining and unrolling leave constants for the cheap
+// passes to fold, and new nodes whose types must be inferred. Reduce
+// rebuilds constants untyped even when the program is otherwise the same.
+void optimise_program(PassContext *ctx) {
+    if (simplify(ctx) > 0 || types_stale) {
+        run_pass(PASS_INFER_TYPES, ctx);
+    }
+    if (run_pass(PASS_SPECIALISE, ctx) > 0) {
+        simplify(ctx);
+        run_pass(PASS_INFER_TYPES, ctx);
+    }
+    if (run_pass(PASS_INLINE, ctx) > 0) {
+        simplify(ctx);
+        run_pass(PASS_INFER_TYPES, ctx);
+    }
+    if (run_pass(PASS_UNROLL, ctx) > 0) {
+        simplify(ctx);
+        run_pass(PASS_INFER_TYPES, ctx);
+    }
+    run_pass(PASS_LICM, ctx);
+    run_pass(PASS_STRENGTH_REDUCE, ctx);
+    run_pass(PASS_CSE, ctx);
+    run_pass(PASS_TAIL_CALLS, ctx);
+}
+
+void generate_program(PassContext *ctx) {
+    run_pass(PASS_CODEGEN, ctx);
+    run_pass(PASS_LAYOUT, ctx);
+    run_pass(PASS_PEEPHOLE, ctx);
+    if (time_passes && pass_enabled(PASS_PEEPHOLE)) {
+        print_peephole_hits(stderr);
+    }
+}
+
+void print_pass_names(FILE *fp) {
+    int level, i;
+    for (level = 1; level <= MAX_OPT_LEVEL; level++) {
+        fprintf(fp, "\t      -O%d:", level);
+        for (i = 0; i < NUM_PASSES; i++) {
+            if (passes[i].switchable && passes[i].level == level) {
+                fprintf(fp, " %s", passes[i].name);
+            }
+        }
+        fprintf(fp, "\n");
+    }
+}
+
+// Runs the cheap passes until they stop changing the program. Returns
+// the number of changes made.
+int simplify(PassContext *ctx) {
+    int total = 0;
+    int round;
+    simplifying = TRUE;
+    for (round = 0; round < MAX_SIMPLIFY_ROUNDS; round++) {
+        int changes = run_pass(PASS_DEAD_PROCS, ctx)
+                      + run_pass(PASS_REDUCE, ctx)
+                      + run_pass(PASS_DEAD_BRANCHES, ctx);
+        if (changes == 0) {
+            break;
+        }
+        total += changes;
+    }
+    simplifying = FALSE;
+    return total;
+}
+
+/*----------------------------------------------------------------------
+    The passes, adapted to take a context
+-----------------------------------------------------------------------*/
+
+// Reduction may reorder the operands of commutative operators each time
+// it runs, so it never reaches a fixed point by itself. It is skipped
+// when the program is the same as when it last ran.
+int run_reduce(PassContext *ctx) {
+    Fingerprint before;
+    fingerprint_program(ctx->prog, &before);
+    if (before.nodes == last_reduced.nodes
+        && before.hash == last_reduced.hash) {
+        return 0;
+    }
+    reduce_ast(ctx->prog);
+    if (ctx->table != NULL) {
+        types_stale = TRUE;
+    }
+    fingerprint_program(ctx->prog, &last_reduced);
+    return before.nodes != last_reduced.nodes
+           || before.hash != last_reduced.hash;
+}
+
+// Run before analysis too, so that procs main never calls are neither
+// analysed nor compiled. With the pass off every proc is analysed, and
+// all errors are reported.
+int run_dead_procs(PassContext *ctx) {
+    return remove_unreachable_procs(ctx->prog, build_call_graph(ctx->prog));
+}
+
+// Branches are only removed once analysis has checked them
+int run_dead_branches(PassContext *ctx) {
+    if (ctx->table == NULL) {
+        return 0;
+    }
+    remove_dead_branches(ctx->prog);
+    return 0;
+}
+
+int run_cse(PassContext *ctx) {
+    eliminate_common_subexpressions(ctx->prog, ctx->table);
+    return 0;
+}
+
+int run_specialise(PassContext *ctx) {
+    return specialise_procs(ctx->prog, ctx->table, MAX_CLONES);
+}
+
+int run_inline(PassContext *ctx) {
+    return inline_procs(ctx->prog, ctx->table, INLINE_THRESHOLD);
+}
+
+int run_unroll(PassContext *ctx) {
+    return unroll_loops(ctx->prog, ctx->table);
+}
+
+int run_licm(PassContext *ctx) {
+    hoist_loop_invariants(ctx->prog, ctx->table);
+    return 0;
+}
+
+int run_strength_reduce(PassContext *ctx) {
+    strength_reduce_loops(ctx->prog, ctx->table);
+    return 0;
+}
+
+int run_tail_calls(PassContext *ctx) {
+    return mark_tail_calls(ctx->prog, ctx->table);
+}
+
+int run_infer_types(PassContext *ctx) {
+    infer_types(ctx->prog, ctx->table);
+    types_stale = FALSE;
+    return 0;
+}
+
+int run_codegen(PassContext *ctx) {
+    ctx->oz = gen_oz_program(ctx->prog, ctx->table);
+    return 0;
+}
+
+int run_layout(PassContext *ctx) {
+    return layout_program(ctx->oz);
+}
+
+int run_peephole(PassContext *ctx) {
+    return peephole_optimise(ctx->oz);
+}
+
+/*----------------------------------------------------------------------
+    Measuring the program
+-----------------------------------------------------------------------*/
+
+void fingerprint_program(Program *prog, Fingerprint *fp) {
+    fp->nodes = 0;
+    fp->hash = 0;
+    Procs *procs;
+    for (procs = prog->procedures; procs != NULL; procs = procs->rest) {
+        Proc *proc = procs->first;
+        fp->nodes++;
+        mix_string(fp, proc->header->id);
+        Params *params;
+        for (params = proc->header->params; params != NULL;
+             params = params->rest) {
+            mix_string(fp, params->first->id);
+        }
+        fingerprint_stmts(proc->body->statements, fp);
+    }
+}
+
+void fingerprint_stmts(Stmts *stmts, Fingerprint *fp) {
+    for (; stmts != NULL; stmts = stmts->rest) {
+        Stmt *stmt = stmts->first;
+        Exprs *args;
+        fp->nodes++;
+        mix(fp, stmt->kind);
+
+        switch (stmt->kind) {
+            case STMT_ASSIGN:
+            case STMT_BIND:
+            case STMT_ADVANCE:
+                fingerprint_expr(stmt->info.assign.asg_ident, fp);
+                fingerprint_expr(stmt->info.assign.asg_expr, fp);
+                break;
+
+            case STMT_COND:
+                fingerprint_expr(stmt->info.cond.cond, fp);
+                fingerprint_stmts(stmt->info.cond.then_branch, fp);
+                mix(fp, STMT_COND);
+                fingerprint_stmts(stmt->info.cond.else_branch, fp);
+                break;
+
+            case STMT_WHILE:
+                fingerprint_expr(stmt->info.loop.cond, fp);
+                fingerprint_stmts(stmt->info.loop.body, fp);
+                break;
+
+            case STMT_READ:
+                fingerprint_expr(stmt->info.read, fp);
+                break;
+
+            case STMT_WRITE:
+                fingerprint_expr(stmt->info.write, fp);
+                break;
+
+            case STMT_FUNC:
+                mix_string(fp, stmt->info.func->id);
+                for (args = stmt->info.func->args; args != NULL;
+                     args = args->rest) {
+                    fingerprint_expr(args->first, fp);
+                }
+                break;
+        }
+    }
+}
+
+void fingerprint_expr(Expr *e, Fingerprint *fp) {
+    Exprs *indices;
+    uint32_t bits;
+    fp->nodes++;
+    mix(fp, e->kind);
+
+    switch (e->kind) {
+        case EXPR_ID:
+            mix_string(fp, e->id);
+            break;
+
+        case EXPR_CONST:
+            mix(fp, e->constant.type);
+            if (e->constant.type == STRING_CONST) {
+                mix_string(fp, e->constant.val.string);
+            } else if (e->constant.type == FLOAT_TYPE) {
+                memcpy(&bits, &(e->constant.val.float_val), sizeof(bits));
+                mix(fp, bits);
+            } else {
+                mix(fp, (unsigned) e->constant.val.int_val);
+            }
+            break;
+
+        case EXPR_BINOP:
+            mix(fp, e->binop);
+            fingerprint_expr(e->e1, fp);
+            fingerprint_expr(e->e2, fp);
+            break;
+
+        case EXPR_UNOP:
+            mix(fp, e->unop);
+            fingerprint_expr(e->e1, fp);
+            break;
+
+        case EXPR_ARRAY:
+            mix_string(fp, e->id);
+            for (indices = e->indices; indices != NULL;
+                 indices = indices->rest) {
+                fingerprint_expr(indices->first, fp);
+            }
+            break;
+    }
+}
+
+void mix(Fingerprint *fp, unsigned value) {
+    fp->hash = (fp->hash ^ value) * 16777619u;
+}
+
+void mix_string(Fingerprint *fp, char *s) {
+    while (*s != '\0') {
+        fp->hash = (fp->hash ^ (unsigned char) *s++) * 16777619u;
+    }
+}
+
+int count_oz_lines(OzProgram *oz) {
+    return oz == NULL ? 0 : oz->nlines;
+}
+
+double now_ms(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
@@ -0,0 +1,82 @@
+/* passes.h */
+
+/*-----------------------------------------------------------------------
+    Developed by: #undef TEAMNAME
+    Provides function definitions and external access rights for
+    passes.c
+-----------------------------------------------------------------------*/
+#ifndef PASSES_H
+#define PASSES_H
+
+#include <stdio.h>
+#include "ast.h"
+#include "symbol.h"
+#include "oztree.h"
+
+/*----------------------------------------------------------------------
+    Passes known to the pass manager. Each pass runs at and above the
+    optimisation level it is listed under, unless switched on or off by
+    name. infer-types and codegen always run, and are listed only so
+    that they are timed.
+-----------------------------------------------------------------------*/
+typedef enum {
+    // -O1
+    PASS_REDUCE, PASS_DEAD_PROCS, PASS_DEAD_BRANCHES, PASS_CSE,
+    PASS_ARRAY_FOLDING, PASS_REG_ORDER, PASS_ROTATE_LOOPS, PASS_BOUND_REGS,
+    PASS_LAYOUT, PASS_PEEPHOLE,
+    // -O2
+    PASS_SPECIALISE, PASS_INLINE, PASS_UNROLL, PASS_LICM,
+    PASS_STRENGTH_REDUCE, PASS_TAIL_CALLS, PASS_REGALLOC,
+    // -O3
+    PASS_HASH_CONS,
+    // always
+    PASS_INFER_TYPES, PASS_CODEGEN,
+    NUM_PASSES
+} PassId;
+
+// The level used when none is given
+#define DEFAULT_OPT_LEVEL 2
+#define MAX_OPT_LEVEL 3
+
+// What a pass works on. oz is NULL until the program is generated.
+typedef struct {
+    Program     *prog;
+    sym_table   *table;
+    OzProgram   *oz;
+} PassContext;
+
+/*----------------------------------------------------------------------
+    External Functions that will be accessed by other C files.
+-----------------------------------------------------------------------*/
+// Sets the optimisation level (0 to 3). Passes switched on or off by
+// name keep their setting whatever the level.
+void set_opt_level(int level);
+
+// Handles a -f<pass> or -fno-<pass> option. Returns FALSE if the option
+// names no pass that can be switched.
+BOOL set_pass_option(char *arg);
+
+// Reports each pass run, with its time and the size of the program
+// before and after, to stderr
+void set_time_passes(BOOL on);
+
+// Applies the settings that are not run as passes. Call once the options
+// have been read, before anything is reduced.
+void configure_passes(void);
+
+BOOL pass_enabled(PassId id);
+
+// Runs a pass if it is enabled. Returns the number of changes it made,
+// or 1 if it does not count them and the program is no longer the same.
+int run_pass(PassId id, PassContext *ctx);
+
+// Optimises an analysed program with the enabled passes
+void optimise_program(PassContext *ctx);
+
+// Generates the Oz program into ctx->oz
+void generate_program(PassContext *ctx);
+
+// Writes the names of the passes and their levels, for usage messages
+void print_pass_names(FILE *fp);
+
+#endif
@@ -0,0 +1,319 @@
+/* peephole.c */
+
+/*-----------------------------------------------------------------------
+    Developed by: #undef TEAMNAME
+    A peephole optimiser over the generated Oz program, run before it is
+    printed.
+
+    A window slides over the program, holding the next few lines from
+    each position. Comments are skipped, and the window ends at the first
+    line another part of the program can reach (a label or proc) or that
+    changes registers behind its back (a builtin call), so everything in
+    the window runs in order. Each rule in the table below is tried on
+    the window in turn; a rule that matches drops or rewrites lines, and
+    counts a hit. The program is swept until no rule matches, and the
+    dropped lines are then removed.
+
+    No rule assumes a register is dead, so each rewrite leaves every
+    register and slot as it was, and can be checked on its own lines.
+-----------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include "peephole.h"
+#include "helper.h"
+
+// The most lines a rule can look at
+#define WINDOW 6
+
+/*----------------------------------------------------------------------
+    Internal structures.
+-----------------------------------------------------------------------*/
+
+// The lines in the window, as indices into the program
+typedef struct {
+    OzProgram   *p;
+    BOOL        *dropped;
+    int         at[WINDOW];
+    int         n;
+} Window;
+
+// A rule, the fewest lines it needs, and how often it has applied
+typedef struct {
+    char    *name;
+    int     length;
+    BOOL    (*apply)(Window *w);
+    int     hits;
+} Rule;
+
+/*----------------------------------------------------------------------
+    Internal function definitions.
+-----------------------------------------------------------------------*/
+BOOL store_load(Window *w);
+BOOL const_reload(Window *w);
+BOOL const_div_check(Window *w);
+BOOL negate_const(Window *w);
+BOOL branch_to_next(Window *w);
+BOOL unreachable(Window *w);
+
+void fill_window(Window *w, int from);
+OzLine *line(Window *w, int k);
+void drop(Window *w, int k);
+BOOL writes_reg(OzLine *l, int reg);
+BOOL same_const(OzLine *a, OzLine *b);
+
+/*----------------------------------------------------------------------
+    The rules, tried in order. Each shows the lines it matches, and what
+    they become.
+-----------------------------------------------------------------------*/
+Rule rules[] = {
+    // store s, rX              store s, rX
+    // load rX, s           =>
+    { "store-load",         2,  store_load,         0 },
+
+    // int_const rX, k          int_const rX, k
+    // ...                      ...
+    // int_const rX, k      =>  (rX not written in between)
+    { "const-reload",       2,  const_reload,       0 },
+
+    // int_const rX, k          int_const rX, k
+    // int_const rY, 0          int_const rY, 0
+    // cmp_eq_int rY, rY, rX
+    // branch_on_true rY, L =>  (k not 0, so rY stays 0)
+    { "const-div-check",    4,  const_div_check,    0 },
+
+    // int_const rX, k
+    // int_const rY, 0          int_const rY, 0
+    // sub_int rX, rY, rX   =>  int_const rX, -k    (or the real versions)
+    { "negate-const",       3,  negate_const,       0 },
+
+    // branch_uncond L
+    // L:                   =>  L:  (or a conditional branch to L)
+    { "branch-to-next",     2,  branch_to_next,     0 },
+
+    // branch_uncond L          branch_uncond L
+    // <op>                 =>  (until the next label; also after
+    //                          return, halt or a branch to a proc)
+    { "unreachable",        2,  unreachable,        0 }
+};
+
+#define NUM_RULES ((int) (sizeof(rules) / sizeof(Rule)))
+
+/*----------------------------------------------------------------------
+    Function implementations
+-----------------------------------------------------------------------*/
+
+int peephole_optimise(OzProgram *p) {
+    Window w;
+    w.p = p;
+    w.dropped = checked_malloc(p->nlines * sizeof(BOOL));
+    int i, r;
+    for (i = 0; i < p->nlines; i++) {
+        w.dropped[i] = FALSE;
+    }
+
+    int total = 0, hits;
+    do {
+        hits = 0;
+        for (i = 0; i < p->nlines; i++) {
+            if (w.dropped[i] || p->lines[i].kind == OZ_COMMENT) {
+                continue;
+            }
+            fill_window(&w, i);
+            for (r = 0; r < NUM_RULES; r++) {
+                if (w.n >= rules[r].length && rules[r].apply(&w)) {
+                    rules[r].hits++;
+                    hits++;
+                    // try every rule again on what is now here
+                    fill_window(&w, i);
+                    r = -1;
+                    if (w.dropped[i]) {
+                        break;
+                    }
+                }
+            }
+        }
+        total += hits;
+    } while (hits > 0);
+
+    drop_oz_lines(p, w.dropped);
+    free(w.dropped);
+    return total;
+}
+
+void print_peephole_hits(FILE *fp) {
+    int r;
+    for (r = 0; r < NUM_RULES; r++) {
+        fprintf(fp, "  %-20s %10d hits\n", rules[r].name, rules[r].hits);
+    }
+}
+
+/*----------------------------------------------------------------------
+    Rules. Each returns TRUE if it changed the program.
+-----------------------------------------------------------------------*/
+
+BOOL store_load(Window *w) {
+    OzLine *store = line(w, 0), *load = line(w, 1);
+    if (is_oz_op(store, OP_STORE) && is_oz_op(load, OP_LOAD)
+        && load->arg1 == store->arg2 && load->arg2 == store->arg1) {
+        drop(w, 1);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+BOOL const_reload(Window *w) {
+    OzLine *first = line(w, 0);
+    if (!is_oz_op(first, OP_INT_CONST) && !is_oz_op(first, OP_REAL_CONST)) {
+        return FALSE;
+    }
+    int k;
+    for (k = 1; k < w->n; k++) {
+        OzLine *l = line(w, k);
+        if (same_const(first, l)) {
+            drop(w, k);
+            return TRUE;
+        }
+        if (writes_reg(l, first->arg1)) {
+            return FALSE;
+        }
+    }
+    return FALSE;
+}
+
+BOOL const_div_check(Window *w) {
+    OzLine *divisor = line(w, 0), *zero = line(w, 1);
+    OzLine *cmp = line(w, 2), *branch = line(w, 3);
+    if (is_oz_op(divisor, OP_INT_CONST) && divisor->arg2 != 0
+        && is_oz_op(zero, OP_INT_CONST) && zero->arg2 == 0
+        && zero->arg1 != divisor->arg1
+        && is_oz_op(cmp, OP_CMP_EQ_INT) && cmp->arg1 == zero->arg1
+        && cmp->arg2 == zero->arg1 && cmp->arg3 == divisor->arg1
+        && is_oz_op(branch, OP_BRANCH_ON_TRUE) && branch->arg1 == zero->arg1) {
+        drop(w, 2);
+        drop(w, 3);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+BOOL negate_const(Window *w) {
+    OzLine *value = line(w, 0), *zero = line(w, 1), *sub = line(w, 2);
+    int x = value->arg1, y = zero->arg1;
+    if (x == y || sub->kind != OZ_OP || sub->arg1 != x || sub->arg2 != y
+        || sub->arg3 != x) {
+        return FALSE;
+    }
+    if (is_oz_op(value, OP_INT_CONST) && is_oz_op(zero, OP_INT_CONST)
+        && zero->arg2 == 0 && sub->code == OP_SUB_INT
+        && value->arg2 != INT_MIN) {
+        sub->code = OP_INT_CONST;
+        sub->arg2 = -value->arg2;
+    } else if (is_oz_op(value, OP_REAL_CONST) && is_oz_op(zero, OP_REAL_CONST)
+               && zero->real == 0.0f && sub->code == OP_SUB_REAL) {
+        sub->code = OP_REAL_CONST;
+        sub->real = -value->real;
+    } else {
+        return FALSE;
+    }
+    sub->arg3 = 0;
+    drop(w, 0);
+    return TRUE;
+}
+
+BOOL branch_to_next(Window *w) {
+    OzLine *branch = line(w, 0), *label = line(w, 1);
+    if (label->kind != OZ_LABEL) {
+        return FALSE;
+    }
+    if ((is_oz_op(branch, OP_BRANCH_UNCOND) && branch->arg1 == label->arg1)
+        || ((is_oz_op(branch, OP_BRANCH_ON_TRUE)
+             || is_oz_op(branch, OP_BRANCH_ON_FALSE))
+            && branch->arg2 == label->arg1)) {
+        drop(w, 0);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+BOOL unreachable(Window *w) {
+    OzLine *jump = line(w, 0), *next = line(w, 1);
+    if (!is_oz_op(jump, OP_BRANCH_UNCOND) && !is_oz_op(jump, OP_BRANCH_PROC)
+        && !is_oz_op(jump, OP_RETURN) && !is_oz_op(jump, OP_HALT)) {
+        return FALSE;
+    }
+    if (next->kind == OZ_OP || next->kind == OZ_BUILTIN) {
+        drop(w, 1);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/*----------------------------------------------------------------------
+    The window
+-----------------------------------------------------------------------*/
+
+// Fills the window with the lines from a position, skipping comments and
+// dropped lines, and ending after any line other than an op
+void fill_window(Window *w, int from) {
+    OzProgram *p = w->p;
+    int i;
+    w->n = 0;
+    for (i = from; i < p->nlines && w->n < WINDOW; i++) {
+        if (w->dropped[i] || p->lines[i].kind == OZ_COMMENT) {
+            continue;
+        }
+        w->at[w->n++] = i;
+        if (p->lines[i].kind != OZ_OP && i != from) {
+            break;
+        }
+    }
+}
+
+OzLine *line(Window *w, int k) {
+    return &(w->p->lines[w->at[k]]);
+}
+
+void drop(Window *w, int k) {
+    w->dropped[w->at[k]] = TRUE;
+}
+
+// Whether a line may change a register. Builtins and calls change any.
+BOOL writes_reg(OzLine *l, int reg) {
+    if (l->kind != OZ_OP) {
+        return TRUE;
+    }
+    switch (l->code) {
+        case OP_PUSH_STACK_FRAME:
+        case OP_POP_STACK_FRAME:
+        case OP_STORE:
+        case OP_STORE_INDIRECT:
+        case OP_BRANCH_ON_TRUE:
+        case OP_BRANCH_ON_FALSE:
+        case OP_BRANCH_UNCOND:
+        case OP_DEBUG_REG:
+        case OP_DEBUG_SLOT:
+        case OP_DEBUG_STACK:
+            return FALSE;
+
+        case OP_CALL:
+        case OP_BRANCH_PROC:
+        case OP_RETURN:
+        case OP_HALT:
+            return TRUE;
+
+        default:
+            // every other op writes its first operand
+            return l->arg1 == reg;
+    }
+}
+
+BOOL same_const(OzLine *a, OzLine *b) {
+    if (b->kind != OZ_OP || b->code != a->code || b->arg1 != a->arg1) {
+        return FALSE;
+    }
+    if (a->code == OP_INT_CONST) {
+        return b->arg2 == a->arg2;
+    }
+    return b->real == a->real;
+}
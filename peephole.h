@@ -0,0 +1,25 @@
+/* peephole.h */
+
+/*-----------------------------------------------------------------------
+    Developed by: #undef TEAMNAME
+    Provides function definitions and external access rights for
+    peephole.c
+-----------------------------------------------------------------------*/
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include <stdio.h>
+#include "ast.h"
+#include "oztree.h"
+
+/*----------------------------------------------------------------------
+    External Functions that will be accessed by other C files.
+-----------------------------------------------------------------------*/
+// Rewrites short sequences of instructions in a generated program into
+// cheaper ones, until no rule applies. Returns the number of rewrites.
+int peephole_optimise(OzProgram *p);
+
+// Writes how many times each rule has applied
+void print_peephole_hits(FILE *fp);
+
+#endif
@@ -0,0 +1,427 @@
+/* peephole_check.c */
+
+/*-----------------------------------------------------------------------
+    Developed by: #undef TEAMNAME
+    Checks the peephole optimiser's rules on small pieces of Oz code.
+
+    Each case gives some Oz text before the peephole optimiser runs, and
+    the text it should leave. Both are read into programs; the first is
+    optimised, and the two are then written out as wiz would write them
+    and compared. Cases named "...-kept" are ones a rule must not touch.
+    Operands are separated by commas, so string constants in the cases
+    cannot hold commas.
+
+    Usage: peephole_check
+    Writes a line per case, and exits with 1 if any case fails.
+-----------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ast.h"
+#include "oztree.h"
+#include "peephole.h"
+#include "emit.h"
+#include "helper.h"
+
+#define NUM_OPS (OP_DEBUG_STACK + 1)
+#define NUM_SECTIONS (SECTION_EPILOGUE + 1)
+#define NUM_BUILTINS (BUILTIN_PRINT_STRING + 1)
+
+/*----------------------------------------------------------------------
+    Internal structures.
+-----------------------------------------------------------------------*/
+
+// Some Oz code, and what the peephole optimiser should turn it into
+typedef struct {
+    char    *name;
+    char    *before;
+    char    *after;
+} Case;
+
+/*----------------------------------------------------------------------
+    Internal function definitions.
+-----------------------------------------------------------------------*/
+BOOL check_case(Case *c);
+OzProgram *parse_oz_text(char *text);
+void parse_line(OzProgram *p, char *s);
+void parse_op(OzProgram *p, char *mnemonic, char *operands);
+int find_name_index(const char **names, int n, char *s);
+char *split_operand(char **s);
+char *trim_spaces(char *s);
+char *written_text(OzProgram *p);
+
+/*----------------------------------------------------------------------
+    The cases, roughly in the order of the rules in peephole.c
+-----------------------------------------------------------------------*/
+Case cases[] = {
+    { "store-load",
+      "store 3, r0\n"
+      "load r0, 3\n",
+      "store 3, r0\n" },
+
+    { "store-load-other-reg-kept",
+      "store 3, r0\n"
+      "load r1, 3\n",
+      "store 3, r0\n"
+      "load r1, 3\n" },
+
+    { "store-load-over-comment",
+      "store 3, r0\n"
+      "# assignment\n"
+      "load r0, 3\n",
+      "store 3, r0\n"
+      "# assignment\n" },
+
+    { "const-reload",
+      "int_const r0, 5\n"
+      "add_int r1, r1, r0\n"
+      "int_const r0, 5\n",
+      "int_const r0, 5\n"
+      "add_int r1, r1, r0\n" },
+
+    { "const-reload-real",
+      "real_const r0, 1.500000\n"
+      "real_const r0, 1.500000\n",
+      "real_const r0, 1.500000\n" },
+
+    { "const-reload-written-kept",
+      "int_const r0, 5\n"
+      "add_int r0, r0, r1\n"
+      "int_const r0, 5\n",
+      "int_const r0, 5\n"
+      "add_int r0, r0, r1\n"
+      "int_const r0, 5\n" },
+
+    { "const-reload-label-kept",
+      "int_const r0, 5\n"
+      "label2:\n"
+      "int_const r0, 5\n",
+      "int_const r0, 5\n"
+      "label2:\n"
+      "int_const r0, 5\n" },
+
+    { "const-reload-builtin-kept",
+      "int_const r0, 5\n"
+      "call_builtin print_int\n"
+      "int_const r0, 5\n",
+      "int_const r0, 5\n"
+      "call_builtin print_int\n"
+      "int_const r0, 5\n" },
+
+    { "const-div-check",
+      "int_const r1, 4\n"
+      "int_const r2, 0\n"
+      "cmp_eq_int r2, r2, r1\n"
+      "branch_on_true r2, label1\n"
+      "div_int r0, r0, r1\n",
+      "int_const r1, 4\n"
+      "int_const r2, 0\n"
+      "div_int r0, r0, r1\n" },
+
+    { "const-div-check-zero-kept",
+      "int_const r1, 0\n"
+      "int_const r2, 0\n"
+      "cmp_eq_int r2, r2, r1\n"
+      "branch_on_true r2, label1\n"
+      "div_int r0, r0, r1\n",
+      "int_const r1, 0\n"
+      "int_const r2, 0\n"
+      "cmp_eq_int r2, r2, r1\n"
+      "branch_on_true r2, label1\n"
+      "div_int r0, r0, r1\n" },
+
+    { "negate-const",
+      "int_const r0, 7\n"
+      "int_const r1, 0\n"
+      "sub_int r0, r1, r0\n",
+      "int_const r1, 0\n"
+      "int_const r0, -7\n" },
+
+    { "negate-const-real",
+      "real_const r0, 2.500000\n"
+      "real_const r1, 0.000000\n"
+      "sub_real r0, r1, r0\n",
+      "real_const r1, 0.000000\n"
+      "real_const r0, -2.500000\n" },
+
+    { "negate-const-int-min-kept",
+      "int_const r0, -2147483648\n"
+      "int_const r1, 0\n"
+      "sub_int r0, r1, r0\n",
+      "int_const r0, -2147483648\n"
+      "int_const r1, 0\n"
+      "sub_int r0, r1, r0\n" },
+
+    { "negate-const-then-reload",
+      "int_const r0, 7\n"
+      "int_const r1, 0\n"
+      "sub_int r0, r1, r0\n"
+      "int_const r0, -7\n",
+      "int_const r1, 0\n"
+      "int_const r0, -7\n" },
+
+    { "branch-to-next",
+      "branch_uncond label3\n"
+      "label3:\n",
+      "label3:\n" },
+
+    { "branch-to-next-cond",
+      "branch_on_false r0, label3\n"
+      "label3:\n",
+      "label3:\n" },
+
+    { "branch-to-next-other-label-kept",
+      "branch_uncond label3\n"
+      "label4:\n",
+      "branch_uncond label3\n"
+      "label4:\n" },
+
+    { "unreachable",
+      "branch_uncond label3\n"
+      "move r0, r1\n"
+      "add_int r0, r0, r0\n"
+      "label4:\n"
+      "move r0, r1\n",
+      "branch_uncond label3\n"
+      "label4:\n"
+      "move r0, r1\n" },
+
+    { "unreachable-after-return",
+      "return\n"
+      "move r0, r1\n"
+      "proc_f:\n"
+      "move r0, r1\n",
+      "return\n"
+      "proc_f:\n"
+      "move r0, r1\n" },
+
+    { "unreachable-after-halt",
+      "halt\n"
+      "call_builtin print_int\n"
+      "label2:\n",
+      "halt\n"
+      "label2:\n" },
+
+    { "unreachable-after-branch-to-proc",
+      "branch_uncond proc_f\n"
+      "int_const r0, 1\n",
+      "branch_uncond proc_f\n" }
+};
+
+#define NUM_CASES ((int) (sizeof(cases) / sizeof(Case)))
+
+/*----------------------------------------------------------------------
+    Function implementations
+-----------------------------------------------------------------------*/
+
+int main(void) {
+    int failed = 0;
+    int i;
+    for (i = 0; i < NUM_CASES; i++) {
+        if (!check_case(&cases[i])) {
+            failed++;
+        }
+    }
+    printf("%d of %d peephole cases passed\n", NUM_CASES - failed, NUM_CASES);
+    return failed > 0;
+}
+
+BOOL check_case(Case *c) {
+    OzProgram *before = parse_oz_text(c->before);
+    OzProgram *after = parse_oz_text(c->after);
+    peephole_optimise(before);
+
+    char *got = written_text(before);
+    char *expected = written_text(after);
+    if (strcmp(got, expected) == 0) {
+        printf("ok   %s\n", c->name);
+        return TRUE;
+    }
+    printf("FAIL %s\nexpected:\n%sgot:\n%s", c->name, expected, got);
+    return FALSE;
+}
+
+/*----------------------------------------------------------------------
+    Reading Oz text
+-----------------------------------------------------------------------*/
+
+// Reads Oz text, one line per line, into a program. The program's
+// strings point into a copy of the text, which is kept.
+OzProgram *parse_oz_text(char *text) {
+    OzProgram *p = new_oz_program();
+    char *s = checked_malloc(strlen(text) + 1);
+    strcpy(s, text);
+
+    while (*s != '\0') {
+        char *end = strchr(s, '\n');
+        if (end == NULL) {
+            end = s + strlen(s);
+        } else {
+            *end++ = '\0';
+        }
+        parse_line(p, trim_spaces(s));
+        s = end;
+    }
+    return p;
+}
+
+void parse_line(OzProgram *p, char *s) {
+    int length = strlen(s);
+    if (length == 0) {
+        return;
+    }
+
+    if (s[0] == '#') {
+        int section = find_name_index(sectionnames, NUM_SECTIONS, trim_spaces(s + 1));
+        new_line(p, OZ_COMMENT)->arg1 = section;
+        return;
+    }
+    if (s[length - 1] == ':') {
+        s[length - 1] = '\0';
+        if (strncmp(s, "label", 5) == 0) {
+            new_line(p, OZ_LABEL)->arg1 = atoi(s + 5);
+        } else if (strncmp(s, "proc_", 5) == 0) {
+            new_line(p, OZ_PROC)->arg1 = add_string(p, s + 5);
+        } else {
+            fprintf(stderr, "bad label: %s\n", s);
+            exit(1);
+        }
+        return;
+    }
+
+    char *operands = s;
+    while (*operands != '\0' && *operands != ' ') {
+        operands++;
+    }
+    if (*operands != '\0') {
+        *operands++ = '\0';
+    }
+    if (streq(s, "call_builtin")) {
+        int builtin = find_name_index(builtinnames, NUM_BUILTINS, trim_spaces(operands));
+        new_line(p, OZ_BUILTIN)->arg1 = builtin;
+        return;
+    }
+    parse_op(p, s, trim_spaces(operands));
+}
+
+// Reads an op's operands by the letters of its format (see emit.c). The
+// two ops written branch_uncond are told apart by their operand.
+void parse_op(OzProgram *p, char *mnemonic, char *operands) {
+    BOOL to_proc = (strncmp(operands, "proc_", 5) == 0);
+    int code;
+    const char *format = NULL;
+    for (code = 0; code < NUM_OPS; code++) {
+        const char *name = oz_mnemonic(code);
+        if (name != NULL && streq((char *) name, mnemonic)) {
+            format = oz_operands(code);
+            if ((format[0] == 'p') == to_proc) {
+                break;
+            }
+        }
+    }
+    if (code == NUM_OPS) {
+        fprintf(stderr, "unknown op: %s %s\n", mnemonic, operands);
+        exit(1);
+    }
+
+    OzLine *line = new_line(p, OZ_OP);
+    line->code = code;
+    int args[3] = { 0, 0, 0 };
+    int i;
+    for (i = 0; format[i] != '\0'; i++) {
+        char *operand = split_operand(&operands);
+        switch (format[i]) {
+            case 'r':
+                args[i] = atoi(operand + 1);
+                break;
+
+            case 'i':
+                args[i] = atoi(operand);
+                break;
+
+            case 'l':
+                args[i] = atoi(operand + 5);
+                break;
+
+            case 'p':
+                args[i] = add_string(p, operand + 5);
+                break;
+
+            case 's':
+                operand[strlen(operand) - 1] = '\0';
+                args[i] = add_string(p, operand + 1);
+                break;
+
+            case 'f':
+                line->real = atof(operand);
+                break;
+        }
+    }
+    line->arg1 = args[0];
+    line->arg2 = args[1];
+    line->arg3 = args[2];
+}
+
+int find_name_index(const char **names, int n, char *s) {
+    int i;
+    for (i = 0; i < n; i++) {
+        if (streq((char *) names[i], s)) {
+            return i;
+        }
+    }
+    fprintf(stderr, "unknown name: %s\n", s);
+    exit(1);
+}
+
+// Splits the next comma separated operand off the front of *s
+char *split_operand(char **s) {
+    char *operand = *s;
+    char *comma = strchr(operand, ',');
+    if (comma == NULL) {
+        *s = operand + strlen(operand);
+    } else {
+        *comma = '\0';
+        *s = comma + 1;
+    }
+    return trim_spaces(operand);
+}
+
+char *trim_spaces(char *s) {
+    while (*s == ' ') {
+        s++;
+    }
+    char *end = s + strlen(s);
+    while (end > s && end[-1] == ' ') {
+        *--end = '\0';
+    }
+    return s;
+}
+
+/*----------------------------------------------------------------------
+    Writing Oz text
+-----------------------------------------------------------------------*/
+
+// The text wiz would write for a program. write_oz_text writes to the
+// file's descriptor, so it goes through a real temporary file.
+char *written_text(OzProgram *p) {
+    FILE *fp = tmpfile();
+    if (fp == NULL) {
+        perror("tmpfile");
+        exit(1);
+    }
+    write_oz_text(fp, p);
+    fseek(fp, 0, SEEK_SET);
+
+    int size = 256, used = 0, n;
+    char *text = checked_malloc(size);
+    while ((n = fread(text + used, 1, size - used - 1, fp)) > 0) {
+        used += n;
+        if (used == size - 1) {
+            size *= 2;
+            text = checked_realloc(text, size);
+        }
+    }
+    text[used] = '\0';
+    fclose(fp);
+    return text;
+}
@@ -428,6 +428,8 @@ stmt
           $$->info.func = allocate(sizeof(struct func));
           $$->info.func->id   = $1;
           $$->info.func->args = $3;
+          $$->info.func->tail = FALSE;
+          $$->info.func->spills = NULL;
         }
     ;
 
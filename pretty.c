@@ -322,6 +322,28 @@ void print_statement(FILE *fp, Stmt *statement, int indents) {
             //Close the braces
             fprintf(fp, ");\n");
             break;
+
+        case STMT_BIND:
+            // Only introduced by the optimiser, print as taking an address
+            print_expression(fp, info->assign.asg_ident, START_PREC);
+            if (info->assign.asg_expr->kind == EXPR_ID) {
+                fprintf(fp, " := ");
+            } else {
+                fprintf(fp, " := &");
+            }
+            print_expression(fp, info->assign.asg_expr, START_PREC);
+            fprintf(fp, ";\n");
+            break;
+
+        case STMT_ADVANCE:
+            // Only introduced by the optimiser, print as pointer arithmetic
+            print_expression(fp, info->assign.asg_ident, START_PREC);
+            fprintf(fp, " := &");
+            print_expression(fp, info->assign.asg_ident, START_PREC);
+            fprintf(fp, "[");
+            print_expression(fp, info->assign.asg_expr, START_PREC);
+            fprintf(fp, "];\n");
+            break;
     }
 }
 
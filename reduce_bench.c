@@ -0,0 +1,110 @@
+/* reduce_bench.c */
+
+/*-----------------------------------------------------------------------
+    Developed by: #undef TEAMNAME
+    Times the reduction of long chains of commutative operators, as found
+    in machine-generated programs, against the number of terms and the
+    shape the chains are rebuilt in.
+
+    Each chain is built the way the parser builds it (deepest on the
+    left), from variables and constants mixed with + and -, or with and.
+    If reduction is linear in the number of terms, the time per term
+    printed stays roughly flat as the chains grow.
+
+    Usage: reduce_bench [largest number of terms]
+-----------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "wizoptimiser.h"
+#include "helper.h"
+
+#define DEFAULT_MAX_TERMS 65536
+#define MIN_TERMS 1024
+#define REPEATS 5
+
+/*----------------------------------------------------------------------
+    Internal function definitions.
+-----------------------------------------------------------------------*/
+Expr *build_sum(int n);
+Expr *build_conjunction(int n);
+Expr *term(int i, Type t);
+double time_reduction(Expr *(*build)(int), int n, ChainShape shape);
+
+/*----------------------------------------------------------------------
+    Function implementations
+-----------------------------------------------------------------------*/
+
+int main(int argc, char **argv) {
+    int max_terms = DEFAULT_MAX_TERMS;
+    if (argc == 2) {
+        max_terms = atoi(argv[1]);
+    }
+
+    printf("%10s %6s %14s %14s\n", "terms", "op", "chain ns/term",
+           "balanced ns/term");
+    int n;
+    for (n = MIN_TERMS; n <= max_terms; n *= 2) {
+        printf("%10d %6s %14.1f %14.1f\n", n, "+/-",
+               time_reduction(build_sum, n, SHAPE_LEFT_CHAIN),
+               time_reduction(build_sum, n, SHAPE_BALANCED));
+        printf("%10d %6s %14.1f %14.1f\n", n, "and",
+               time_reduction(build_conjunction, n, SHAPE_LEFT_CHAIN),
+               time_reduction(build_conjunction, n, SHAPE_BALANCED));
+    }
+    return 0;
+}
+
+// x0 + 1 - x1 + 2 + ... with n terms
+Expr *build_sum(int n) {
+    Expr *e = term(0, INT_TYPE);
+    int i;
+    for (i = 1; i < n; i++) {
+        BinOp op = (i % 3 == 0) ? BINOP_SUB : BINOP_ADD;
+        e = new_binop_expr(op, e, term(i, INT_TYPE), INT_TYPE, 1);
+    }
+    return e;
+}
+
+// b0 and true and b1 and ... with n terms
+Expr *build_conjunction(int n) {
+    Expr *e = term(0, BOOL_TYPE);
+    int i;
+    for (i = 1; i < n; i++) {
+        e = new_binop_expr(BINOP_AND, e, term(i, BOOL_TYPE), BOOL_TYPE, 1);
+    }
+    return e;
+}
+
+// Every other term is a constant, the rest are distinct variables
+Expr *term(int i, Type t) {
+    if (i % 2 == 1) {
+        Expr *c = new_zero_expr(t, 1);
+        if (t == BOOL_TYPE) {
+            c->constant.val.bool_val = TRUE;
+        } else {
+            c->constant.val.int_val = i;
+        }
+        return c;
+    }
+    char *id = (char *) checked_malloc(16 * sizeof(char));
+    sprintf(id, "v%d", i);
+    return new_id_expr(id, t, 1);
+}
+
+// The best time of a few runs, in nanoseconds per term
+double time_reduction(Expr *(*build)(int), int n, ChainShape shape) {
+    double best = -1;
+    int r;
+    set_chain_shape(shape);
+    for (r = 0; r < REPEATS; r++) {
+        Expr *e = build(n);
+        clock_t start = clock();
+        reduce_expression(e);
+        double ns = (double) (clock() - start) * 1e9 / CLOCKS_PER_SEC / n;
+        if (best < 0 || ns < best) {
+            best = ns;
+        }
+    }
+    return best;
+}
@@ -0,0 +1,676 @@
+/* regalloc.c */
+
+/*-----------------------------------------------------------------------
+    Developed by: #undef TEAMNAME
+    Global register allocation for the scalar variables of a proc, run by
+    codegen just before the proc is generated.
+
+    Every scalar local, val parameter and address held like a ref
+    parameter (ref parameters, and the address temporaries strength
+    reduction binds) is a candidate, unless its address is passed to a
+    ref parameter, as it must then stay in its slot. The liveness of the
+    candidates is found backwards over the proc's statements, which are
+    its control flow graph in structured form: a branch joins the
+    variables live in each arm, and a loop is repeated until the
+    variables live at its head stop changing. Each definition of a
+    variable interferes with every other variable live after it.
+
+    Oz registers are shared by every proc, so a call destroys them all.
+    A variable in a register that is live after a call is stored to its
+    slot before the call, and loaded back after it. Builtins only change
+    r0, which is never given to a variable. A candidate is kept in a
+    register only if its reads and writes (weighted by the loops they are
+    in) outweigh the stores and loads around the calls it is live across.
+    The chosen variables are coloured greedily, the heaviest first, with
+    the lowest register none of the variables it interferes with has.
+
+    Registers are numbered from FIRST_VAR_REG while the proc is generated,
+    since the registers its expressions use are not known until then, and
+    are moved down to just above them afterwards.
+-----------------------------------------------------------------------*/
+#include <stdlib.h>
+#include <string.h>
+#include "regalloc.h"
+#include "passes.h"
+#include "helper.h"
+
+// How much more a reference in a loop counts than one outside it, and
+// the deepest loop that adds to it
+#define LOOP_WEIGHT 8
+#define MAX_LOOP_DEPTH 6
+
+// The most registers given to variables of one proc, which leaves
+// enough of Oz's 1024 registers for the proc's expressions
+#define MAX_VAR_REGS 512
+
+#define WORD_BITS ((int) (8 * sizeof(unsigned long)))
+
+/*----------------------------------------------------------------------
+    Internal structures.
+-----------------------------------------------------------------------*/
+
+// A set of variables, as a bit per variable
+typedef unsigned long *VarSet;
+
+// The candidates of the proc being allocated
+typedef struct {
+    void        *tables;
+    scope       *table;
+    symbol      **vars;
+    int         nvars;
+    int         size;
+    int         nwords;     /* in each VarSet */
+    BOOL        *taken;     /* address passed to a ref parameter */
+    long        *weight;    /* weighted reads and writes */
+    long        *cost;      /* weighted stores and loads around calls */
+    VarSet      *interferes;
+} Alloc;
+
+/*----------------------------------------------------------------------
+    Internal function definitions.
+-----------------------------------------------------------------------*/
+void find_stmts(Alloc *a, Stmts *stmts, int depth);
+void find_expr(Alloc *a, Expr *e, int depth);
+void find_lvalue(Alloc *a, Expr *e, int depth);
+int find_var(Alloc *a, char *id, int depth);
+
+void live_stmts(Alloc *a, Stmts *stmts, VarSet live);
+void live_stmt(Alloc *a, Stmt *stmt, VarSet live);
+void live_expr(Alloc *a, Expr *e, VarSet live);
+void live_lvalue(Alloc *a, Expr *e, VarSet live);
+void live_def(Alloc *a, char *id, VarSet live);
+Spills *live_spills(Alloc *a, VarSet live);
+
+void cost_stmts(Alloc *a, Stmts *stmts, int depth);
+void keep_chosen_spills(Stmts *stmts);
+void colour(Alloc *a, BOOL *chosen, VarSet entry);
+
+int var_index(Alloc *a, char *id);
+long loop_weight(int depth);
+
+VarSet new_set(Alloc *a);
+void add_var(VarSet s, int v);
+void remove_var(VarSet s, int v);
+BOOL has_var(VarSet s, int v);
+void union_sets(Alloc *a, VarSet into, VarSet from);
+BOOL equal_sets(Alloc *a, VarSet s1, VarSet s2);
+void copy_set(Alloc *a, VarSet into, VarSet from);
+
+/*----------------------------------------------------------------------
+    Function implementations
+-----------------------------------------------------------------------*/
+
+int allocate_registers(Proc *proc, void *tables, void *table) {
+    Alloc a;
+    a.tables = tables;
+    a.table = table;
+    a.nvars = 0;
+    a.size = 16;
+    a.vars = checked_malloc(a.size * sizeof(symbol *));
+    a.taken = checked_malloc(a.size * sizeof(BOOL));
+    a.weight = checked_malloc(a.size * sizeof(long));
+
+    // every param and decl has a register set up on entry if it has one,
+    // so they come first, whether the body uses them or not
+    Params *params;
+    Decls *decls;
+    for (params = proc->header->params; params != NULL;
+         params = params->rest) {
+        find_var(&a, params->first->id, -1);
+    }
+    for (decls = proc->body->decls; decls != NULL; decls = decls->rest) {
+        find_var(&a, decls->first->id, -1);
+    }
+    find_stmts(&a, proc->body->statements, 0);
+
+    // without register allocation, only the calls' spills need clearing
+    int v;
+    for (v = 0; v < a.nvars; v++) {
+        a.vars[v]->reg = NO_REG;
+        a.vars[v]->reg_init = FALSE;
+    }
+    if (!pass_enabled(PASS_REGALLOC) || a.nvars == 0) {
+        keep_chosen_spills(proc->body->statements);
+        free(a.vars);
+        free(a.taken);
+        free(a.weight);
+        return 0;
+    }
+
+    a.nwords = (a.nvars + WORD_BITS - 1) / WORD_BITS;
+    a.cost = checked_malloc(a.nvars * sizeof(long));
+    a.interferes = checked_malloc(a.nvars * sizeof(VarSet));
+    for (v = 0; v < a.nvars; v++) {
+        a.cost[v] = 0;
+        a.interferes[v] = new_set(&a);
+    }
+
+    // the variables live on entry are all set there, so interfere
+    VarSet entry = new_set(&a);
+    live_stmts(&a, proc->body->statements, entry);
+    int u;
+    for (v = 0; v < a.nvars; v++) {
+        for (u = 0; u < a.nvars; u++) {
+            if (u != v && has_var(entry, v) && has_var(entry, u)) {
+                add_var(a.interferes[v], u);
+            }
+        }
+    }
+
+    // keep each variable whose references outweigh its spills
+    cost_stmts(&a, proc->body->statements, 0);
+    BOOL *chosen = checked_malloc(a.nvars * sizeof(BOOL));
+    for (v = 0; v < a.nvars; v++) {
+        chosen[v] = !a.taken[v] && a.weight[v] > a.cost[v];
+    }
+    colour(&a, chosen, entry);
+    keep_chosen_spills(proc->body->statements);
+    int nregs = 0;
+    for (v = 0; v < a.nvars; v++) {
+        if (a.vars[v]->reg != NO_REG) {
+            nregs = max(nregs, a.vars[v]->reg - FIRST_VAR_REG + 1);
+        }
+    }
+
+    for (v = 0; v < a.nvars; v++) {
+        free(a.interferes[v]);
+    }
+    free(a.interferes);
+    free(entry);
+    free(chosen);
+    free(a.cost);
+    free(a.vars);
+    free(a.taken);
+    free(a.weight);
+    return nregs;
+}
+
+void place_registers(OzProgram *p, int first) {
+    int highest = 0;
+    int i, mask;
+    OzLine *line;
+    for (i = first; i < p->nlines; i++) {
+        line = &p->lines[i];
+        if (line->kind != OZ_OP) {
+            continue;
+        }
+        mask = oz_reg_args(line->code);
+        if ((mask & REG_ARG1) && line->arg1 < FIRST_VAR_REG) {
+            highest = max(highest, line->arg1);
+        }
+        if ((mask & REG_ARG2) && line->arg2 < FIRST_VAR_REG) {
+            highest = max(highest, line->arg2);
+        }
+        if ((mask & REG_ARG3) && line->arg3 < FIRST_VAR_REG) {
+            highest = max(highest, line->arg3);
+        }
+    }
+
+    int shift = FIRST_VAR_REG - (highest + 1);
+    for (i = first; i < p->nlines; i++) {
+        line = &p->lines[i];
+        if (line->kind != OZ_OP) {
+            continue;
+        }
+        mask = oz_reg_args(line->code);
+        if ((mask & REG_ARG1) && line->arg1 >= FIRST_VAR_REG) {
+            line->arg1 -= shift;
+        }
+        if ((mask & REG_ARG2) && line->arg2 >= FIRST_VAR_REG) {
+            line->arg2 -= shift;
+        }
+        if ((mask & REG_ARG3) && line->arg3 >= FIRST_VAR_REG) {
+            line->arg3 -= shift;
+        }
+    }
+}
+
+/*----------------------------------------------------------------------
+    Finding the candidates, and weighing their references
+-----------------------------------------------------------------------*/
+
+void find_stmts(Alloc *a, Stmts *stmts, int depth) {
+    Exprs *args;
+    Params *params;
+    for (; stmts != NULL; stmts = stmts->rest) {
+        Stmt *stmt = stmts->first;
+        switch (stmt->kind) {
+            case STMT_ASSIGN:
+            case STMT_BIND:
+            case STMT_ADVANCE:
+                find_lvalue(a, stmt->info.assign.asg_ident, depth);
+                find_expr(a, stmt->info.assign.asg_expr, depth);
+                break;
+
+            case STMT_READ:
+                find_lvalue(a, stmt->info.read, depth);
+                break;
+
+            case STMT_WRITE:
+                find_expr(a, stmt->info.write, depth);
+                break;
+
+            case STMT_FUNC:
+                params = find_scope(stmt->info.func->id,
+                                    a->tables)->params;
+                for (args = stmt->info.func->args; args != NULL;
+                     args = args->rest, params = params->rest) {
+                    int v = -1;
+                    if (args->first->kind == EXPR_ID) {
+                        v = find_var(a, args->first->id, depth);
+                    } else {
+                        find_expr(a, args->first, depth);
+                    }
+                    // passing a local's own address
+                    if (v >= 0 && params->first->ind == REF_IND
+                        && a->vars[v]->kind != SYM_PARAM_REF) {
+                        a->taken[v] = TRUE;
+                    }
+                }
+                break;
+
+            case STMT_COND:
+                find_expr(a, stmt->info.cond.cond, depth);
+                find_stmts(a, stmt->info.cond.then_branch, depth);
+                find_stmts(a, stmt->info.cond.else_branch, depth);
+                break;
+
+            case STMT_WHILE:
+                find_expr(a, stmt->info.loop.cond, depth + 1);
+                find_stmts(a, stmt->info.loop.body, depth + 1);
+                break;
+        }
+    }
+}
+
+void find_expr(Alloc *a, Expr *e, int depth) {
+    Exprs *indices;
+    switch (e->kind) {
+        case EXPR_ID:
+            find_var(a, e->id, depth);
+            break;
+
+        case EXPR_BINOP:
+            find_expr(a, e->e2, depth);
+            /* fall through */
+        case EXPR_UNOP:
+            find_expr(a, e->e1, depth);
+            break;
+
+        case EXPR_ARRAY:
+            for (indices = e->indices; indices != NULL;
+                 indices = indices->rest) {
+                find_expr(a, indices->first, depth);
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+// The variable written (or, through a ref, read), or the indices read
+void find_lvalue(Alloc *a, Expr *e, int depth) {
+    if (e->kind == EXPR_ID) {
+        find_var(a, e->id, depth);
+    } else {
+        find_expr(a, e, depth);
+    }
+}
+
+// Weighs a reference to a scalar variable, adding it as a candidate if
+// it is new. A depth below 0 adds it without a reference. Returns its
+// index, or -1 if it is an array.
+int find_var(Alloc *a, char *id, int depth) {
+    int v = var_index(a, id);
+    if (v < 0) {
+        symbol *sym = retrieve_symbol_in_scope(id, a->table);
+        if (sym->bounds != NULL) {
+            return -1;
+        }
+        if (a->nvars == a->size) {
+            a->size *= 2;
+            a->vars = checked_realloc(a->vars, a->size * sizeof(symbol *));
+            a->taken = checked_realloc(a->taken, a->size * sizeof(BOOL));
+            a->weight = checked_realloc(a->weight, a->size * sizeof(long));
+        }
+        v = a->nvars++;
+        a->vars[v] = sym;
+        a->taken[v] = FALSE;
+        a->weight[v] = 0;
+    }
+    if (depth >= 0) {
+        a->weight[v] += loop_weight(depth);
+    }
+    return v;
+}
+
+/*----------------------------------------------------------------------
+    Liveness. Each function takes the variables live after its code and
+    leaves those live before it.
+-----------------------------------------------------------------------*/
+
+void live_stmts(Alloc *a, Stmts *stmts, VarSet live) {
+    if (stmts == NULL) {
+        return;
+    }
+    live_stmts(a, stmts->rest, live);
+    live_stmt(a, stmts->first, live);
+}
+
+void live_stmt(Alloc *a, Stmt *stmt, VarSet live) {
+    Assign *assign = &(stmt->info.assign);
+    Function *call;
+    Exprs *args;
+    VarSet other, head;
+
+    switch (stmt->kind) {
+        case STMT_ASSIGN:
+            live_lvalue(a, assign->asg_ident, live);
+            live_expr(a, assign->asg_expr, live);
+            break;
+
+        case STMT_BIND:
+            live_def(a, assign->asg_ident->id, live);
+            live_expr(a, assign->asg_expr, live);
+            break;
+
+        case STMT_ADVANCE:
+            live_def(a, assign->asg_ident->id, live);
+            live_expr(a, assign->asg_ident, live);
+            break;
+
+        case STMT_READ:
+            live_lvalue(a, stmt->info.read, live);
+            break;
+
+        case STMT_WRITE:
+            live_expr(a, stmt->info.write, live);
+            break;
+
+        case STMT_FUNC:
+            // the list is replaced each time a loop around it is redone,
+            // so the last one is for what is live once the loop is done
+            call = stmt->info.func;
+            while (call->spills != NULL) {
+                Spills *next = call->spills->rest;
+                free(call->spills);
+                call->spills = next;
+            }
+            if (!call->tail) {
+                call->spills = live_spills(a, live);
+            }
+            for (args = call->args; args != NULL; args = args->rest) {
+                live_expr(a, args->first, live);
+            }
+            break;
+
+        case STMT_COND:
+            other = new_set(a);
+            copy_set(a, other, live);
+            live_stmts(a, stmt->info.cond.then_branch, live);
+            live_stmts(a, stmt->info.cond.else_branch, other);
+            union_sets(a, live, other);
+            live_expr(a, stmt->info.cond.cond, live);
+            free(other);
+            break;
+
+        case STMT_WHILE:
+            // live at the head: what is live after the loop or through
+            // its body, and what its condition reads
+            head = new_set(a);
+            other = new_set(a);
+            copy_set(a, head, live);
+            live_expr(a, stmt->info.loop.cond, head);
+            do {
+                copy_set(a, other, head);
+                live_stmts(a, stmt->info.loop.body, other);
+                union_sets(a, other, live);
+                live_expr(a, stmt->info.loop.cond, other);
+                if (equal_sets(a, other, head)) {
+                    break;
+                }
+                copy_set(a, head, other);
+            } while (TRUE);
+            copy_set(a, live, head);
+            free(head);
+            free(other);
+            break;
+    }
+}
+
+void live_expr(Alloc *a, Expr *e, VarSet live) {
+    Exprs *indices;
+    int v;
+    switch (e->kind) {
+        case EXPR_ID:
+            v = var_index(a, e->id);
+            if (v >= 0) {
+                add_var(live, v);
+            }
+            break;
+
+        case EXPR_BINOP:
+            live_expr(a, e->e2, live);
+            /* fall through */
+        case EXPR_UNOP:
+            live_expr(a, e->e1, live);
+            break;
+
+        case EXPR_ARRAY:
+            for (indices = e->indices; indices != NULL;
+                 indices = indices->rest) {
+                live_expr(a, indices->first, live);
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+// A write of a variable defines it, and a write through a ref reads it
+void live_lvalue(Alloc *a, Expr *e, VarSet live) {
+    if (e->kind == EXPR_ID
+        && retrieve_symbol_in_scope(e->id, a->table)->kind != SYM_PARAM_REF) {
+        live_def(a, e->id, live);
+    } else {
+        live_expr(a, e, live);
+    }
+}
+
+void live_def(Alloc *a, char *id, VarSet live) {
+    int v = var_index(a, id);
+    if (v < 0) {
+        return;
+    }
+    int u;
+    for (u = 0; u < a->nvars; u++) {
+        if (u != v && has_var(live, u)) {
+            add_var(a->interferes[v], u);
+            add_var(a->interferes[u], v);
+        }
+    }
+    remove_var(live, v);
+}
+
+Spills *live_spills(Alloc *a, VarSet live) {
+    Spills *spills = NULL;
+    int v;
+    for (v = a->nvars - 1; v >= 0; v--) {
+        if (has_var(live, v)) {
+            Spills *node = checked_malloc(sizeof(Spills));
+            node->first = a->vars[v];
+            node->rest = spills;
+            spills = node;
+        }
+    }
+    return spills;
+}
+
+/*----------------------------------------------------------------------
+    Choosing and colouring
+-----------------------------------------------------------------------*/
+
+// Weighs the store and load around each call for what is live across it
+void cost_stmts(Alloc *a, Stmts *stmts, int depth) {
+    Spills *spills;
+    for (; stmts != NULL; stmts = stmts->rest) {
+        Stmt *stmt = stmts->first;
+        switch (stmt->kind) {
+            case STMT_FUNC:
+                for (spills = stmt->info.func->spills; spills != NULL;
+                     spills = spills->rest) {
+                    int v = var_index(a, get_symbol_id(spills->first));
+                    a->cost[v] += 2 * loop_weight(depth);
+                }
+                break;
+
+            case STMT_COND:
+                cost_stmts(a, stmt->info.cond.then_branch, depth);
+                cost_stmts(a, stmt->info.cond.else_branch, depth);
+                break;
+
+            case STMT_WHILE:
+                cost_stmts(a, stmt->info.loop.body, depth + 1);
+                break;
+
+            default:
+                break;
+        }
+    }
+}
+
+// Drops the variables left in their slots from the calls' spills
+void keep_chosen_spills(Stmts *stmts) {
+    Spills **spills;
+    for (; stmts != NULL; stmts = stmts->rest) {
+        Stmt *stmt = stmts->first;
+        switch (stmt->kind) {
+            case STMT_FUNC:
+                spills = &(stmt->info.func->spills);
+                while (*spills != NULL) {
+                    if ((*spills)->first->reg == NO_REG) {
+                        Spills *dropped = *spills;
+                        *spills = dropped->rest;
+                        free(dropped);
+                    } else {
+                        spills = &((*spills)->rest);
+                    }
+                }
+                break;
+
+            case STMT_COND:
+                keep_chosen_spills(stmt->info.cond.then_branch);
+                keep_chosen_spills(stmt->info.cond.else_branch);
+                break;
+
+            case STMT_WHILE:
+                keep_chosen_spills(stmt->info.loop.body);
+                break;
+
+            default:
+                break;
+        }
+    }
+}
+
+// Gives each chosen variable, the heaviest first, the lowest register no
+// variable it interferes with has. Those left without one stay in slots.
+void colour(Alloc *a, BOOL *chosen, VarSet entry) {
+    int *reg = checked_malloc(a->nvars * sizeof(int));
+    BOOL *used = checked_malloc(MAX_VAR_REGS * sizeof(BOOL));
+    int v, u, r;
+    for (v = 0; v < a->nvars; v++) {
+        reg[v] = NO_REG;
+    }
+
+    while (TRUE) {
+        int next = -1;
+        for (v = 0; v < a->nvars; v++) {
+            if (chosen[v] && reg[v] == NO_REG
+                && (next < 0 || a->weight[v] > a->weight[next])) {
+                next = v;
+            }
+        }
+        if (next < 0) {
+            break;
+        }
+        chosen[next] = FALSE;
+
+        for (r = 0; r < MAX_VAR_REGS; r++) {
+            used[r] = FALSE;
+        }
+        for (u = 0; u < a->nvars; u++) {
+            if (reg[u] != NO_REG && has_var(a->interferes[next], u)) {
+                used[reg[u]] = TRUE;
+            }
+        }
+        for (r = 0; r < MAX_VAR_REGS && used[r]; r++) {
+        }
+        if (r < MAX_VAR_REGS) {
+            reg[next] = r;
+            a->vars[next]->reg = FIRST_VAR_REG + r;
+            a->vars[next]->reg_init = has_var(entry, next);
+        }
+    }
+    free(reg);
+    free(used);
+}
+
+/*----------------------------------------------------------------------
+    Helpers
+-----------------------------------------------------------------------*/
+
+// The index of a candidate, or -1 if it is not one
+int var_index(Alloc *a, char *id) {
+    int v;
+    for (v = 0; v < a->nvars; v++) {
+        if (streq(get_symbol_id(a->vars[v]), id)) {
+            return v;
+        }
+    }
+    return -1;
+}
+
+long loop_weight(int depth) {
+    long weight = 1;
+    int i;
+    for (i = 0; i < depth && i < MAX_LOOP_DEPTH; i++) {
+        weight *= LOOP_WEIGHT;
+    }
+    return weight;
+}
+
+VarSet new_set(Alloc *a) {
+    VarSet s = checked_malloc(a->nwords * sizeof(unsigned long));
+    memset(s, 0, a->nwords * sizeof(unsigned long));
+    return s;
+}
+
+void add_var(VarSet s, int v) {
+    s[v / WORD_BITS] |= 1UL << (v % WORD_BITS);
+}
+
+void remove_var(VarSet s, int v) {
+    s[v / WORD_BITS] &= ~(1UL << (v % WORD_BITS));
+}
+
+BOOL has_var(VarSet s, int v) {
+    return (s[v / WORD_BITS] >> (v % WORD_BITS)) & 1UL;
+}
+
+void union_sets(Alloc *a, VarSet into, VarSet from) {
+    int i;
+    for (i = 0; i < a->nwords; i++) {
+        into[i] |= from[i];
+    }
+}
+
+BOOL equal_sets(Alloc *a, VarSet s1, VarSet s2) {
+    return memcmp(s1, s2, a->nwords * sizeof(unsigned long)) == 0;
+}
+
+void copy_set(Alloc *a, VarSet into, VarSet from) {
+    memcpy(into, from, a->nwords * sizeof(unsigned long));
+}
@@ -0,0 +1,42 @@
+/* regalloc.h */
+
+/*-----------------------------------------------------------------------
+    Developed by: #undef TEAMNAME
+    Provides function definitions and external access rights for
+    regalloc.c
+-----------------------------------------------------------------------*/
+#ifndef REGALLOC_H
+#define REGALLOC_H
+
+#include "ast.h"
+#include "symbol.h"
+#include "oztree.h"
+
+/*----------------------------------------------------------------------
+    Structures needed from other files.
+-----------------------------------------------------------------------*/
+// The variables a call must save before it and restore after it
+typedef struct spills {
+    symbol          *first;
+    struct spills   *rest;
+} Spills;
+
+// Registers given to variables are numbered from here while their proc is
+// generated, and moved down above the registers the proc's code uses once
+// it is complete
+#define FIRST_VAR_REG (1 << 20)
+
+/*----------------------------------------------------------------------
+    External Functions that will be accessed by other C files.
+-----------------------------------------------------------------------*/
+// Chooses which of a proc's scalar variables to keep in registers, and
+// which registers, setting each variable's reg (and each call's spills).
+// Variables keep their stack slots if register allocation is off. Returns
+// the number of registers from FIRST_VAR_REG given to variables.
+int allocate_registers(Proc *proc, void *tables, void *table);
+
+// Moves the registers given to variables in the lines of a proc, from
+// first on, down to just above the highest register its code uses
+void place_registers(OzProgram *p, int first);
+
+#endif
@@ -0,0 +1,324 @@
+/* specialise.c */
+
+/*-----------------------------------------------------------------------
+    Developed by: #undef TEAMNAME
+    Specialisation of procs for constant arguments, run after semantic
+    analysis.
+
+    Calls are grouped by the constants they pass to val parameters that
+    the callee never writes. For each group (the most frequent first, up
+    to a cap per proc) the callee is cloned as foo__k1, foo__k2 and so on,
+    with those parameters removed and their constants substituted into
+    the clone's body, where the reducer can then fold them. The calls in
+    the group are redirected to the clone and no longer pass the
+    constants.
+-----------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "specialise.h"
+#include "effects.h"
+#include "helper.h"
+
+#define CLONE_SUFFIX "__k"
+
+/*----------------------------------------------------------------------
+    Internal structures.
+-----------------------------------------------------------------------*/
+
+// A call passing constants to a proc
+typedef struct call_site {
+    Function            *call;
+    struct call_site    *next;
+} CallSite;
+
+// The calls passing the same constants to the same parameters
+typedef struct variant {
+    Expr                **consts;   /* per parameter, NULL if not fixed */
+    int                 sites;
+    CallSite            *calls;
+    BOOL                cloned;
+    struct variant      *next;
+} Variant;
+
+// A proc with val parameters that could be fixed
+typedef struct target {
+    Proc                *proc;
+    scope               *scope;
+    int                 nparams;
+    BOOL                *fixable;   /* val parameter never written */
+    Variant             *variants;
+    struct target       *next;
+} Target;
+
+/*----------------------------------------------------------------------
+    Internal function definitions.
+-----------------------------------------------------------------------*/
+Target *find_targets(Program *prog, sym_table *table);
+void find_calls(Stmts *stmts, Target *targets);
+void add_call_site(Function *call, Target *target);
+BOOL same_consts(Expr **a, Expr **b, int n);
+Variant *most_frequent(Target *target);
+void make_clone(Target *target, Variant *variant, Procs *procs,
+                sym_table *table);
+char *clone_name(char *id, sym_table *table);
+Target *find_target(Target *targets, char *id);
+
+/*----------------------------------------------------------------------
+    Function implementations
+-----------------------------------------------------------------------*/
+
+int specialise_procs(Program *prog, sym_table *table, int max_clones) {
+    Target *targets = find_targets(prog, table);
+    Procs *procs = prog->procedures;
+    while (procs != NULL) {
+        find_calls(procs->first->body->statements, targets);
+        procs = procs->rest;
+    }
+
+    // clone the proc for its most common constants first, placing the
+    // clones straight after it
+    int clones = 0;
+    Target *target;
+    for (target = targets; target != NULL; target = target->next) {
+        Procs *node = prog->procedures;
+        while (node->first != target->proc) {
+            node = node->rest;
+        }
+
+        int made = 0;
+        Variant *variant;
+        while (made < max_clones
+               && (variant = most_frequent(target)) != NULL) {
+            make_clone(target, variant, node, table);
+            node = node->rest;
+            made++;
+        }
+        clones += made;
+    }
+    return clones;
+}
+
+// The procs with at least one val parameter their body never writes
+Target *find_targets(Program *prog, sym_table *table) {
+    Target *targets = NULL;
+    Procs *procs = prog->procedures;
+    while (procs != NULL) {
+        Proc *proc = procs->first;
+        scope *s = find_scope(proc->header->id, table);
+        Names *writes = stmts_writes(proc->body->statements, table, s, NULL);
+
+        int nparams = 0;
+        Params *params;
+        for (params = proc->header->params; params != NULL;
+             params = params->rest) {
+            nparams++;
+        }
+
+        BOOL *fixable = (BOOL *) checked_malloc(nparams * sizeof(BOOL));
+        BOOL any = FALSE;
+        int i = 0;
+        for (params = proc->header->params; params != NULL;
+             params = params->rest) {
+            Param *p = params->first;
+            fixable[i] = (p->ind == VAL_IND && !has_name(writes, p->id));
+            any = any || fixable[i];
+            i++;
+        }
+
+        if (any) {
+            Target *target = (Target *) checked_malloc(sizeof(Target));
+            target->proc = proc;
+            target->scope = s;
+            target->nparams = nparams;
+            target->fixable = fixable;
+            target->variants = NULL;
+            target->next = targets;
+            targets = target;
+        }
+        procs = procs->rest;
+    }
+    return targets;
+}
+
+void find_calls(Stmts *stmts, Target *targets) {
+    while (stmts != NULL) {
+        Stmt *stmt = stmts->first;
+        Target *target;
+
+        switch (stmt->kind) {
+            case STMT_COND:
+                find_calls(stmt->info.cond.then_branch, targets);
+                find_calls(stmt->info.cond.else_branch, targets);
+                break;
+
+            case STMT_WHILE:
+                find_calls(stmt->info.loop.body, targets);
+                break;
+
+            case STMT_FUNC:
+                target = find_target(targets, stmt->info.func->id);
+                if (target != NULL) {
+                    add_call_site(stmt->info.func, target);
+                }
+                break;
+
+            default:
+                break;
+        }
+        stmts = stmts->rest;
+    }
+}
+
+// Records a call under the variant for the constants it passes, if any
+void add_call_site(Function *call, Target *target) {
+    Expr **consts = (Expr **) checked_malloc(target->nparams
+                                             * sizeof(Expr *));
+    BOOL any = FALSE;
+    Exprs *args = call->args;
+    int i;
+    for (i = 0; i < target->nparams; i++) {
+        consts[i] = NULL;
+        if (target->fixable[i] && args->first->kind == EXPR_CONST) {
+            consts[i] = args->first;
+            any = TRUE;
+        }
+        args = args->rest;
+    }
+    if (!any) {
+        free(consts);
+        return;
+    }
+
+    Variant *variant = target->variants;
+    while (variant != NULL
+           && !same_consts(variant->consts, consts, target->nparams)) {
+        variant = variant->next;
+    }
+    if (variant == NULL) {
+        variant = (Variant *) checked_malloc(sizeof(Variant));
+        variant->consts = consts;
+        variant->sites = 0;
+        variant->calls = NULL;
+        variant->cloned = FALSE;
+        variant->next = target->variants;
+        target->variants = variant;
+    } else {
+        free(consts);
+    }
+
+    CallSite *site = (CallSite *) checked_malloc(sizeof(CallSite));
+    site->call = call;
+    site->next = variant->calls;
+    variant->calls = site;
+    variant->sites++;
+}
+
+BOOL same_consts(Expr **a, Expr **b, int n) {
+    int i;
+    for (i = 0; i < n; i++) {
+        if (a[i] == NULL || b[i] == NULL) {
+            if (a[i] != b[i]) {
+                return FALSE;
+            }
+        } else if (!exprs_equal(a[i], b[i])) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+// The variant with the most calls not yet cloned (the earliest on a tie)
+Variant *most_frequent(Target *target) {
+    Variant *best = NULL;
+    Variant *variant;
+    for (variant = target->variants; variant != NULL;
+         variant = variant->next) {
+        if (!variant->cloned && (best == NULL
+                                 || variant->sites >= best->sites)) {
+            best = variant;
+        }
+    }
+    return best;
+}
+
+// Adds a clone of the target for the variant's constants after the list
+// node holding the target (or its last clone), and redirects its calls
+void make_clone(Target *target, Variant *variant, Procs *node,
+                sym_table *table) {
+    Proc *proc = target->proc;
+    variant->cloned = TRUE;
+
+    Header *header = (Header *) checked_malloc(sizeof(Header));
+    header->id = clone_name(proc->header->id, table);
+    header->line_no = proc->header->line_no;
+    header->params = NULL;
+
+    Body *body = (Body *) checked_malloc(sizeof(Body));
+    body->decls = proc->body->decls;
+    body->statements = copy_stmts(proc->body->statements);
+
+    // keep the parameters that are not fixed, and substitute the rest
+    Params **link = &(header->params);
+    Params *params = proc->header->params;
+    int i;
+    for (i = 0; i < target->nparams; i++) {
+        Param *p = params->first;
+        Expr *value = variant->consts[i];
+        if (value == NULL) {
+            *link = (Params *) checked_malloc(sizeof(Params));
+            (*link)->first = p;
+            (*link)->rest = NULL;
+            link = &((*link)->rest);
+        } else {
+            if (p->type == FLOAT_TYPE && value->constant.type == INT_TYPE) {
+                int val = value->constant.val.int_val;
+                value = new_zero_expr(FLOAT_TYPE, value->lineno);
+                value->constant.val.float_val = val;
+            }
+            subst_stmts(body->statements, p->id, value);
+        }
+        params = params->rest;
+    }
+
+    Proc *clone = (Proc *) checked_malloc(sizeof(Proc));
+    clone->header = header;
+    clone->body = body;
+    Procs *added = (Procs *) checked_malloc(sizeof(Procs));
+    added->first = clone;
+    added->rest = node->rest;
+    node->rest = added;
+    generate_scope(clone, table);
+
+    // the calls no longer pass the fixed arguments
+    CallSite *site;
+    for (site = variant->calls; site != NULL; site = site->next) {
+        Exprs **arg_link = &(site->call->args);
+        for (i = 0; i < target->nparams; i++) {
+            if (variant->consts[i] != NULL) {
+                *arg_link = (*arg_link)->rest;
+            } else {
+                arg_link = &((*arg_link)->rest);
+            }
+        }
+        site->call->id = header->id;
+    }
+}
+
+// Names a clone after its proc, with a number not used by any other proc
+char *clone_name(char *id, sym_table *table) {
+    int len = strlen(id) + strlen(CLONE_SUFFIX) + 12;
+    char *name = (char *) checked_malloc(len * sizeof(char));
+    int n = 1;
+    do {
+        sprintf(name, "%s%s%d", id, CLONE_SUFFIX, n++);
+    } while (find_scope(name, table) != NULL);
+    return name;
+}
+
+Target *find_target(Target *targets, char *id) {
+    while (targets != NULL && !streq(targets->proc->header->id, id)) {
+        targets = targets->next;
+    }
+    return targets;
+}
@@ -0,0 +1,22 @@
+/* specialise.h */
+
+/*-----------------------------------------------------------------------
+    Developed by: #undef TEAMNAME
+    Provides function definitions and external access rights for
+    specialise.c
+-----------------------------------------------------------------------*/
+#include "ast.h"
+#include "symbol.h"
+
+/*----------------------------------------------------------------------
+    External Functions that will be accessed by other C files.
+-----------------------------------------------------------------------*/
+// The most clones made of any one proc
+#define MAX_CLONES 4
+
+// Clones procs for the constants their calls pass to val parameters,
+// substituting the constants into each clone's body and redirecting the
+// calls passing them to the clone (without those arguments). Must run
+// after analysis, as it adds scopes to the symbol table. Returns the
+// number of clones made.
+int specialise_procs(Program *prog, sym_table *table, int max_clones);
@@ -25,6 +25,14 @@
 /*----------------------------------------------------------------------
     Internal structures.
 -----------------------------------------------------------------------*/
+// Prefixes for compiler temporaries, these can never clash with a Wiz
+// identifier as '$' is not a valid identifier character.
+#define TEMP_PREFIX "$t"
+#define ADDR_TEMP_PREFIX "$a"
+#define TEMP_ID_LEN 24
+
+// Counter used to give every temporary a unique name
+static int next_temp = 0;
 
 /*----------------------------------------------------------------------
     Internal function definitions.
@@ -110,6 +118,8 @@ create_scope(void *table, char *scope_id, void *p, int line_no) {
     new_scope->params = p;
     new_scope->line_no = line_no;
     new_scope->next_slot = 0;
+    new_scope->frame_reused = FALSE;
+    new_scope->frame_label = -1;
     bbst_insert(table, scope_id, new_scope, comp_scope);
     return new_scope;
 }
@@ -129,6 +139,49 @@ insert_symbol(sym_table *prog, symbol *sym, scope *s) {
     }
 }
 
+// Creates a compiler temporary of type t in the given scope, taking the
+// next free stack slot. Ordinary temporaries are locals that are never
+// initialised in the prologue. Address temporaries hold the address of an
+// array element and so are given a ref parameter symbol (without being
+// added to the proc header), which makes code generation load and store
+// through them.
+symbol *
+create_temp_symbol(sym_table *prog, scope *sc, Type t, BOOL is_address) {
+    char *id = checked_malloc(TEMP_ID_LEN * sizeof(char));
+    sprintf(id, "%s%d", is_address ? ADDR_TEMP_PREFIX : TEMP_PREFIX,
+            next_temp++);
+
+    symbol *s = checked_malloc(sizeof(symbol));
+    if (is_address) {
+        Param *p = checked_malloc(sizeof(Param));
+        p->ind = REF_IND;
+        p->type = t;
+        p->id = id;
+        s->kind = SYM_PARAM_REF;
+        s->sym_value = p;
+    } else {
+        Decl *d = checked_malloc(sizeof(Decl));
+        d->lineno = sc->line_no;
+        d->id = id;
+        d->type = t;
+        d->array = NULL;
+        s->kind = SYM_LOCAL;
+        s->sym_value = d;
+    }
+    s->type = sym_type_from_ast_type(t);
+    s->line_no = sc->line_no;
+    s->slot = sc->next_slot;
+    sc->next_slot++;
+    s->used = TRUE;
+    s->bounds = NULL;
+    s->target = NULL;
+    s->reg = NO_REG;
+    s->reg_init = FALSE;
+
+    insert_symbol(prog, s, sc);
+    return s;
+}
+
 // Finds the id of a symbol depending on the type of the symbol itself.
 // Quite straightforward implementation
 char *
@@ -209,6 +262,9 @@ generate_decls_symbols(Decls *decls, scope *sc, sym_table *prog) {
         s->type = sym_type_from_ast_type(decl->type);
         s->used = FALSE;
         s->bounds = NULL;
+        s->target = NULL;
+        s->reg = NO_REG;
+        s->reg_init = FALSE;
         Bound *bound;
         int frames;
 
@@ -304,6 +360,10 @@ generate_params_symbols(Header *h, scope *sc, sym_table *prog) {
         sc->next_slot++;
         s->sym_value = p;
         s->line_no = line_no;
+        s->bounds = NULL;
+        s->target = NULL;
+        s->reg = NO_REG;
+        s->reg_init = FALSE;
 
         // Insert the symbol
         if (!insert_symbol(prog, s, sc)) {
@@ -5,6 +5,9 @@
     Provides function definitions and external access rights for
     symbol.c
 -----------------------------------------------------------------------*/
+#ifndef SYMBOL_H
+#define SYMBOL_H
+
 #include <stdio.h>
 #include "std.h"
 #include "ast.h"
@@ -44,8 +47,14 @@ typedef struct symbol_data {
     int         slot;
     BOOL        used;
     Bounds  *bounds;
+    char        *target;    /* array an address temporary points into */
+    int         reg;        /* register holding it in its proc, or NO_REG */
+    BOOL        reg_init;   /* whether that register is set on entry */
 } symbol;
 
+// The reg of a symbol that lives in its stack slot
+#define NO_REG -1
+
 // A scope in our root scope table, contains the parameters, function id,
 // line_no defined on and next_slot value
 typedef struct scope_data {
@@ -54,6 +63,8 @@ typedef struct scope_data {
     void *params;
     int line_no;
     int next_slot;
+    BOOL frame_reused;  /* tail calls branch straight past its push */
+    int frame_label;    /* label after its push_stack_frame, if reused */
 } scope;
 
 // The root symbol table
@@ -71,6 +82,12 @@ BOOL insert_symbol(sym_table *prob, symbol *sym, scope *s);
 scope *create_scope(void *table, char *scope_id, void *p, int line_no);
 sym_table *gen_sym_table(Program *prog);
 
+// For adding the scope of a proc the optimiser creates after analysis
+void generate_scope(Proc *proc, sym_table *prog);
+
+// For creating compiler temporaries after analysis
+symbol *create_temp_symbol(sym_table *prog, scope *s, Type t, BOOL is_address);
+
 // For finding
 symbol *retrieve_symbol(char *id, char *scope_id, sym_table *prog);
 symbol *retrieve_symbol_in_scope(char *id, scope *s);
@@ -90,3 +107,5 @@ void dump_symbol_table(sym_table *prog);
 
 // To retrieve types
 Type get_type(symbol *sym);
+
+#endif /* SYMBOL_H */
@@ -0,0 +1,101 @@
+/* tailcall.c */
+
+/*-----------------------------------------------------------------------
+    Developed by: #undef TEAMNAME
+    Detection of tail calls, run just before code generation.
+
+    A call is in tail position when it is the last statement of its proc,
+    or the last statement of a branch of an if in tail position. Nothing
+    the caller does after such a call needs its frame, so code generation
+    can drop the frame instead of returning through it. A tail call to a
+    proc with a frame of the same size (in particular a self tail call)
+    keeps the frame and branches to just after the callee's
+    push_stack_frame, which turns self recursion into a loop. Other tail
+    calls pop the frame and branch to the callee, whose return goes
+    straight back to the caller's caller.
+
+    Arguments passed by reference must not point into the frame being
+    dropped (or about to be zeroed again), so a call passing a local, a
+    val parameter or an array element by reference is never a tail call.
+    A ref parameter may be passed on, as it points into an older frame.
+-----------------------------------------------------------------------*/
+#include "tailcall.h"
+#include "helper.h"
+
+/*----------------------------------------------------------------------
+    Internal function definitions.
+-----------------------------------------------------------------------*/
+int mark_tail_stmts(Stmts *stmts, scope *s, sym_table *table);
+BOOL args_outlive_frame(Function *f, scope *callee, scope *s);
+
+/*----------------------------------------------------------------------
+    Function implementations
+-----------------------------------------------------------------------*/
+
+int mark_tail_calls(Program *prog, sym_table *table) {
+    int calls = 0;
+    Procs *procs = prog->procedures;
+    while (procs != NULL) {
+        Proc *proc = procs->first;
+        scope *s = find_scope(proc->header->id, table);
+        calls += mark_tail_stmts(proc->body->statements, s, table);
+        procs = procs->rest;
+    }
+    return calls;
+}
+
+// Marks the call in tail position in the statements, if any
+int mark_tail_stmts(Stmts *stmts, scope *s, sym_table *table) {
+    if (stmts == NULL) {
+        return 0;
+    }
+    while (stmts->rest != NULL) {
+        stmts = stmts->rest;
+    }
+    Stmt *last = stmts->first;
+    Function *f;
+    scope *callee;
+
+    switch (last->kind) {
+        case STMT_COND:
+            return mark_tail_stmts(last->info.cond.then_branch, s, table)
+                   + mark_tail_stmts(last->info.cond.else_branch, s, table);
+
+        case STMT_FUNC:
+            f = last->info.func;
+            callee = find_scope(f->id, table);
+            if (!args_outlive_frame(f, callee, s)) {
+                return 0;
+            }
+            f->tail = TRUE;
+            if (slots_needed_for_table(callee) == slots_needed_for_table(s)) {
+                callee->frame_reused = TRUE;
+            }
+            return 1;
+
+        default:
+            return 0;
+    }
+}
+
+// Whether every argument passed by reference is a ref parameter of the
+// caller (and not an address temporary into one of its arrays)
+BOOL args_outlive_frame(Function *f, scope *callee, scope *s) {
+    Params *params = (Params *) callee->params;
+    Exprs *args = f->args;
+    while (args != NULL) {
+        Expr *arg = args->first;
+        if (params->first->ind == REF_IND) {
+            if (arg->kind != EXPR_ID) {
+                return FALSE;
+            }
+            symbol *sym = retrieve_symbol_in_scope(arg->id, s);
+            if (sym->kind != SYM_PARAM_REF || sym->target != NULL) {
+                return FALSE;
+            }
+        }
+        params = params->rest;
+        args = args->rest;
+    }
+    return TRUE;
+}
@@ -0,0 +1,19 @@
+/* tailcall.h */
+
+/*-----------------------------------------------------------------------
+    Developed by: #undef TEAMNAME
+    Provides function definitions and external access rights for
+    tailcall.c
+-----------------------------------------------------------------------*/
+#include "ast.h"
+#include "symbol.h"
+
+/*----------------------------------------------------------------------
+    External Functions that will be accessed by other C files.
+-----------------------------------------------------------------------*/
+// Marks the calls that are the last thing their proc does, and pass
+// nothing by reference that lives in the caller's frame, as tail calls.
+// Callees whose frame is the same size as a tail caller's are marked as
+// having their frame reused. Must run last before code generation, once
+// every temporary exists. Returns the number of tail calls.
+int mark_tail_calls(Program *prog, sym_table *table);
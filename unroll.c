@@ -0,0 +1,309 @@
+/* unroll.c */
+
+/*-----------------------------------------------------------------------
+    Developed by: #undef TEAMNAME
+    Unrolling of counted while loops, run after semantic analysis and
+    before the program is reduced again.
+
+    A loop is counted when its counter (an int local) is stepped by a
+    constant as the last statement of the body, is written nowhere else
+    in the loop, and the condition compares it against an invariant bound
+    in the direction it moves, as for induction variable strength
+    reduction.
+
+    When the counter is set to a constant just before the loop and the
+    bound is constant, the number of iterations is known. If it is small
+    the loop is replaced by that many copies of its body, each reading
+    the counter as a constant, so that reduction folds them and array
+    accesses become fully static.
+
+    Otherwise a small body is unrolled by a factor: a first loop runs the
+    body for the counter, the counter plus one step and so on while every
+    one of those iterations would run, and the original loop then runs
+    any that remain.
+-----------------------------------------------------------------------*/
+#include <string.h>
+#include "unroll.h"
+#include "effects.h"
+#include "induction.h"
+#include "wizoptimiser.h"
+#include "helper.h"
+
+/*----------------------------------------------------------------------
+    Internal structures.
+-----------------------------------------------------------------------*/
+
+// Loops running more times than this are never fully unrolled
+#define MAX_FULL_TRIPS 8
+
+// The most statements an unrolled loop may be replaced by
+#define MAX_UNROLLED_STMTS 32
+
+// The copies of the body in each iteration of a partially unrolled loop
+#define UNROLL_FACTOR 4
+
+// The counted loop being unrolled
+typedef struct {
+    char            *counter;
+    int             step;
+    Stmts           *body;      /* the body without the step */
+    Expr            *last;      /* last value the body runs for */
+    int             lineno;
+} Counted;
+
+/*----------------------------------------------------------------------
+    Internal function definitions.
+-----------------------------------------------------------------------*/
+int unroll_stmts(Stmts **link, sym_table *prog, scope *s);
+BOOL find_counted(Stmt *stmt, Counted *loop, sym_table *prog, scope *s);
+BOOL find_first_value(Stmt *stmt, char *counter, int *first);
+int trip_count(int first, int last, int step);
+
+Stmts *unroll_fully(Counted *loop, int first, int trips);
+Stmts *unroll_partly(Stmt *orig, Counted *loop);
+Expr *counter_plus(char *counter, int offset, int lineno);
+Stmt *set_counter(char *counter, Expr *value, int lineno);
+
+/*----------------------------------------------------------------------
+    Function implementations
+-----------------------------------------------------------------------*/
+
+int unroll_loops(Program *prog, sym_table *table) {
+    int unrolled = 0;
+    Procs *procs = prog->procedures;
+    while (procs != NULL) {
+        Proc *proc = procs->first;
+        scope *s = find_scope(proc->header->id, table);
+        unrolled += unroll_stmts(&(proc->body->statements), table, s);
+        procs = procs->rest;
+    }
+    return unrolled;
+}
+
+// Unrolls every counted loop in a list of statements, innermost loops
+// first, splicing the unrolled statements in place of each loop
+int unroll_stmts(Stmts **link, sym_table *prog, scope *s) {
+    int unrolled = 0;
+    Stmt *prev = NULL;
+    while (*link != NULL) {
+        Stmt *stmt = (*link)->first;
+        Stmts *rest = (*link)->rest;
+        Stmts *replacement;
+        Counted loop;
+        int first, trips;
+
+        switch (stmt->kind) {
+            case STMT_COND:
+                unrolled += unroll_stmts(&(stmt->info.cond.then_branch),
+                                         prog, s);
+                unrolled += unroll_stmts(&(stmt->info.cond.else_branch),
+                                         prog, s);
+                break;
+
+            case STMT_WHILE:
+                unrolled += unroll_stmts(&(stmt->info.loop.body), prog, s);
+                if (!find_counted(stmt, &loop, prog, s)) {
+                    break;
+                }
+
+                // a known number of iterations, with a constant last value
+                replacement = NULL;
+                trips = -1;
+                loop.last = reduce_expression(loop.last);
+                if (prev != NULL && loop.last->kind == EXPR_CONST
+                    && find_first_value(prev, loop.counter, &first)) {
+                    trips = trip_count(first, loop.last->constant.val.int_val,
+                                       loop.step);
+                    if (trips <= MAX_FULL_TRIPS && trips
+                        * count_stmts(loop.body) <= MAX_UNROLLED_STMTS) {
+                        replacement = unroll_fully(&loop, first, trips);
+                        if (replacement == NULL) {
+                            // the loop never runs
+                            *link = rest;
+                            unrolled++;
+                            continue;
+                        }
+                    }
+                }
+                if (replacement == NULL
+                    && (trips < 0 || trips >= UNROLL_FACTOR)
+                    && UNROLL_FACTOR * count_stmts(stmt->info.loop.body)
+                       <= MAX_UNROLLED_STMTS) {
+                    replacement = unroll_partly(stmt, &loop);
+                }
+                if (replacement == NULL) {
+                    break;
+                }
+
+                unrolled++;
+                *link = replacement;
+                while (replacement->rest != NULL) {
+                    replacement = replacement->rest;
+                }
+                replacement->rest = rest;
+                link = &(replacement->rest);
+                prev = replacement->first;
+                continue;
+
+            default:
+                break;
+        }
+        prev = stmt;
+        link = &((*link)->rest);
+    }
+    return unrolled;
+}
+
+/*----------------------------------------------------------------------
+    Recognising counted loops
+-----------------------------------------------------------------------*/
+
+BOOL find_counted(Stmt *stmt, Counted *loop, sym_table *prog, scope *s) {
+    While *w = &(stmt->info.loop);
+    if (w->body == NULL || w->body->rest == NULL) {
+        return FALSE;
+    }
+
+    // the body, without the step at its end
+    Stmts *last = w->body;
+    Stmts *body = NULL;
+    while (last->rest != NULL) {
+        body = append_stmt(body, last->first);
+        last = last->rest;
+    }
+    if (!find_step(last->first, &loop->counter, &loop->step)) {
+        return FALSE;
+    }
+    symbol *sym = retrieve_symbol_in_scope(loop->counter, s);
+    if (sym == NULL || sym->kind != SYM_LOCAL || sym->type != SYM_INT
+        || sym->bounds != NULL) {
+        return FALSE;
+    }
+
+    // the step must be the only write to the counter, and the bound must
+    // not change in the loop
+    Names *writes = stmts_writes(body, prog, s, NULL);
+    if (has_name(writes, loop->counter)) {
+        return FALSE;
+    }
+    loop->last = find_last_value(w->cond, loop->counter, loop->step);
+    if (loop->last == NULL
+        || names_intersect(expr_reads(loop->last, s, NULL), writes)
+        || can_fault(loop->last)) {
+        return FALSE;
+    }
+
+    loop->body = body;
+    loop->lineno = stmt->lineno;
+    return TRUE;
+}
+
+// Recognises the counter being set to an int constant
+BOOL find_first_value(Stmt *stmt, char *counter, int *first) {
+    if (stmt->kind != STMT_ASSIGN
+        || stmt->info.assign.asg_ident->kind != EXPR_ID
+        || !streq(stmt->info.assign.asg_ident->id, counter)) {
+        return FALSE;
+    }
+    Expr *e = stmt->info.assign.asg_expr;
+    if (e->kind != EXPR_CONST || e->constant.type != INT_TYPE) {
+        return FALSE;
+    }
+    *first = e->constant.val.int_val;
+    return TRUE;
+}
+
+// The number of iterations from the first value to the last
+int trip_count(int first, int last, int step) {
+    if (step > 0) {
+        return last < first ? 0 : (last - first) / step + 1;
+    }
+    return last > first ? 0 : (first - last) / -step + 1;
+}
+
+/*----------------------------------------------------------------------
+    Unrolling
+-----------------------------------------------------------------------*/
+
+// A copy of the body for each iteration, reading the counter's value as
+// a constant, and the counter's value after the loop. NULL if the loop
+// never runs.
+Stmts *unroll_fully(Counted *loop, int first, int trips) {
+    if (trips == 0) {
+        return NULL;
+    }
+
+    Stmts *stmts = NULL;
+    int i;
+    for (i = 0; i < trips; i++) {
+        Stmts *copy = copy_stmts(loop->body);
+        subst_stmts(copy, loop->counter,
+                    new_int_expr(first + i * loop->step, loop->lineno));
+        while (copy != NULL) {
+            stmts = append_stmt(stmts, copy->first);
+            copy = copy->rest;
+        }
+    }
+
+    Expr *after = new_int_expr(first + trips * loop->step, loop->lineno);
+    return append_stmt(stmts, set_counter(loop->counter, after,
+                                          loop->lineno));
+}
+
+// Replaces the loop with
+//
+//      while <cond, with the bound moved by (factor - 1) steps> do
+//          <body for i>; <body for i + step>; ...; i := i + factor * step
+//      od
+//      <the original loop>
+//
+// The first loop keeps the form of a counted loop, so it can still be
+// strength reduced.
+Stmts *unroll_partly(Stmt *orig, Counted *loop) {
+    int lineno = loop->lineno;
+    Stmts *body = NULL;
+    int i;
+    for (i = 0; i < UNROLL_FACTOR; i++) {
+        Stmts *copy = copy_stmts(loop->body);
+        if (i > 0) {
+            subst_stmts(copy, loop->counter,
+                        counter_plus(loop->counter, i * loop->step, lineno));
+        }
+        while (copy != NULL) {
+            body = append_stmt(body, copy->first);
+            copy = copy->rest;
+        }
+    }
+    body = append_stmt(body, set_counter(loop->counter,
+            counter_plus(loop->counter, UNROLL_FACTOR * loop->step, lineno),
+            lineno));
+
+    // i op bound runs the next factor iterations iff i op bound - k does,
+    // for k the distance to the last of them
+    Expr *cond = copy_expr(orig->info.loop.cond);
+    Expr *shift = new_int_expr((UNROLL_FACTOR - 1) * loop->step, lineno);
+    if (cond->e1->kind == EXPR_ID && streq(cond->e1->id, loop->counter)) {
+        cond->e2 = new_binop_expr(BINOP_SUB, cond->e2, shift, INT_TYPE,
+                                  lineno);
+    } else {
+        cond->e1 = new_binop_expr(BINOP_SUB, cond->e1, shift, INT_TYPE,
+                                  lineno);
+    }
+
+    Stmt *unrolled = new_stmt(STMT_WHILE, lineno);
+    unrolled->info.loop.cond = cond;
+    unrolled->info.loop.body = body;
+    return new_stmts_node(unrolled, new_stmts_node(orig, NULL));
+}
+
+Expr *counter_plus(char *counter, int offset, int lineno) {
+    return new_binop_expr(BINOP_ADD, new_id_expr(counter, INT_TYPE, lineno),
+                          new_int_expr(offset, lineno), INT_TYPE, lineno);
+}
+
+Stmt *set_counter(char *counter, Expr *value, int lineno) {
+    Stmt *stmt = new_stmt(STMT_ASSIGN, lineno);
+    stmt->info.assign.asg_ident = new_id_expr(counter, INT_TYPE, lineno);
+    stmt->info.assign.asg_expr = value;
+    return stmt;
+}
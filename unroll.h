@@ -0,0 +1,20 @@
+/* unroll.h */
+
+/*-----------------------------------------------------------------------
+    Developed by: #undef TEAMNAME
+    Provides function definitions and external access rights for
+    unroll.c
+-----------------------------------------------------------------------*/
+#include "ast.h"
+#include "symbol.h"
+
+/*----------------------------------------------------------------------
+    External Functions that will be accessed by other C files.
+-----------------------------------------------------------------------*/
+// Replaces counted while loops with a known, small number of iterations
+// by copies of their bodies, and unrolls other counted loops with small
+// bodies by a factor, leaving the original loop to run the remainder.
+// Must run after analysis, as it relies on inferred types, and before the
+// program is reduced again so the copies fold. Returns the number of
+// loops unrolled.
+int unroll_loops(Program *prog, sym_table *table);
@@ -22,7 +22,10 @@
 #include    "missing.h"
 #include    "pretty.h"
 #include    "wizoptimiser.h"
+#include    "callgraph.h"
 #include    "error_printer.h"
+#include    "passes.h"
+#include    "oztree.h"
 
 const char  *progname;
 const char  *iz_infile;
@@ -41,40 +44,61 @@ main(int argc, char **argv) {
     FILE        *fp = stdout;
     BOOL        pretty_print_only;
     BOOL        analyse_optimise_print;
-    BOOL        optimise;
+    BOOL        print_call_graph;
     BOOL        to_file;
+    BOOL        binary;
 
 
     progname = argv[0];
     pretty_print_only = FALSE;
     analyse_optimise_print = FALSE;
-    optimise = FALSE;
+    print_call_graph = FALSE;
     to_file = FALSE;
+    binary = FALSE;
 
     /* Process command line */
-    if ((argc < 2) || (argc > 3)) {
+    in_filename = NULL;
+    int i;
+    for (i = 1; i < argc; i++) {
+        char *arg = argv[i];
+        if (streq(arg, "-p")) {
+            pretty_print_only = TRUE;
+        } else if (streq(arg, "-c")) {
+            analyse_optimise_print = TRUE;
+        } else if (streq(arg, "-callgraph")) {
+            print_call_graph = TRUE;
+        } else if (streq(arg, "-f")) {
+            to_file = TRUE;
+        } else if (streq(arg, "-b")) {
+            binary = TRUE;
+        } else if (strncmp(arg, "-j", 2) == 0 && arg[2] >= '1'
+                   && arg[2] <= '9' && strspn(arg + 2, "0123456789")
+                   == strlen(arg + 2)) {
+            set_codegen_threads(atoi(arg + 2));
+        } else if (streq(arg, "-time-passes")) {
+            set_time_passes(TRUE);
+        } else if (strlen(arg) == 3 && strncmp(arg, "-O", 2) == 0
+                   && arg[2] >= '0' && arg[2] <= '0' + MAX_OPT_LEVEL) {
+            set_opt_level(arg[2] - '0');
+        } else if (strncmp(arg, "-f", 2) == 0) {
+            if (!set_pass_option(arg)) {
+                fprintf(stderr, "%s: no pass to switch for %s\n",
+                        progname, arg);
+                usage();
+                exit(EXIT_FAILURE);
+            }
+        } else if (arg[0] != '-' && in_filename == NULL) {
+            in_filename = arg;
+        } else {
+            usage();
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (in_filename == NULL) {
         usage();
         exit(EXIT_FAILURE);
     }
-
-    if (argc == 2) {
-        in_filename = argv[1];
-    }
-
-    if (argc == 3 && streq(argv[1], "-p")) {
-        pretty_print_only = TRUE;
-        in_filename = argv[2];
-    }
-    if (argc == 3 && streq(argv[1], "-c")) {
-        analyse_optimise_print = TRUE;
-        in_filename = argv[2];
-    }
-
-    if (argc == 3 && streq(argv[1], "-f")) {
-        to_file = TRUE;
-        in_filename = argv[2];
-    }
-
+    configure_passes();
 
     yyin = fopen(in_filename, "r");
     if (yyin == NULL) {
@@ -103,11 +127,20 @@ main(int argc, char **argv) {
         return 0;
     }
 
-    //Standard compilation
-    reduce_ast(parsed_program);
+    //Standard compilation. Expressions are reduced before analysis, so
+    //that constant errors are caught, if reduce is enabled.
+    PassContext ctx;
+    ctx.prog = parsed_program;
+    ctx.table = NULL;
+    ctx.oz = NULL;
+    run_pass(PASS_REDUCE, &ctx);
+    if (print_call_graph) {
+        dump_call_graph(fp, build_call_graph(parsed_program));
+        return 0;
+    }
     if (to_file) {
         int in_filename_len = strlen(in_filename);
-        char *outfile = checked_malloc((strlen(in_filename) + 4) * sizeof(char));
+        char *outfile = checked_malloc((strlen(in_filename) + 5) * sizeof(char));
         //suffix points to the '.' in filename, assuming it ends in ".wiz"
         const char *suffix = &in_filename[in_filename_len - 4];
 
@@ -126,15 +159,15 @@ main(int argc, char **argv) {
             outfile[in_filename_len + 1] = '\0';
         }
 
-        //finally add the "oz" to end of name
-        const char *ending = "oz";
+        //finally add the "oz" (or "ozb" for binary) to end of name
+        const char *ending = binary ? "ozb" : "oz";
         strcat(outfile, ending);
 
         printf("%s\n", outfile);
-        fp = fopen(outfile, "w");
+        fp = fopen(outfile, binary ? "wb" : "w");
     }
 
-    compile(fp, parsed_program);
+    compile(fp, parsed_program, binary);
     return 0;
 }
 
@@ -142,17 +175,36 @@ main(int argc, char **argv) {
 
 static void
 usage(void) {
-    printf("usage: wiz [-p|-c|-f] iz_source_file\n"
+    printf("usage: wiz [-p|-c|-f|-callgraph] [-b] [-O0|-O1|-O2|-O3]\n"
+           "           [-f<pass>|-fno-<pass>]... [-j<n>] [-time-passes]"
+           " iz_source_file\n"
            "\t -p : Parses program and pretty prints internal\n"
            "\t      representation to stdout.\n"
            "\t -c : Optimise and reduce expressions, printing the before\n"
            "\t      and after results, along with any errors.\n"
            "\t      Output is written to stdout.\n"
+           "\t -callgraph : Print each proc, the number of calls made\n"
+           "\t      to it and the procs it calls, marking those that are\n"
+           "\t      recursive or unreachable from main. Output is written\n"
+           "\t      to stdout.\n"
            "\t -f : Compile with optimisations enabled.\n"
            "\t      Output is written to file WIZ_SOURCE_PREFIX.oz (where\n"
            "\t      WIZ_SOURCE_PREFIX is the prefix of wiz_source_file\n"
            "\t      - i.e. with '.wiz' suffix removed, if present).\n"
-           "\t NO_FLAGS :\n" 
+           "\t -b : Output the program in the binary Oz format, which\n"
+           "\t      oz_text turns back into text (to file\n"
+           "\t      WIZ_SOURCE_PREFIX.ozb with -f).\n"
+           "\t -O0 .. -O3 : Optimisation level (default -O%d). Each level\n"
+           "\t      runs the passes of the levels below it, and:\n",
+           DEFAULT_OPT_LEVEL);
+    print_pass_names(stdout);
+    printf("\t -f<pass>, -fno-<pass> : Run or skip a pass, whatever the\n"
+           "\t      optimisation level.\n"
+           "\t -j<n> : Generate code for the procs on n threads. The\n"
+           "\t      output is the same whatever n is.\n"
+           "\t -time-passes : Report the time, allocations and program\n"
+           "\t      size before and after each pass to stderr.\n"
+           "\t NO_FLAGS :\n"
            "\t      Compile with optimisations enabled.\n"
            "\t      Output is written to stdout.\n");
 
@@ -13,11 +13,52 @@
 #include "helper.h"
 #include "wizoptimiser.h"
 
+/*----------------------------------------------------------------------
+    Internal structures.
+-----------------------------------------------------------------------*/
+
+// Under SHAPE_AUTO, chains with more terms than this are balanced
+#define MAX_CHAIN_TERMS 256
+
+// Starting size of the stack used to linearize an expression
+#define INITIAL_STACK_SIZE 16
+
+// A sub-expression waiting to be linearized
+typedef struct {
+    Expr    *e;
+    BOOL    inverted;   /* under an odd number of subtractions */
+} Term;
+
+// The sub-expressions waiting to be linearized, last pushed on top
+typedef struct {
+    Term    *terms;
+    int     size;
+    int     capacity;
+} TermStack;
+
+ChainShape chain_shape = SHAPE_AUTO;
+
+// Buckets in the table of shared expressions
+#define CONS_BUCKETS 4093
+
+// A shared expression, with its hash and (once known) its reduction
+typedef struct cons {
+    Expr        *e;
+    unsigned    hash;
+    Expr        *reduced;   /* shared node it reduces to, if reduced */
+    struct cons *next;
+} Cons;
+
+Cons *cons_table[CONS_BUCKETS];
+BOOL hash_consing = FALSE;
+
 /*----------------------------------------------------------------------
     Internal function definitions.
 -----------------------------------------------------------------------*/
 void reduce_statements(Stmts *statements);
+Stmts *prune_statements(Stmts *statements);
 
+Expr *reduce_expr_tree(Expr *e);
 void reduce_assigment(Assign *a);
 void reduce_if(Cond *c);
 Expr *reduce_binop(Expr *e);
@@ -25,10 +66,18 @@ Expr *reduce_commutative_multiop(Expr *e);
 Expr *generate_binop_node(BinOp op, Expr *e1, Expr *e2, int lineno);
 BOOL is_identity(Expr *e, BinOp op);
 Expr *fold_expression_list(Exprs *elist, BinOp op);
-Exprs *linearize_expression(Expr *e, BinOp std_op, BinOp inv_op, int num_inv);
+Expr *fold_balanced(Expr **terms, int n, BinOp op);
+Exprs *reverse_expression_list(Exprs *elist);
+Exprs *linearize_expression(Expr *e, BinOp std_op, BinOp inv_op);
+void push_term(TermStack *stack, Expr *e, BOOL inverted);
 Expr *reduce_unop(Expr *e, BOOL recursive);
 Expr *generate_unop_node(UnOp op, Expr *e1, int lineno);
 
+Cons *intern(Expr *e);
+unsigned hash_node(Expr *e);
+unsigned hash_string(char *s);
+BOOL same_node(Expr *a, Expr *b);
+
 /*----------------------------------------------------------------------------
     Calls the reduction procedure on entire program (this provides interface
     between this module with other modules that use it)
@@ -47,6 +96,77 @@ Program *reduce_ast(Program *prog) {
     return optimised;
 }
 
+/*----------------------------------------------------------------------------
+    removes the branches of ifs and whiles whose (reduced) condition is
+    constant and that can never run. Only done after analysis, so errors
+    in such code are still reported. This can leave a proc body, a branch
+    of an if or a loop body empty (NULL), so every later pass must accept
+    empty statement lists.
+----------------------------------------------------------------------------*/
+void remove_dead_branches(Program *prog) {
+    Procs *procs = prog->procedures;
+    while (procs != NULL) {
+        Proc *p = procs->first;
+        p->body->statements = prune_statements(p->body->statements);
+        procs = procs->rest;
+    }
+}
+
+Stmts *prune_statements(Stmts *statements) {
+    Stmts **link = &statements;
+    while (*link != NULL) {
+        Stmt *statement = (*link)->first;
+        Stmts *rest = (*link)->rest;
+        Stmts *branch;
+        Expr *cond;
+
+        switch (statement->kind) {
+            case STMT_COND:
+                cond = statement->info.cond.cond;
+                statement->info.cond.then_branch =
+                    prune_statements(statement->info.cond.then_branch);
+                statement->info.cond.else_branch =
+                    prune_statements(statement->info.cond.else_branch);
+                if (cond->kind != EXPR_CONST) {
+                    break;
+                }
+                //replace the if with the branch it always takes
+                if (cond->constant.val.bool_val) {
+                    branch = statement->info.cond.then_branch;
+                } else {
+                    branch = statement->info.cond.else_branch;
+                }
+                if (branch == NULL) {
+                    *link = rest;
+                    continue;
+                }
+                *link = branch;
+                while (branch->rest != NULL) {
+                    branch = branch->rest;
+                }
+                branch->rest = rest;
+                link = &(branch->rest);
+                continue;
+
+            case STMT_WHILE:
+                cond = statement->info.loop.cond;
+                if (cond->kind == EXPR_CONST && !cond->constant.val.bool_val) {
+                    //a loop that is never entered
+                    *link = rest;
+                    continue;
+                }
+                statement->info.loop.body =
+                    prune_statements(statement->info.loop.body);
+                break;
+
+            default:
+                break;
+        }
+        link = &((*link)->rest);
+    }
+    return statements;
+}
+
 void reduce_statements(Stmts *statements) {
     while (statements != NULL) {
         Stmt *statement = statements->first;
@@ -57,6 +177,7 @@ void reduce_statements(Stmts *statements) {
         // Switch on kind of statement and print appropriately
         switch (kind) {
             case STMT_ASSIGN:
+            case STMT_BIND:
                 reduce_assigment(&info->assign);
                 break;
 
@@ -87,6 +208,9 @@ void reduce_statements(Stmts *statements) {
                     }
                 }
                 break;
+
+            case STMT_ADVANCE:
+                break;
         }
         statements = statements->rest;
     }
@@ -114,11 +238,29 @@ void reduce_if(Cond *c) {
 }
 
 
+/*----------------------------------------------------------------------------
+    reduces an expression (as a statement holds it). with hash consing on,
+    each distinct expression is only reduced once, and a private copy of
+    its shared reduction is returned, as later passes rewrite the ast's
+    expressions in place
+----------------------------------------------------------------------------*/
+Expr *reduce_expression(Expr *e) {
+    if (!hash_consing) {
+        return reduce_expr_tree(e);
+    }
+    Cons *c = intern(e);
+    if (c->reduced == NULL) {
+        c->reduced = hash_cons(reduce_expr_tree(copy_expr(e)));
+    }
+    return copy_expr(c->reduced);
+}
+
+
 /*----------------------------------------------------------------------------
     reduces a generic expression by transfering control to specific
     reduction function based on expression kind
 ----------------------------------------------------------------------------*/
-Expr *reduce_expression(Expr *e) {
+Expr *reduce_expr_tree(Expr *e) {
     //Find the type of an expression
     ExprKind kind = e->kind;
     // Switch on kind to print
@@ -142,7 +284,7 @@ Expr *reduce_expression(Expr *e) {
             if (e) {
                 Exprs *es = e->indices;
                 while (es != NULL) {
-                    es->first = reduce_expression(es->first);
+                    es->first = reduce_expr_tree(es->first);
                     es = es->rest;
                 }
 
@@ -182,8 +324,8 @@ Expr *reduce_binop(Expr *e) {
 
     //now reduce sub expressions recursively for non-commutative cases,
     //and check if they are both constants
-    e->e1 = reduce_expression(e->e1);
-    e->e2 = reduce_expression(e->e2);
+    e->e1 = reduce_expr_tree(e->e1);
+    e->e2 = reduce_expr_tree(e->e2);
     //Get their kinds
     ExprKind e1k = e->e1->kind;
     ExprKind e2k = e->e2->kind;
@@ -260,12 +402,12 @@ Expr *reduce_binop(Expr *e) {
             if (t == INT_TYPE) {
                 new_constant.type = BOOL_TYPE;
                 new_constant.val.bool_val = (e->e1->constant.val.int_val
-                                             < e->e2->constant.val.int_val);
+                                             > e->e2->constant.val.int_val);
             } else if (t == FLOAT_TYPE) {
                 //this is a safe reduction for floats (unambiguous result)
                 new_constant.type = BOOL_TYPE;
                 new_constant.val.bool_val = (e->e1->constant.val.float_val
-                                             < e->e2->constant.val.float_val);
+                                             > e->e2->constant.val.float_val);
             } else {
                 //do nothing in error case
                 return e;
@@ -275,12 +417,12 @@ Expr *reduce_binop(Expr *e) {
             if (t == INT_TYPE) {
                 new_constant.type = BOOL_TYPE;
                 new_constant.val.bool_val = (e->e1->constant.val.int_val
-                                             < e->e2->constant.val.int_val);
+                                             <= e->e2->constant.val.int_val);
             } else if (t == FLOAT_TYPE) {
                 //this is a safe reduction for floats (unambiguous result)
                 new_constant.type = BOOL_TYPE;
                 new_constant.val.bool_val = (e->e1->constant.val.float_val
-                                             < e->e2->constant.val.float_val);
+                                             <= e->e2->constant.val.float_val);
             } else {
                 //do nothing in error case
                 return e;
@@ -290,12 +432,12 @@ Expr *reduce_binop(Expr *e) {
             if (t == INT_TYPE) {
                 new_constant.type = BOOL_TYPE;
                 new_constant.val.bool_val = (e->e1->constant.val.int_val
-                                             < e->e2->constant.val.int_val);
+                                             >= e->e2->constant.val.int_val);
             } else if (t == FLOAT_TYPE) {
                 //this is a safe reduction for floats (unambiguous result)
                 new_constant.type = BOOL_TYPE;
                 new_constant.val.bool_val = (e->e1->constant.val.float_val
-                                             < e->e2->constant.val.float_val);
+                                             >= e->e2->constant.val.float_val);
             } else {
                 //do nothing in error case
                 return e;
@@ -333,7 +475,7 @@ Expr *reduce_commutative_multiop(Expr *e) {
     }
     //linearize expression, converting to list of terms at same precedence
     //level
-    term_list = linearize_expression(e, std_op, inv_op, 0);
+    term_list = linearize_expression(e, std_op, inv_op);
 
     //now scan through the list, folding constant terms onto the RHS
     //expression, and appending others to the left
@@ -342,6 +484,7 @@ Expr *reduce_commutative_multiop(Expr *e) {
     Exprs *pos_list_start = NULL;
     Exprs *neg_list = NULL;
     Exprs *neg_list_start = NULL;
+    int neg_count = 0;
     UnOp neg_op;
     Expr *const_node = checked_malloc(sizeof(Expr));
     const_node->inferred_type = -1;
@@ -370,6 +513,23 @@ Expr *reduce_commutative_multiop(Expr *e) {
         return e;
     }
 
+    //and/or only evaluate their right operands when needed, so their terms
+    //are kept in order, and negated terms are only factorised out when
+    //every term is negated (which does not reorder them)
+    BOOL ordered = (std_op == BINOP_AND || std_op == BINOP_OR);
+    BOOL split_neg = TRUE;
+    if (ordered) {
+        Exprs *terms = term_list;
+        while (terms != NULL) {
+            Expr *t = terms->first;
+            if (t->kind != EXPR_CONST
+                    && !(t->kind == EXPR_UNOP && t->unop == neg_op)) {
+                split_neg = FALSE;
+            }
+            terms = terms->rest;
+        }
+    }
+
     //now perform the scan
     while (term_list != NULL) {
         Expr *next_e = term_list->first;
@@ -403,7 +563,8 @@ Expr *reduce_commutative_multiop(Expr *e) {
             //otherwise we can't reduce this expression, so append it to
             //either positive or negative list
             //check if it is a negative operand first
-            if (next_e->kind == EXPR_UNOP && next_e->unop == neg_op) {
+            if (split_neg && next_e->kind == EXPR_UNOP
+                    && next_e->unop == neg_op) {
                 //append list node to the negative list
                 if (neg_list == NULL) {
                     //if this is first node in neg list set neg_list_start
@@ -418,6 +579,7 @@ Expr *reduce_commutative_multiop(Expr *e) {
                 neg_list->rest = NULL;
                 //prune the negative unary node from the neg_list entry
                 neg_list->first = next_e->e1;
+                neg_count++;
             } else {
                 //otherwise append list node to the positive list
                 if (pos_list == NULL) {
@@ -453,14 +615,25 @@ Expr *reduce_commutative_multiop(Expr *e) {
     } else {
         neglist_binop = BINOP_AND;
     }
+    //the terms of +, * are rebuilt last term first, which tends to leave
+    //the sub-expressions common to several chains (invariants written
+    //after a varying term) grouped together for cse
+    if (!ordered) {
+        pos_list_start = reverse_expression_list(pos_list_start);
+        neg_list_start = reverse_expression_list(neg_list_start);
+    }
     Expr *pos_expr = fold_expression_list(pos_list_start, std_op);
     Expr *neg_expr = fold_expression_list(neg_list_start, neglist_binop);
 
+    //a product of an even number of negated terms is not negated
+    BOOL negate = (std_op != BINOP_MUL || neg_count % 2 == 1);
+
     //form reduced_expr from pos_expr and neg_expr
     Expr *reduced_expr = NULL;
     if (pos_expr == NULL && neg_expr != NULL) {
         //make sure to enclose the neg_expr in negative node
-        reduced_expr = generate_unop_node(neg_op, neg_expr, e->lineno);
+        reduced_expr = negate
+            ? generate_unop_node(neg_op, neg_expr, e->lineno) : neg_expr;
     } else if (neg_expr == NULL && pos_expr != NULL) {
         reduced_expr = pos_expr;
     } else if (pos_expr != NULL && neg_expr != NULL) {
@@ -472,7 +645,9 @@ Expr *reduce_commutative_multiop(Expr *e) {
         } else {
             //for others, need to explicitly negate the negative terms
             combine_binop = std_op;
-            neg_expr = generate_unop_node(neg_op, neg_expr, e->lineno);
+            if (negate) {
+                neg_expr = generate_unop_node(neg_op, neg_expr, e->lineno);
+            }
         }
         //now combine them
         reduced_expr = generate_binop_node(combine_binop, pos_expr,
@@ -559,9 +734,20 @@ BOOL is_identity(Expr *e, BinOp op) {
 }
 
 
+/*----------------------------------------------------------------------------
+    sets the shape chains of terms are folded into (see wizoptimiser.h)
+----------------------------------------------------------------------------*/
+void set_chain_shape(ChainShape shape) {
+    chain_shape = shape;
+}
+
+
 /*----------------------------------------------------------------------------
     folds the expression list given by elist, using the commutative
-    operator op, into a left-heavy binary expression tree
+    operator op, into a binary expression tree keeping the terms in order:
+    either a left chain ((a op b) op c) op d, or a balanced tree
+    (a op b) op (c op d), whose depth only grows with the log of the
+    number of terms
 ----------------------------------------------------------------------------*/
 Expr *fold_expression_list(Exprs *elist, BinOp op) {
     //trivial cases
@@ -570,88 +756,314 @@ Expr *fold_expression_list(Exprs *elist, BinOp op) {
     } else if (elist->rest == NULL) {
         return elist->first;
     }
-    //main, recursive case
-    else {
-        //call recursively on rest of list, and put the recursively
-        //built expression on left (left growing tree)
-        Expr *e_left = fold_expression_list(elist->rest, op);
-        return generate_binop_node(op, e_left, elist->first, e_left->lineno);
+
+    int n = 0;
+    Exprs *terms;
+    for (terms = elist; terms != NULL; terms = terms->rest) {
+        n++;
+    }
+
+    if (chain_shape == SHAPE_LEFT_CHAIN
+            || (chain_shape == SHAPE_AUTO && n <= MAX_CHAIN_TERMS)) {
+        //grow the chain to the right, one term at a time
+        Expr *chain = elist->first;
+        for (terms = elist->rest; terms != NULL; terms = terms->rest) {
+            chain = generate_binop_node(op, chain, terms->first,
+                                        chain->lineno);
+        }
+        return chain;
+    }
+
+    //otherwise put the terms in an array, and split it in halves
+    Expr **array = (Expr **) checked_malloc(n * sizeof(Expr *));
+    int i = 0;
+    for (terms = elist; terms != NULL; terms = terms->rest) {
+        array[i++] = terms->first;
+    }
+    Expr *tree = fold_balanced(array, n, op);
+    free(array);
+    return tree;
+}
+
+/*----------------------------------------------------------------------------
+    folds n terms of an array into a balanced tree (recursing only as deep
+    as the tree)
+----------------------------------------------------------------------------*/
+Expr *fold_balanced(Expr **terms, int n, BinOp op) {
+    if (n == 1) {
+        return terms[0];
+    }
+    int half = n / 2;
+    Expr *left = fold_balanced(terms, half, op);
+    Expr *right = fold_balanced(terms + half, n - half, op);
+    return generate_binop_node(op, left, right, left->lineno);
+}
+
+
+/*----------------------------------------------------------------------------
+    reverses a list of expressions in place, returning the new head
+----------------------------------------------------------------------------*/
+Exprs *reverse_expression_list(Exprs *elist) {
+    Exprs *reversed = NULL;
+    while (elist != NULL) {
+        Exprs *next = elist->rest;
+        elist->rest = reversed;
+        reversed = elist;
+        elist = next;
     }
+    return reversed;
 }
 
 
 /*----------------------------------------------------------------------------
     linearizes the expression, converting it to list of operands of the
-    given commutative operator (std_op)
+    given commutative operator (std_op), in the order they are written
     in the case of addition, we also take into account inversions from
     the subtaction operator (expressions that are inverted an odd number
     of times have unary minus node attached)
     also performs recursive reductions of the individual terms
+    the tree is walked with an explicit stack of pending sub-expressions
+    and the list is built by appending to its tail, so this takes time
+    linear in the number of terms however the tree is shaped
 ----------------------------------------------------------------------------*/
-Exprs *linearize_expression(Expr *e, BinOp std_op, BinOp inv_op, int num_inv) {
+Exprs *linearize_expression(Expr *e, BinOp std_op, BinOp inv_op) {
     Exprs *e_list = NULL;
-    if (e->kind == EXPR_BINOP && e->binop == std_op) {
-        //linearise LHS sub-expression
-        e_list = linearize_expression(e->e1, std_op, inv_op, num_inv);
-        //traverse to end of list
-        Exprs *tmp_list = e_list;
-        while (tmp_list->rest != NULL) {
-            tmp_list = tmp_list->rest;
-        }
-        //linearise RHS sub-expression and append
-        tmp_list->rest = linearize_expression(e->e2, std_op, inv_op, num_inv);
-    } else if (e->kind == EXPR_BINOP && e->binop == inv_op) {
-        //same as previous case, but number of inversions is increased by
-        //one for RHS sub-expression
-        e_list = linearize_expression(e->e1, std_op, inv_op, num_inv);
-        Exprs *tmp_list = e_list;
-        while (tmp_list->rest != NULL) {
-            tmp_list = tmp_list->rest;
+    Exprs **tail = &e_list;
+    TermStack stack;
+    stack.size = 0;
+    stack.capacity = INITIAL_STACK_SIZE;
+    stack.terms = (Term *) checked_malloc(stack.capacity * sizeof(Term));
+    push_term(&stack, e, FALSE);
+
+    while (stack.size > 0) {
+        Term top = stack.terms[--stack.size];
+        e = top.e;
+        if (e->kind == EXPR_BINOP && (e->binop == std_op
+                                      || e->binop == inv_op)) {
+            //linearise the LHS first, so push it last. the RHS of the
+            //inverse operation is inverted once more
+            push_term(&stack, e->e2, top.inverted ^ (e->binop == inv_op));
+            push_term(&stack, e->e1, top.inverted);
+            continue;
         }
-        tmp_list->rest = linearize_expression(e->e2, std_op, inv_op, num_inv + 1);
-    } else {
+
         //in any other case the expression is a single term, so reduce
         //and continue linearizing if possible (the reduction
-        //might create further scope), or terminate by returning a singleton
-        //list node and reducing recursively
-
-        //first, invert the expression if necessary
-        Expr *e1;
-        //if odd number of inversions, invert the expression
-        if (num_inv % 2 == 1) {
-            //invert expression (add unary minus node)
-            Expr *inv_node = (Expr *) checked_malloc(sizeof(Expr));
-            inv_node->kind = EXPR_UNOP;
-            inv_node->lineno = e->lineno;
-            inv_node->unop = UNOP_MINUS;
-            inv_node->e1 = e;
-            e1 = inv_node;
-        } else {
-            e1 = e;
+        //might create further scope)
+
+        //first, if inverted an odd number of times, invert the expression
+        //(add unary minus node)
+        Expr *e1 = e;
+        if (top.inverted) {
+            e1 = generate_unop_node(UNOP_MINUS, e, e->lineno);
         }
         //if e1 is unary, there could be scope for further
         //linearization, so try a non-recursive reduction
         if (e1->kind == EXPR_UNOP) {
             e1 = reduce_unop(e1, FALSE);
             //if there is scope to continue linearising reduced expression,
-            //then call recursively to continue
+            //push it back (any inversion is now part of it)
             if (e1->kind == EXPR_BINOP && (e1->binop == std_op
                                            || e1->binop == inv_op)) {
-                e_list = linearize_expression(e1, std_op, inv_op, num_inv);
+                push_term(&stack, e1, FALSE);
+                continue;
             }
         }
-        if (e_list == NULL) {
-            //otherwise we are at base case of the recursive search, so
-            //create a list node, and populate, after performing
-            //a fully recursive reduction
-            e_list = (Exprs *) checked_malloc(sizeof(Exprs));
-            e_list->first = reduce_expression(e1);
-            e_list->rest = NULL;
-        }
+        //otherwise we have a term, so append a list node after
+        //performing a fully recursive reduction
+        *tail = (Exprs *) checked_malloc(sizeof(Exprs));
+        (*tail)->first = reduce_expr_tree(e1);
+        (*tail)->rest = NULL;
+        tail = &((*tail)->rest);
     }
+
+    free(stack.terms);
     return e_list;
 }
 
+/*----------------------------------------------------------------------------
+    pushes a sub-expression to be linearized, doubling the stack if full
+----------------------------------------------------------------------------*/
+void push_term(TermStack *stack, Expr *e, BOOL inverted) {
+    if (stack->size == stack->capacity) {
+        Term *old = stack->terms;
+        stack->capacity *= 2;
+        stack->terms = (Term *) checked_malloc(stack->capacity
+                                               * sizeof(Term));
+        memcpy(stack->terms, old, stack->size * sizeof(Term));
+        free(old);
+    }
+    stack->terms[stack->size].e = e;
+    stack->terms[stack->size].inverted = inverted;
+    stack->size++;
+}
+
+/*----------------------------------------------------------------------------
+    turns memoised reduction through the table of shared expressions on or
+    off (see wizoptimiser.h)
+----------------------------------------------------------------------------*/
+void set_hash_consing(BOOL on) {
+    hash_consing = on;
+}
+
+
+/*----------------------------------------------------------------------------
+    returns the shared node structurally identical to e (its sub-expressions
+    shared in turn), so two expressions are equal iff their shared nodes
+    are the same node. inferred types are part of the structure, as code
+    generation relies on those of reduced expressions, but line numbers
+    are those of the first expression interned
+----------------------------------------------------------------------------*/
+Expr *hash_cons(Expr *e) {
+    return intern(e)->e;
+}
+
+/*----------------------------------------------------------------------------
+    finds (or adds) the table entry for e, interning its sub-expressions
+    first so that nodes can be compared and hashed by their children's
+    addresses alone
+----------------------------------------------------------------------------*/
+Cons *intern(Expr *e) {
+    //build the candidate node over shared children
+    Expr node = *e;
+    Exprs *indices = NULL;
+    Exprs **tail = &indices;
+    Exprs *es;
+    switch (e->kind) {
+        case EXPR_BINOP:
+            node.e2 = hash_cons(e->e2);
+            // fall through
+        case EXPR_UNOP:
+            node.e1 = hash_cons(e->e1);
+            break;
+        case EXPR_ARRAY:
+            for (es = e->indices; es != NULL; es = es->rest) {
+                *tail = (Exprs *) checked_malloc(sizeof(Exprs));
+                (*tail)->first = hash_cons(es->first);
+                (*tail)->rest = NULL;
+                tail = &((*tail)->rest);
+            }
+            node.indices = indices;
+            break;
+        default:
+            break;
+    }
+
+    unsigned hash = hash_node(&node);
+    Cons **bucket = &cons_table[hash % CONS_BUCKETS];
+    Cons *c;
+    for (c = *bucket; c != NULL; c = c->next) {
+        if (c->hash == hash && same_node(c->e, &node)) {
+            return c;
+        }
+    }
+
+    c = (Cons *) checked_malloc(sizeof(Cons));
+    c->e = (Expr *) checked_malloc(sizeof(Expr));
+    *(c->e) = node;
+    c->hash = hash;
+    c->reduced = NULL;
+    c->next = *bucket;
+    *bucket = c;
+    return c;
+}
+
+/*----------------------------------------------------------------------------
+    hashes a node whose sub-expressions are already shared
+----------------------------------------------------------------------------*/
+unsigned hash_node(Expr *e) {
+    unsigned hash = e->kind * 31 + e->inferred_type;
+    unsigned bits = 0;
+    Exprs *es;
+    switch (e->kind) {
+        case EXPR_ID:
+            hash = hash * 31 + hash_string(e->id);
+            break;
+        case EXPR_CONST:
+            hash = hash * 31 + e->constant.type;
+            switch (e->constant.type) {
+                case BOOL_TYPE:
+                    hash = hash * 31 + e->constant.val.bool_val;
+                    break;
+                case INT_TYPE:
+                    hash = hash * 31 + (unsigned) e->constant.val.int_val;
+                    break;
+                case FLOAT_TYPE:
+                    memcpy(&bits, &(e->constant.val.float_val), sizeof(bits));
+                    hash = hash * 31 + bits;
+                    break;
+                case STRING_CONST:
+                    hash = hash * 31 + hash_string(e->constant.val.string);
+                    break;
+                default:
+                    break;
+            }
+            break;
+        case EXPR_BINOP:
+            hash = hash * 31 + e->binop;
+            hash = hash * 31 + (unsigned) (size_t) e->e1;
+            hash = hash * 31 + (unsigned) (size_t) e->e2;
+            break;
+        case EXPR_UNOP:
+            hash = hash * 31 + e->unop;
+            hash = hash * 31 + (unsigned) (size_t) e->e1;
+            break;
+        case EXPR_ARRAY:
+            hash = hash * 31 + hash_string(e->id);
+            for (es = e->indices; es != NULL; es = es->rest) {
+                hash = hash * 31 + (unsigned) (size_t) es->first;
+            }
+            break;
+    }
+    return hash;
+}
+
+unsigned hash_string(char *s) {
+    unsigned hash = 5381;
+    while (*s != '\0') {
+        hash = hash * 33 + (unsigned char) *s++;
+    }
+    return hash;
+}
+
+/*----------------------------------------------------------------------------
+    compares two nodes whose sub-expressions are already shared, so their
+    children are equal iff they are the same node
+----------------------------------------------------------------------------*/
+BOOL same_node(Expr *a, Expr *b) {
+    Exprs *as, *bs;
+    if (a->kind != b->kind || a->inferred_type != b->inferred_type) {
+        return FALSE;
+    }
+    switch (a->kind) {
+        case EXPR_ID:
+            return streq(a->id, b->id);
+        case EXPR_CONST:
+            //shallow nodes, so structural equality is cheap
+            return exprs_equal(a, b);
+        case EXPR_BINOP:
+            return a->binop == b->binop && a->e1 == b->e1 && a->e2 == b->e2;
+        case EXPR_UNOP:
+            return a->unop == b->unop && a->e1 == b->e1;
+        case EXPR_ARRAY:
+            if (!streq(a->id, b->id)) {
+                return FALSE;
+            }
+            as = a->indices;
+            bs = b->indices;
+            while (as != NULL && bs != NULL) {
+                if (as->first != bs->first) {
+                    return FALSE;
+                }
+                as = as->rest;
+                bs = bs->rest;
+            }
+            return as == NULL && bs == NULL;
+    }
+    return FALSE;
+}
+
+
 /*----------------------------------------------------------------------------
     Reduces a unop expression, removing double negatives and expanding over
     over binary sub-expressions where appropriate. Also folds expression if
@@ -680,10 +1092,10 @@ Expr *reduce_unop(Expr *e, BOOL recursive) {
                 e1->e1 = generate_unop_node(UNOP_MINUS, e1->e1, e1->lineno);
                 e_shallow_reduced = e1;
             } else if (e1->kind == EXPR_BINOP && e1->binop == BINOP_MUL) {
-                //reduce -(a*b) to (-a)*(-b)
-                //place minus around each sub expression
+                //reduce -(a*b) to (-a)*b, negating only one factor (if a
+                //is itself a chain of + and -, every term of it is then
+                //negated when it is reduced)
                 e1->e1 = generate_unop_node(UNOP_MINUS, e1->e1, e1->lineno);
-                e1->e2 = generate_unop_node(UNOP_MINUS, e1->e2, e1->lineno);
                 e_shallow_reduced = e1;
             }
             //do not do above for divide, as we do not try to re-arrange
@@ -704,7 +1116,7 @@ Expr *reduce_unop(Expr *e, BOOL recursive) {
             //generated), based on whether unop reduction is recursive
             if (e_shallow_reduced != NULL) {
                 if (recursive) {
-                    return reduce_expression(e_shallow_reduced);
+                    return reduce_expr_tree(e_shallow_reduced);
                 } else {
                     return e_shallow_reduced;
                 }
@@ -712,7 +1124,7 @@ Expr *reduce_unop(Expr *e, BOOL recursive) {
 
             //if we fail to find reduction above, reduce sub-expression now
             if (recursive) {
-                e1 = reduce_expression(e1);
+                e1 = reduce_expr_tree(e1);
             }
             //We have to change it into a negative value
             if (e1->kind == EXPR_CONST && !(e1->constant.type == BOOL_TYPE)) {
@@ -786,7 +1198,7 @@ Expr *reduce_unop(Expr *e, BOOL recursive) {
             //generated), based on whether unop reduction is recursive
             if (e_shallow_reduced != NULL) {
                 if (recursive) {
-                    return reduce_expression(e_shallow_reduced);
+                    return reduce_expr_tree(e_shallow_reduced);
                 } else {
                     return e_shallow_reduced;
                 }
@@ -794,7 +1206,7 @@ Expr *reduce_unop(Expr *e, BOOL recursive) {
 
             //otherwise reduce e1, and check if it is constant
             if (recursive) {
-                e1 = reduce_expression(e1);
+                e1 = reduce_expr_tree(e1);
             }
             if (e1->kind == EXPR_CONST && e1->constant.type == BOOL_TYPE) {
                 Expr *new_expr = checked_malloc(sizeof(Expr));
@@ -5,6 +5,9 @@
     Provides function definitions and external access rights for
     ozoptimiser.h
 -----------------------------------------------------------------------*/
+#ifndef WIZOPTIMISER_H
+#define WIZOPTIMISER_H
+
 #include <stdio.h>
 #include "std.h"
 #include "ast.h"
@@ -12,5 +15,26 @@
     Structures and enums needed from other files.
 -----------------------------------------------------------------------*/
 
+// The shape a chain of terms of a commutative operator is rebuilt in. A
+// left chain needs the fewest registers to evaluate, but is as deep as it
+// is long; a balanced tree keeps long chains shallow for every pass that
+// recurses over them. SHAPE_AUTO balances only very long chains.
+typedef enum {
+    SHAPE_LEFT_CHAIN, SHAPE_BALANCED, SHAPE_AUTO
+} ChainShape;
+
 Program *reduce_ast(Program *p);
+void remove_dead_branches(Program *prog);
 Expr *reduce_expression(Expr *e);
+void set_chain_shape(ChainShape shape);
+
+// The one shared node for every expression structurally identical to e
+// (with the same inferred types), so that comparing shared nodes by
+// address compares expressions. Shared nodes must never be modified.
+Expr *hash_cons(Expr *e);
+
+// Turns on (or off) memoised reduction: each distinct expression is then
+// reduced only once, through its shared node
+void set_hash_consing(BOOL on);
+
+#endif